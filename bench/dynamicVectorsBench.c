@@ -0,0 +1,97 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* Microbenchmark of the DYNV generic vector: PushBack and DeleteAt at 10k and 100k elements.
+   DeleteAt keeps the order and moves the tail, SwapDeleteAt is timed next to it for comparison.
+   Build and run with: make dynamicVectorsBench && ./build/dynamicVectorsBench */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../library/dynamicVectors.h"
+
+/* Every run deletes this fraction of the elements from the middle of the vector */
+#define BENCH_DELETE_DIVIDER	10
+
+static double getElapsedNanoseconds(struct timespec *start, struct timespec *end)
+{
+    return (double) (end->tv_sec - start->tv_sec) * 1e9 + (double) (end->tv_nsec - start->tv_nsec);
+}
+
+static void deleteNothing(void *TheElementToDelete)
+{
+    (void) TheElementToDelete;
+}
+
+static void fillVector(DYNV_VectorGenericDataType *TheVector, int elementsNumber)
+{
+    int i;
+
+    for (i = 0; i < elementsNumber; i++)
+        TheVector->PushBack(TheVector, &i, sizeof(int));
+}
+
+static void runBenchmark(int elementsNumber)
+{
+    int i, deletesNumber = elementsNumber / BENCH_DELETE_DIVIDER;
+    struct timespec start, end;
+    double pushBackTime, deleteAtTime, swapDeleteAtTime;
+    DYNV_VectorGenericDataType theVector;
+
+    DYNV_VectorGeneric_Init(&theVector);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    fillVector(&theVector, elementsNumber);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pushBackTime = getElapsedNanoseconds(&start, &end);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < deletesNumber; i++)
+        theVector.DeleteAt(&theVector, theVector.Size / 2, deleteNothing);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    deleteAtTime = getElapsedNanoseconds(&start, &end);
+    theVector.SoftDestroy(&theVector);
+
+    DYNV_VectorGeneric_Init(&theVector);
+    fillVector(&theVector, elementsNumber);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < deletesNumber; i++)
+        theVector.SwapDeleteAt(&theVector, theVector.Size / 2, deleteNothing);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    swapDeleteAtTime = getElapsedNanoseconds(&start, &end);
+    theVector.SoftDestroy(&theVector);
+
+    printf("%7d elements: PushBack %8.1f ns/op, DeleteAt %8.1f ns/op, SwapDeleteAt %8.1f ns/op (%d deletes)\n",
+           elementsNumber,
+           pushBackTime / elementsNumber,
+           deleteAtTime / deletesNumber,
+           swapDeleteAtTime / deletesNumber,
+           deletesNumber);
+}
+
+int main(void)
+{
+    runBenchmark(10000);
+    runBenchmark(100000);
+    return 0;
+}
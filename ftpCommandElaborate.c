@@ -33,9 +33,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <errno.h>
 
 #include "ftpData.h"
 #include "ftpServer.h"
+#include "ftpTransfer.h"
 #include "library/logFunctions.h"
 #include "library/fileManagement.h"
 #include "library/configRead.h"
@@ -113,6 +115,17 @@ int parseCommandSite(ftpDataType * data, int socketId)
             break;
         }
     }
+    else if(compareStringCaseInsensitive(theCommand, "TLSSTAT", strlen("TLSSTAT")) == 1)
+    {
+        returnCode = socketPrintf(data, socketId, "slslslsls", "200 TLS data connections: ",
+                                  (long long int) __atomic_load_n(&data->tlsStatistics.kernelTlsSessions, __ATOMIC_RELAXED), " kernel, ",
+                                  (long long int) __atomic_load_n(&data->tlsStatistics.userTlsSessions, __ATOMIC_RELAXED), " user space, ",
+                                  (long long int) __atomic_load_n(&data->tlsStatistics.resumedTlsSessions, __ATOMIC_RELAXED), " resumed, ",
+                                  (long long int) __atomic_load_n(&data->tlsStatistics.fullTlsHandshakes, __ATOMIC_RELAXED), " full handshakes\r\n");
+
+        if (returnCode <= 0)
+            return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+    }
     else
     {
     	returnCode = socketPrintf(data, socketId, "s", "500 unknown extension\r\n");
@@ -134,9 +147,10 @@ int parseCommandPass(ftpDataType * data, int socketId)
     thePass = getFtpCommandArg("PASS", data->clients[socketId].theCommandReceived, 0);
 
     strcpy(element.ipAddress, data->clients[socketId].clientIpAddress);
-    element.failTimeStamp = time(NULL);
+    element.failTimeStamp = TWHEEL_GetCoarseTime();
     element.failureNumbers = 1;
 
+    pthread_mutex_lock(&data->loginFailsMutex);
     searchPosition = data->loginFailsVector.SearchElement(&data->loginFailsVector, &element);
 
     if (searchPosition != -1)
@@ -145,6 +159,7 @@ int parseCommandPass(ftpDataType * data, int socketId)
         {
             if (((loginFailsDataType *) data->loginFailsVector.Data[searchPosition])->failureNumbers >= data->ftpParameters.maximumUserAndPassowrdLoginTries)
             {
+                pthread_mutex_unlock(&data->loginFailsMutex);
                 //printf("\n TOO MANY LOGIN FAILS! \n");
                 data->clients[socketId].closeTheClient = 1;
                 returnCode = socketPrintf(data, socketId, "s", "430 Too many login failure detected, your ip will be blacklisted for 5 minutes\r\n");
@@ -153,6 +168,7 @@ int parseCommandPass(ftpDataType * data, int socketId)
             }
         }
     }
+    pthread_mutex_unlock(&data->loginFailsMutex);
 
     if (strlen(thePass) >= 1)
     {
@@ -185,16 +201,7 @@ int parseCommandPass(ftpDataType * data, int socketId)
         {
             
             //Record the login fail!
-            if (searchPosition == -1)
-            {
-                if (data->ftpParameters.maximumUserAndPassowrdLoginTries != 0)
-                    data->loginFailsVector.PushBack(&data->loginFailsVector, &element, sizeof(loginFailsDataType));
-            }
-            else
-            {
-                ((loginFailsDataType *) data->loginFailsVector.Data[searchPosition])->failureNumbers++;
-                ((loginFailsDataType *) data->loginFailsVector.Data[searchPosition])->failTimeStamp = time(NULL);
-            }
+            recordLoginFail(data, &element);
             returnCode = socketPrintf(data, socketId, "s", "430 Invalid username or password\r\n");
             if (returnCode <= 0)
             	return FTP_COMMAND_PROCESSED_WRITE_ERROR;
@@ -227,16 +234,7 @@ int parseCommandPass(ftpDataType * data, int socketId)
     {
 
         //Record the login fail!
-        if (searchPosition == -1)
-        {
-            if (data->ftpParameters.maximumUserAndPassowrdLoginTries != 0)
-                data->loginFailsVector.PushBack(&data->loginFailsVector, &element, sizeof(loginFailsDataType));
-        }
-        else
-        {
-            ((loginFailsDataType *) data->loginFailsVector.Data[searchPosition])->failureNumbers++;
-            ((loginFailsDataType *) data->loginFailsVector.Data[searchPosition])->failTimeStamp = time(NULL);
-        }
+        recordLoginFail(data, &element);
 
         returnCode = socketPrintf(data, socketId, "s", "430 Invalid username or password\r\n");
         if (returnCode <= 0)
@@ -261,6 +259,11 @@ int parseCommandAuth(ftpDataType * data, int socketId)
 		if (returnCode <= 0)
 			return FTP_COMMAND_PROCESSED_WRITE_ERROR;
 
+		//The reply must leave in clear before the handshake
+		if (flushClientOutput(data, socketId) < 0 ||
+			data->clients[socketId].outputBytes > 0)
+			return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+
 		returnCode = SSL_set_fd(data->clients[socketId].ssl, data->clients[socketId].socketDescriptor);
 
 		if (returnCode == 0)
@@ -269,19 +272,21 @@ int parseCommandAuth(ftpDataType * data, int socketId)
 		}
 
 		returnCodeTls = SSL_accept(data->clients[socketId].ssl);
-		data->clients[socketId].tlsNegotiatingTimeStart = (int)time(NULL);
 
 		if (returnCodeTls <= 0)
 		{
 			//printf("\nSSL NOT YET ACCEPTED: %d", returnCodeTls);
+			TWHEEL_WheelDataType *theTimers = &data->connectionData[data->clients[socketId].reactorId].timers;
 			data->clients[socketId].tlsIsEnabled = 0;
 			data->clients[socketId].tlsIsNegotiating = 1;
+			TWHEEL_Start(theTimers, &data->clients[socketId].tlsNegotiatingTimer, theTimers->currentTime + TLS_NEGOTIATING_TIMEOUT + 1);
 		}
 		else
 		{
 			//printf("\nSSL ACCEPTED");
 			data->clients[socketId].tlsIsEnabled = 1;
 			data->clients[socketId].tlsIsNegotiating = 0;
+			TRANSPORT_InitTls(&data->clients[socketId].transport, data->clients[socketId].socketDescriptor, data->clients[socketId].ssl);
 		}
 	#endif
 
@@ -412,11 +417,23 @@ int parseCommandCcc(ftpDataType * data, int socketId)
 	#ifdef OPENSSL_ENABLED
 
     returnCode = socketPrintf(data, socketId, "s", "200 TLS connection aborted\r\n");
-    SSL_set_shutdown(data->clients[socketId].ssl, SSL_SENT_SHUTDOWN);
-    data->clients[socketId].tlsIsEnabled = 0;
 
-    if (returnCode <= 0)
+    //The reply still leaves protected
+    if (returnCode <= 0 ||
+        flushClientOutput(data, socketId) < 0 ||
+        data->clients[socketId].outputBytes > 0)
         return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+
+    //Send the close notify, the reactor waits the client one before going plain
+    if (data->clients[socketId].tlsIsEnabled == 1)
+    {
+        data->clients[socketId].tlsIsEnabled = 0;
+
+        if (SSL_shutdown(data->clients[socketId].ssl) == 0)
+            data->clients[socketId].tlsIsClosing = 1;
+        else
+            TRANSPORT_InitPlain(&data->clients[socketId].transport, data->clients[socketId].socketDescriptor);
+    }
 	#endif
 
 	#ifndef OPENSSL_ENABLED
@@ -485,35 +502,89 @@ int parseCommandModeS(ftpDataType * data, int socketId)
     return FTP_COMMAND_PROCESSED;
 }
 
+/* Hand the transfer command to the worker of the data connection, refused if the worker has given it up */
+static int sendCommandToWorker(ftpDataType * data, int socketId)
+{
+    int returnCode, isRefused;
+
+    pthread_mutex_lock(&data->clients[socketId].conditionMutex);
+    isRefused = (data->clients[socketId].workerData.threadIsAlive == 0 || data->clients[socketId].workerData.abortTransfer == 1);
+
+    if (isRefused == 0)
+    {
+        strcpy(data->clients[socketId].workerData.theCommandReceived, data->clients[socketId].theCommandReceived);
+        data->clients[socketId].workerData.commandCode = data->clients[socketId].commandCode;
+        data->clients[socketId].workerData.commandReceived = 1;
+        pthread_cond_signal(&data->clients[socketId].conditionVariable);
+    }
+    pthread_mutex_unlock(&data->clients[socketId].conditionMutex);
+
+    if (isRefused == 1)
+    {
+        returnCode = socketPrintf(data, socketId, "s", "425 No data connection\r\n");
+
+        if (returnCode <= 0)
+            return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+    }
+
+    return FTP_COMMAND_PROCESSED;
+}
+
 int parseCommandPasv(ftpDataType * data, int socketId)
 {
-    /* Create worker thread */
-    void *pReturn;
     int returnCode;
-    //printf("\n data->clients[%d].workerData.workerThread = %d",socketId,  (int)data->clients[socketId].workerData.workerThread);
 
-    //printf("\n data->clients[%d].workerData.threadHasBeenCreated = %d", socketId,  data->clients[socketId].workerData.threadHasBeenCreated);
+    /* Stop the previous data connection and queue a new one on the worker pool */
     if (data->clients[socketId].workerData.threadIsAlive == 1)
     {
     	cancelWorker(data, socketId);
     }
 
-    if (data->clients[socketId].workerData.threadHasBeenCreated == 1)
+    /* The pool thread is still releasing it, the command runs again when it is gone */
+    if (data->clients[socketId].workerData.threadIsAlive == 1)
+        return FTP_COMMAND_DEFERRED;
+
+    /* The listener is ready before the reply, the worker only has to accept */
+    data->clients[socketId].workerData.passiveListeningSocket = PORTPOOL_Acquire(&data->passivePorts, &data->clients[socketId].workerData.connectionPort);
+
+    if (data->clients[socketId].workerData.passiveListeningSocket == -1)
     {
-    	returnCode = pthread_join(data->clients[socketId].workerData.workerThread, &pReturn);
-    	printf("\nPASV JOIN RETURN STATUS %d", returnCode);
+        returnCode = socketPrintf(data, socketId, "s", "425 No passive port available\r\n");
+
+        if (returnCode <= 0)
+            return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+
+        return FTP_COMMAND_PROCESSED;
     }
 
     data->clients[socketId].workerData.passiveModeOn = 1;
     data->clients[socketId].workerData.activeModeOn = 0;    
-    returnCode = pthread_create(&data->clients[socketId].workerData.workerThread, NULL, connectionWorkerHandle, (void *) &data->clients[socketId].clientProgressiveNumber);
+    data->clients[socketId].workerData.threadIsAlive = 1;
+
+    if (data->ftpParameters.eventDrivenTransfers == 1)
+        returnCode = startEventTransfer(data, socketId);
+    else
+        returnCode = WPOOL_Submit(&data->workerPool, data->clients[socketId].clientProgressiveNumber);
 
     if (returnCode != 0)
     {
-    	//printf("\nError in pthread_create %d", returnCode);
-    	return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+    	//The data connection can't be started, the client can retry later
+    	releasePassiveSocket(data, data->clients[socketId].workerData.passiveListeningSocket, data->clients[socketId].workerData.connectionPort);
+    	resetWorkerData(data, socketId, 0);
+    	data->clients[socketId].workerData.threadIsAlive = 0;
+    	returnCode = socketPrintf(data, socketId, "s", "425 Can't open data connection\r\n");
+
+    	if (returnCode <= 0)
+    		return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+
+    	return FTP_COMMAND_PROCESSED;
     }
 
+    returnCode = socketPrintf(data, socketId, "sdsdsdsdsdsds", "227 Entering Passive Mode (", data->clients[socketId].serverIpAddressInteger[0], ",", data->clients[socketId].serverIpAddressInteger[1], ",", data->clients[socketId].serverIpAddressInteger[2], ",", data->clients[socketId].serverIpAddressInteger[3], ",", (data->clients[socketId].workerData.connectionPort / 256), ",", (data->clients[socketId].workerData.connectionPort % 256), ")\r\n");
+
+    if (returnCode <= 0)
+        return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+
     return FTP_COMMAND_PROCESSED;
 }
 
@@ -523,30 +594,49 @@ int parseCommandPort(ftpDataType * data, int socketId)
     char *theIpAndPort;
     int ipAddressBytes[4];
     int portBytes[2];
-    theIpAndPort = getFtpCommandArg("PORT", data->clients[socketId].theCommandReceived, 0);    
-    sscanf(theIpAndPort, "%d,%d,%d,%d,%d,%d", &ipAddressBytes[0], &ipAddressBytes[1], &ipAddressBytes[2], &ipAddressBytes[3], &portBytes[0], &portBytes[1]);
-    data->clients[socketId].workerData.connectionPort = (portBytes[0]*256)+portBytes[1];
-    returnCode = snprintf(data->clients[socketId].workerData.activeIpAddress, CLIENT_BUFFER_STRING_SIZE, "%d.%d.%d.%d", ipAddressBytes[0],ipAddressBytes[1],ipAddressBytes[2],ipAddressBytes[3]);
 
-    void *pReturn;
+    //Stop the previous data connection first, its cleanup resets the worker data
     if (data->clients[socketId].workerData.threadIsAlive == 1)
     {
     	cancelWorker(data, socketId);
     }
 
-    if (data->clients[socketId].workerData.threadHasBeenCreated == 1)
-    {
-    	returnCode = pthread_join(data->clients[socketId].workerData.workerThread, &pReturn);
-    	printf("\nPORT JOIN RETURN STATUS %d", returnCode);
-    }
+    if (data->clients[socketId].workerData.threadIsAlive == 1)
+        return FTP_COMMAND_DEFERRED;
+
+    theIpAndPort = getFtpCommandArg("PORT", data->clients[socketId].theCommandReceived, 0);    
+    sscanf(theIpAndPort, "%d,%d,%d,%d,%d,%d", &ipAddressBytes[0], &ipAddressBytes[1], &ipAddressBytes[2], &ipAddressBytes[3], &portBytes[0], &portBytes[1]);
+    data->clients[socketId].workerData.connectionPort = (portBytes[0]*256)+portBytes[1];
+    returnCode = snprintf(data->clients[socketId].workerData.activeIpAddress, CLIENT_BUFFER_STRING_SIZE, "%d.%d.%d.%d", ipAddressBytes[0],ipAddressBytes[1],ipAddressBytes[2],ipAddressBytes[3]);
+
     data->clients[socketId].workerData.passiveModeOn = 0;
     data->clients[socketId].workerData.activeModeOn = 1;    
-    returnCode = pthread_create(&data->clients[socketId].workerData.workerThread, NULL, connectionWorkerHandle, (void *) &data->clients[socketId].clientProgressiveNumber);
+    data->clients[socketId].workerData.threadIsAlive = 1;
 
-    if (returnCode != 0)
+    if (data->ftpParameters.eventDrivenTransfers == 1)
     {
-    	//printf("\nError in pthread_create %d", returnCode);
-    	return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+        if (startEventTransfer(data, socketId) != 0)
+        {
+            resetWorkerData(data, socketId, 0);
+            data->clients[socketId].workerData.threadIsAlive = 0;
+            returnCode = socketPrintf(data, socketId, "s", "425 Unable to open the data connection\r\n");
+
+            if (returnCode <= 0)
+                return FTP_COMMAND_PROCESSED_WRITE_ERROR;
+        }
+
+        return FTP_COMMAND_PROCESSED;
+    }
+
+    if (WPOOL_Submit(&data->workerPool, data->clients[socketId].clientProgressiveNumber) != 0)
+    {
+    	//The pool queue is full, the client can retry later
+    	resetWorkerData(data, socketId, 0);
+    	data->clients[socketId].workerData.threadIsAlive = 0;
+    	returnCode = socketPrintf(data, socketId, "s", "425 Can't open data connection\r\n");
+
+    	if (returnCode <= 0)
+    		return FTP_COMMAND_PROCESSED_WRITE_ERROR;
     }
 
 
@@ -633,21 +723,14 @@ int parseCommandList(ftpDataType * data, int socketId)
         setDynamicStringDataType(&data->clients[socketId].listPath, data->clients[socketId].login.absolutePath.text, data->clients[socketId].login.absolutePath.textLen, &data->clients[socketId].memoryTable);
     }
 
-    pthread_mutex_lock(&data->clients[socketId].conditionMutex);
-    memset(data->clients[socketId].workerData.theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
-    strcpy(data->clients[socketId].workerData.theCommandReceived, data->clients[socketId].theCommandReceived);
-    data->clients[socketId].workerData.commandReceived = 1;
-    pthread_cond_signal(&data->clients[socketId].conditionVariable);
-    pthread_mutex_unlock(&data->clients[socketId].conditionMutex);
-
-    return FTP_COMMAND_PROCESSED;
+    return sendCommandToWorker(data, socketId);
 }
 
 int parseCommandNlst(ftpDataType * data, int socketId)
 {
     int isSafePath = 0;
     char *theNameToNlist;
-    theNameToNlist = getFtpCommandArg("NLIST", data->clients[socketId].theCommandReceived, 1);
+    theNameToNlist = getFtpCommandArg("NLST", data->clients[socketId].theCommandReceived, 1);
     cleanDynamicStringDataType(&data->clients[socketId].nlistPath, 0, &data->clients[socketId].memoryTable);
 
    // printf("\nNLIST COMMAND ARG: %s", data->clients[socketId].workerData.ftpCommand.commandArgs.text);
@@ -665,15 +748,7 @@ int parseCommandNlst(ftpDataType * data, int socketId)
         setDynamicStringDataType(&data->clients[socketId].nlistPath, data->clients[socketId].login.absolutePath.text, data->clients[socketId].login.absolutePath.textLen, &data->clients[socketId].memoryTable);
     }
     
-    pthread_mutex_lock(&data->clients[socketId].conditionMutex);
-
-    memset(data->clients[socketId].workerData.theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
-    strcpy(data->clients[socketId].workerData.theCommandReceived, data->clients[socketId].theCommandReceived);
-    data->clients[socketId].workerData.commandReceived = 1;
-    pthread_cond_signal(&data->clients[socketId].conditionVariable);
-    pthread_mutex_unlock(&data->clients[socketId].conditionMutex);
-
-    return FTP_COMMAND_PROCESSED;
+    return sendCommandToWorker(data, socketId);
 }
 
 int parseCommandRetr(ftpDataType * data, int socketId)
@@ -692,15 +767,7 @@ int parseCommandRetr(ftpDataType * data, int socketId)
     if (isSafePath == 1 &&
         FILE_IsFile(data->clients[socketId].fileToRetr.text) == 1)
     {
-        pthread_mutex_lock(&data->clients[socketId].conditionMutex);
-
-        memset(data->clients[socketId].workerData.theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
-        strcpy(data->clients[socketId].workerData.theCommandReceived, data->clients[socketId].theCommandReceived);
-        data->clients[socketId].workerData.commandReceived = 1;
-        pthread_cond_signal(&data->clients[socketId].conditionVariable);
-        pthread_mutex_unlock(&data->clients[socketId].conditionMutex);
-
-        return FTP_COMMAND_PROCESSED;
+        return sendCommandToWorker(data, socketId);
     }
     else
     {
@@ -724,13 +791,7 @@ int parseCommandStor(ftpDataType * data, int socketId)
 
     if (isSafePath == 1)
     {
-        pthread_mutex_lock(&data->clients[socketId].conditionMutex);
-        memset(data->clients[socketId].workerData.theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
-        strcpy(data->clients[socketId].workerData.theCommandReceived, data->clients[socketId].theCommandReceived);
-        data->clients[socketId].workerData.commandReceived = 1;
-        pthread_cond_signal(&data->clients[socketId].conditionVariable);
-        pthread_mutex_unlock(&data->clients[socketId].conditionMutex);
-
+        return sendCommandToWorker(data, socketId);
     }
     else
     {
@@ -754,13 +815,7 @@ int parseCommandAppe(ftpDataType * data, int socketId)
 
     if (isSafePath == 1)
     {
-        pthread_mutex_lock(&data->clients[socketId].conditionMutex);
-        memset(data->clients[socketId].workerData.theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
-        strcpy(data->clients[socketId].workerData.theCommandReceived, data->clients[socketId].theCommandReceived);
-        data->clients[socketId].workerData.commandReceived = 1;
-        pthread_cond_signal(&data->clients[socketId].conditionVariable);
-        pthread_mutex_unlock(&data->clients[socketId].conditionMutex);
-
+        return sendCommandToWorker(data, socketId);
     }
     else
     {
@@ -1376,7 +1431,8 @@ long long int writeRetrFile(ftpDataType * data, int theSocketId, long long int s
     long long int toReturn = 0, writtenSize = 0;
     long long int currentPosition = 0;
     long long int theFileSize;
-    char buffer[FTP_COMMAND_ELABORATE_CHAR_BUFFER];
+    size_t readSize;
+    char *theBuffer;
 
     #ifdef LARGE_FILE_SUPPORT_ENABLED
 		//#warning LARGE FILE SUPPORT IS ENABLED!
@@ -1415,28 +1471,56 @@ long long int writeRetrFile(ftpDataType * data, int theSocketId, long long int s
         }
     }
 
-    while ((readen = (long long int) fread(buffer, sizeof(char), FTP_COMMAND_ELABORATE_CHAR_BUFFER, retrFP)) > 0)
+    /* Let the kernel move the file to the socket if the transport can */
+    toReturn = TRANSPORT_SendFile(&data->clients[theSocketId].workerData.transport, fileno(retrFP), startFrom, theFileSize);
+
+    if (toReturn != TRANSPORT_NOT_SUPPORTED)
     {
+        fclose(retrFP);
+        retrFP = NULL;
+        return toReturn;
+    }
 
-    	if (data->clients[theSocketId].dataChannelIsTls != 1)
-    	{
-    		writtenSize = write(data->clients[theSocketId].workerData.socketConnection, buffer, readen);
-    	}
-    	else
-    	{
+    toReturn = 0;
+    theBuffer = getTransferBuffer(data, theSocketId);
 
-		#ifdef OPENSSL_ENABLED
-		if (data->clients[theSocketId].workerData.passiveModeOn == 1)
-			writtenSize = SSL_write(data->clients[theSocketId].workerData.serverSsl, buffer, readen);
-		else if (data->clients[theSocketId].workerData.activeModeOn == 1)
-			writtenSize = SSL_write(data->clients[theSocketId].workerData.clientSsl, buffer, readen);
-		#endif
-    	}
+    if (theBuffer == NULL)
+    {
+        fclose(retrFP);
+        retrFP = NULL;
+        return -1;
+    }
+
+    //The stdio position is not the one of the descriptor, the file is read from startFrom
+    currentPosition = (startFrom > 0) ? startFrom : 0;
+
+    //Whole chunks of FTP_RETR_RECORD_SIZE become full TLS records, a truncated file only makes pread return less
+    readSize = data->transferBuffers.bufferSize - (data->transferBuffers.bufferSize % FTP_RETR_RECORD_SIZE);
+    posix_fadvise(fileno(retrFP), (off_t) currentPosition, 0, POSIX_FADV_SEQUENTIAL);
+
+    while (1)
+    {
+      #ifdef LARGE_FILE_SUPPORT_ENABLED
+        readen = (long long int) pread64(fileno(retrFP), theBuffer, readSize, currentPosition);
+      #endif
+
+      #ifndef LARGE_FILE_SUPPORT_ENABLED
+        readen = (long long int) pread(fileno(retrFP), theBuffer, readSize, currentPosition);
+      #endif
+
+      if (readen < 0 && errno == EINTR)
+        continue;
+
+      if (readen <= 0)
+        break;
+
+      currentPosition = currentPosition + readen;
+      writtenSize = TRANSPORT_WriteAll(&data->clients[theSocketId].workerData.transport, theBuffer, readen);
 
       if (writtenSize <= 0)
       {
 
-    	  printf("\nError %d while writing retr file.", writtenSize);
+    	  printf("\nError %lld while writing retr file.", writtenSize);
           fclose(retrFP);
           retrFP = NULL;
           return -1;
@@ -1451,6 +1535,48 @@ long long int writeRetrFile(ftpDataType * data, int theSocketId, long long int s
     return toReturn;
 }
 
+long long int readWriteStorFile(TRANSPORT_DataType *theTransport, int theFileDescriptor, char *theBuffer, int theBufferSize)
+{
+    long long int toReturn = 0;
+    ssize_t receivedSize, writtenSize, bufferIndex;
+
+    if (theBuffer == NULL)
+        return -1;
+
+    while (1)
+    {
+        receivedSize = TRANSPORT_Read(theTransport, theBuffer, theBufferSize);
+
+        if (receivedSize < 0 && errno == EINTR)
+            continue;
+
+        //Transfer completed or connection error
+        if (receivedSize <= 0)
+            break;
+
+        bufferIndex = 0;
+        while (bufferIndex < receivedSize)
+        {
+            writtenSize = write(theFileDescriptor, theBuffer + bufferIndex, receivedSize - bufferIndex);
+
+            if (writtenSize < 0 && errno == EINTR)
+                continue;
+
+            if (writtenSize <= 0)
+            {
+                printf("\nError %d while writing stor file.", errno);
+                return -1;
+            }
+
+            bufferIndex = bufferIndex + writtenSize;
+        }
+
+        toReturn = toReturn + receivedSize;
+    }
+
+    return toReturn;
+}
+
 char *getFtpCommandArg(char * theCommand, char *theCommandString, int skipArgs)
 {
     char *toReturn = theCommandString + strlen(theCommand);
@@ -1487,74 +1613,30 @@ char *getFtpCommandArg(char * theCommand, char *theCommandString, int skipArgs)
 
 int getFtpCommandArgWithOptions(char * theCommand, char *theCommandString, ftpCommandDataType *ftpCommand, DYNMEM_MemoryTable_DataType **memoryTable)
 {
-    #define CASE_ARG_MAIN   0
-    #define CASE_ARG_SECONDARY   1
-
-    int i = 0;
-    int isSecondArg = 0;
-    char argMain[FTP_COMMAND_ELABORATE_CHAR_BUFFER];
-    char argSecondary[FTP_COMMAND_ELABORATE_CHAR_BUFFER];
-    memset (argMain, 0, FTP_COMMAND_ELABORATE_CHAR_BUFFER);
-    memset (argSecondary, 0, FTP_COMMAND_ELABORATE_CHAR_BUFFER);
+    /* The options and the argument are taken as views of the line */
+    char *theOptions = getFtpCommandArg(theCommand, theCommandString, 0);
+    char *theArgument = theOptions;
+    size_t theOptionsLen = 0, theArgumentLen;
 
-    int argMainIndex = 0;
-    int argSecondaryIndex = 0;
-
-    char *theCommandPointer = theCommandString;
-    theCommandPointer += strlen(theCommand);
-    
-    /*Remove spaces*/
-    while (theCommandPointer[0] == ' ')
-    {
-        theCommandPointer += 1;
-    }
-    
-    if (theCommandPointer[i] == '-') 
-    {
-        isSecondArg = 1;
-        theCommandPointer++;
-    }
-    
-    while (theCommandPointer[i] != '\r' &&
-           theCommandPointer[i] != '\n' &&
-           theCommandPointer[i] != 0)
+    if (theOptions[0] == '-')
     {
-        switch(isSecondArg)
+        theOptions++;
+        theOptionsLen = strcspn(theOptions, " \r\n");
+        theArgument = theOptions + theOptionsLen;
+
+        while (theArgument[0] == ' ')
         {
-            case CASE_ARG_MAIN:
-            {
-                if (argMainIndex < FTP_COMMAND_ELABORATE_CHAR_BUFFER)
-                    argMain[argMainIndex++] = theCommandPointer[i];
-                i++;
-            }
-            break;
-                
-            case CASE_ARG_SECONDARY:
-            {
-                if (theCommandPointer[i] != ' ')
-                {
-                    if (argSecondaryIndex < FTP_COMMAND_ELABORATE_CHAR_BUFFER)
-                        argSecondary[argSecondaryIndex++] = theCommandPointer[i];
-                    i++;
-                }
-                else 
-                {
-                    isSecondArg = 0;
-                    while (theCommandPointer[0] == ' ')
-                    {
-                        theCommandPointer += 1;
-                    }
-                }
-            }
-            break;
+            theArgument += 1;
         }
     }
-    
-    if (argMainIndex > 0)
-        setDynamicStringDataType(&ftpCommand->commandArgs, argMain, argMainIndex, &*memoryTable);
 
-    if (argSecondaryIndex > 0)
-        setDynamicStringDataType(&ftpCommand->commandOps, argSecondary, argSecondaryIndex, &*memoryTable);
+    theArgumentLen = strcspn(theArgument, "\r\n");
+
+    if (theArgumentLen > 0)
+        setDynamicStringDataType(&ftpCommand->commandArgs, theArgument, theArgumentLen, &*memoryTable);
+
+    if (theOptionsLen > 0)
+        setDynamicStringDataType(&ftpCommand->commandOps, theOptions, theOptionsLen, &*memoryTable);
         
     return 1;
 }
@@ -1660,3 +1742,132 @@ int setPermissions(char * permissionsCommand, char * basePath, ownerShip_DataTyp
 
     return FTP_CHMODE_COMMAND_RETURN_CODE_OK;
 }
+
+/* Command registry */
+static ftpCommandEntryDataType ftpCommands[] =
+{
+    {FTP_COMMAND_CODE('U', 'S', 'E', 'R'), NULL, FTP_COMMAND_FLAG_NO_LOGIN, parseCommandUser},
+    {FTP_COMMAND_CODE('P', 'A', 'S', 'S'), NULL, FTP_COMMAND_FLAG_NO_LOGIN, parseCommandPass},
+    {FTP_COMMAND_CODE('S', 'I', 'T', 'E'), NULL, 0, parseCommandSite},
+    {FTP_COMMAND_CODE('A', 'U', 'T', 'H'), NULL, FTP_COMMAND_FLAG_NO_LOGIN, parseCommandAuth},
+    {FTP_COMMAND_CODE('P', 'R', 'O', 'T'), NULL, FTP_COMMAND_FLAG_NO_LOGIN, parseCommandProt},
+    {FTP_COMMAND_CODE('P', 'B', 'S', 'Z'), NULL, FTP_COMMAND_FLAG_NO_LOGIN, parseCommandPbsz},
+    {FTP_COMMAND_CODE('C', 'C', 'C', 0), NULL, FTP_COMMAND_FLAG_NO_LOGIN, parseCommandCcc},
+    {FTP_COMMAND_CODE('P', 'W', 'D', 0), NULL, 0, parseCommandPwd},
+    {FTP_COMMAND_CODE('S', 'Y', 'S', 'T'), NULL, 0, parseCommandSyst},
+    {FTP_COMMAND_CODE('F', 'E', 'A', 'T'), NULL, 0, parseCommandFeat},
+    /* TYPE A is served as TYPE I */
+    {FTP_COMMAND_CODE('T', 'Y', 'P', 'E'), "IA", 0, parseCommandTypeI},
+    {FTP_COMMAND_CODE('S', 'T', 'R', 'U'), "F", 0, parseCommandStruF},
+    {FTP_COMMAND_CODE('M', 'O', 'D', 'E'), "S", 0, parseCommandModeS},
+    {FTP_COMMAND_CODE('P', 'A', 'S', 'V'), NULL, 0, parseCommandPasv},
+    {FTP_COMMAND_CODE('P', 'O', 'R', 'T'), NULL, 0, parseCommandPort},
+    {FTP_COMMAND_CODE_LIST, NULL, FTP_COMMAND_FLAG_WORKER, parseCommandList},
+    {FTP_COMMAND_CODE('C', 'W', 'D', 0), NULL, 0, parseCommandCwd},
+    {FTP_COMMAND_CODE('C', 'D', 'U', 'P'), NULL, 0, parseCommandCdup},
+    {FTP_COMMAND_CODE('R', 'E', 'S', 'T'), NULL, 0, parseCommandRest},
+    {FTP_COMMAND_CODE_RETR, NULL, FTP_COMMAND_FLAG_WORKER, parseCommandRetr},
+    {FTP_COMMAND_CODE_STOR, NULL, FTP_COMMAND_FLAG_WORKER, parseCommandStor},
+    {FTP_COMMAND_CODE('M', 'K', 'D', 0), NULL, 0, parseCommandMkd},
+    {FTP_COMMAND_CODE('A', 'B', 'O', 'R'), NULL, 0, parseCommandAbor},
+    {FTP_COMMAND_CODE('D', 'E', 'L', 'E'), NULL, 0, parseCommandDele},
+    {FTP_COMMAND_CODE('O', 'P', 'T', 'S'), NULL, 0, parseCommandOpts},
+    {FTP_COMMAND_CODE('M', 'D', 'T', 'M'), NULL, 0, parseCommandMdtm},
+    {FTP_COMMAND_CODE_NLST, NULL, FTP_COMMAND_FLAG_WORKER, parseCommandNlst},
+    {FTP_COMMAND_CODE('Q', 'U', 'I', 'T'), NULL, FTP_COMMAND_FLAG_NO_LOGIN, parseCommandQuit},
+    {FTP_COMMAND_CODE('R', 'M', 'D', 0), NULL, 0, parseCommandRmd},
+    {FTP_COMMAND_CODE('R', 'N', 'F', 'R'), NULL, 0, parseCommandRnfr},
+    {FTP_COMMAND_CODE('R', 'N', 'T', 'O'), NULL, 0, parseCommandRnto},
+    {FTP_COMMAND_CODE('S', 'I', 'Z', 'E'), NULL, 0, parseCommandSize},
+    {FTP_COMMAND_CODE_APPE, NULL, FTP_COMMAND_FLAG_WORKER, parseCommandAppe},
+    {FTP_COMMAND_CODE('N', 'O', 'O', 'P'), NULL, 0, parseCommandNoop}
+};
+
+/* Open addressing index of the registry, built once */
+static ftpCommandEntryDataType *ftpCommandsTable[FTP_COMMAND_TABLE_SIZE];
+static pthread_once_t ftpCommandsTableOnce = PTHREAD_ONCE_INIT;
+
+static unsigned int getFtpCommandTableIndex(unsigned int commandCode)
+{
+    return (commandCode * 0x9E3779B1u) >> 25;
+}
+
+static void initFtpCommandsTable(void)
+{
+    int i;
+    unsigned int index;
+
+    for (i = 0; i < sizeof(ftpCommands) / sizeof(ftpCommands[0]); i++)
+    {
+        index = getFtpCommandTableIndex(ftpCommands[i].commandCode);
+
+        while (ftpCommandsTable[index] != NULL)
+            index = (index + 1) & (FTP_COMMAND_TABLE_SIZE - 1);
+
+        ftpCommandsTable[index] = &ftpCommands[i];
+    }
+}
+
+/* Pack the case folded verb, 0 if it is not a 3 or 4 letters word */
+unsigned int getFtpCommandCode(char *theCommand)
+{
+    int i;
+    unsigned int commandCode = 0;
+
+    for (i = 0; i < 4; i++)
+    {
+        char theChar = theCommand[i];
+
+        if (theChar >= 'a' && theChar <= 'z')
+            theChar -= 'a' - 'A';
+        else if (theChar < 'A' || theChar > 'Z')
+            break;
+
+        commandCode = (commandCode << 8) | (unsigned char) theChar;
+    }
+
+    if (i < 3)
+        return 0;
+
+    if (i == 3)
+        commandCode <<= 8;
+
+    if (theCommand[i] != ' ' &&
+        theCommand[i] != '\r' &&
+        theCommand[i] != '\n' &&
+        theCommand[i] != '\0')
+        return 0;
+
+    return commandCode;
+}
+
+/* Return the registry entry of the command, NULL if it is not supported */
+ftpCommandEntryDataType *searchFtpCommand(unsigned int commandCode, char *theCommand)
+{
+    unsigned int index;
+    ftpCommandEntryDataType *theEntry;
+
+    if (commandCode == 0)
+        return NULL;
+
+    pthread_once(&ftpCommandsTableOnce, initFtpCommandsTable);
+
+    index = getFtpCommandTableIndex(commandCode);
+
+    while ((theEntry = ftpCommandsTable[index]) != NULL &&
+           theEntry->commandCode != commandCode)
+        index = (index + 1) & (FTP_COMMAND_TABLE_SIZE - 1);
+
+    if (theEntry == NULL || theEntry->allowedArguments == NULL)
+        return theEntry;
+
+    //Only some arguments are supported
+    theCommand += (commandCode & 0xFF) ? 4 : 3;
+
+    if (theCommand[0] != ' ' ||
+        theCommand[1] == '\0' ||
+        strchr(theEntry->allowedArguments, theCommand[1] & ~0x20) == NULL)
+        return NULL;
+
+    return theEntry;
+}
@@ -28,11 +28,26 @@
 
 #define FTP_COMMAND_ELABORATE_CHAR_BUFFER       1024
 #define FTP_COMMAND_ELABORATE_CHAR_BUFFER_BIG   4096
+#define FTP_RETR_RECORD_SIZE                    (16 * 1024)
 #define FTP_COMMAND_NOT_RECONIZED               0
 #define FTP_COMMAND_PROCESSED                   1
 #define FTP_COMMAND_PROCESSED_WRITE_ERROR       2
+#define FTP_COMMAND_DEFERRED                    3   /* Processed again once the data connection worker is gone */
 
 
+/* Verbs are packed case folded in an integer, 3 letters verbs end with 0 */
+#define FTP_COMMAND_CODE(a, b, c, d)            (((unsigned int) (a) << 24) | ((unsigned int) (b) << 16) | ((unsigned int) (c) << 8) | (unsigned int) (d))
+#define FTP_COMMAND_CODE_LIST                   FTP_COMMAND_CODE('L', 'I', 'S', 'T')
+#define FTP_COMMAND_CODE_NLST                   FTP_COMMAND_CODE('N', 'L', 'S', 'T')
+#define FTP_COMMAND_CODE_RETR                   FTP_COMMAND_CODE('R', 'E', 'T', 'R')
+#define FTP_COMMAND_CODE_STOR                   FTP_COMMAND_CODE('S', 'T', 'O', 'R')
+#define FTP_COMMAND_CODE_APPE                   FTP_COMMAND_CODE('A', 'P', 'P', 'E')
+#define FTP_COMMAND_TABLE_SIZE                  128
+
+/* Command flags */
+#define FTP_COMMAND_FLAG_NO_LOGIN               1   /* Accepted before the login */
+#define FTP_COMMAND_FLAG_WORKER                 2   /* Served by the data connection worker */
+
 #define FTP_CHMODE_COMMAND_RETURN_CODE_OK               1
 #define FTP_CHMODE_COMMAND_RETURN_CODE_NO_FILE          2
 #define FTP_CHMODE_COMMAND_RETURN_CODE_NO_PERMISSIONS   3
@@ -49,6 +64,19 @@
 extern "C" {
 #endif
 
+struct ftpCommandEntry
+{
+    unsigned int commandCode;
+    /* Allowed first letters of the argument, NULL if any argument is allowed */
+    char *allowedArguments;
+    int flags;
+    int (*CommandFunction)(ftpDataType *, int);
+} typedef ftpCommandEntryDataType;
+
+/* Command registry */
+unsigned int getFtpCommandCode(char *theCommand);
+ftpCommandEntryDataType *searchFtpCommand(unsigned int commandCode, char *theCommand);
+
 
 /* Elaborate the User login command */
 int parseCommandUser(ftpDataType * data, int socketId);
@@ -90,6 +118,7 @@ int parseCommandRnfr(ftpDataType * data, int socketId);
 int parseCommandRnto(ftpDataType * data, int socketId);
 
 long long int writeRetrFile(ftpDataType * data, int theSocketId, long long int startFrom, FILE *retrFP);
+long long int readWriteStorFile(TRANSPORT_DataType *theTransport, int theFileDescriptor, char *theBuffer, int theBufferSize);
 char *getFtpCommandArg(char * theCommand, char *theCommandString, int skipArgs);
 int getFtpCommandArgWithOptions(char * theCommand, char *theCommandString, ftpCommandDataType *ftpCommand, DYNMEM_MemoryTable_DataType **memoryTable);
 int setPermissions(char * permissionsCommand, char * basePath, ownerShip_DataType ownerShip);
@@ -26,14 +26,17 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <time.h>
 #include <pthread.h>
+#include <sys/socket.h>
 #include <netinet/in.h>
 #include <unistd.h>
 
 #include "ftpServer.h"
 #include "ftpCommandsElaborate.h"
 #include "ftpData.h"
+#include "ftpTransfer.h"
 #include "library/configRead.h"
 #include "library/fileManagement.h"
 #include "library/connection.h"
@@ -196,204 +199,256 @@ void appendToDynamicStringDataType(dynamicStringDataType *dynamicString, char *t
     dynamicString->textLen = theNewSize;
 }
 
-void setRandomicPort(ftpDataType *data, int socketPosition)
+/* Close a passive listening socket and give its port back to the pool */
+void releasePassiveSocket(ftpDataType *data, int theSocket, int thePort)
 {
-    unsigned short int randomicPort = 5000;
-    int i;
-
-  randomicPort = data->ftpParameters.connectionPortMin + (rand()%(data->ftpParameters.connectionPortMax - data->ftpParameters.connectionPortMin)); 
-
-   while (i < data->ftpParameters.maxClients)
-   {
-       if (randomicPort == data->clients[i].workerData.connectionPort)
-       {
-        randomicPort = data->ftpParameters.connectionPortMin + (rand()%(data->ftpParameters.connectionPortMax - data->ftpParameters.connectionPortMin)); 
-        i = 0;
-       }
-       else 
-       {
-        i++;
-       }
-   }
-      
-   data->clients[socketPosition].workerData.connectionPort = randomicPort;
-
-   printf("\n  data->clients[%d].workerData.connectionPort = %d", socketPosition, data->clients[socketPosition].workerData.connectionPort);
+    if (theSocket == -1)
+        return;
 
+    shutdown(theSocket, SHUT_RDWR);
+    close(theSocket);
+    PORTPOOL_Release(&data->passivePorts, thePort);
 }
 
-int writeListDataInfoToSocket(ftpDataType *ftpData, int clientId, int *filesNumber, int commandType, DYNMEM_MemoryTable_DataType **memoryTable)
+/* Fill data with the attributes of one directory list entry, returns 0 when the entry is not listed */
+static int getListDataFromDirectoryList(FILE_DirectoryList_DataType *theList, char *theName, ftpListDataType *data, DYNMEM_MemoryTable_DataType **memoryTable)
 {
-    int i, x, returnCode;
-    int fileAndFoldersCount = 0;
-    char **fileList = NULL;
-    FILE_GetDirectoryInodeList(ftpData->clients[clientId].listPath.text, &fileList, &fileAndFoldersCount, 0, &*memoryTable);
-    *filesNumber = fileAndFoldersCount;
-
-    returnCode = socketWorkerPrintf(ftpData, clientId, "sds", "total ", fileAndFoldersCount ,"\r\n");
-    if (returnCode <= 0)
+    struct stat info;
+
+    data->fileNameWithPath = NULL;
+    data->finalStringPath = NULL;
+    data->linkPath = NULL;
+    data->isFile = 0;
+    data->isDirectory = 0;
+    data->isLink = 0;
+
+    if (FILE_StatDirectoryListEntry(theList, theName, &info, &data->isLink) == 0)
     {
-        return -1;
+        //Broken link or entry removed meanwhile
+        return 0;
     }
-    
-    for (i = 0; i < fileAndFoldersCount; i++)
+
+    if (S_ISDIR(info.st_mode))
     {
-        ftpListDataType data;
-        data.owner = NULL;
-        data.groupOwner = NULL;
-        data.inodePermissionString = NULL;
-        data.fileNameWithPath = NULL;
-        data.finalStringPath = NULL;
-        data.linkPath = NULL;       
-        data.isFile = 0;
-        data.isDirectory = 0;
-
-        //printf("\nPROCESSING: %s", fileList[i]);
-        
-        if (FILE_IsDirectory(fileList[i]) == 1)
+        data->isDirectory = 1;
+        data->fileSize = 4096;
+    }
+    else if (S_ISREG(info.st_mode))
+    {
+        data->isFile = 1;
+        data->fileSize = info.st_size;
+    }
+    else
+    {
+        return 0;
+    }
+
+    data->numberOfSubDirectories = info.st_nlink;
+    FILE_GetOwnerName(info.st_uid, data->owner, LIST_DATA_TYPE_OWNER_STR_SIZE);
+    FILE_GetGroupOwnerName(info.st_gid, data->groupOwner, LIST_DATA_TYPE_OWNER_STR_SIZE);
+    data->fileNameNoPath = FILE_GetFilenameFromPath(theName);
+    FILE_GetPermissionsStringFromMode(info.st_mode, data->isLink, data->inodePermissionString);
+    data->lastModifiedData = info.st_mtime;
+
+    if (strlen(data->fileNameNoPath) > 0)
+    {
+        data->finalStringPath = (char *) DYNMEM_malloc (strlen(data->fileNameNoPath)+1, &*memoryTable, "dataFinalPath");
+        strcpy(data->finalStringPath, data->fileNameNoPath);
+    }
+
+    if (data->isLink == 1)
+    {
+        data->linkPath = (char *) DYNMEM_malloc (CLIENT_COMMAND_STRING_SIZE*sizeof(char), &*memoryTable, "dataLinkPath");
+        if (FILE_ReadDirectoryListLink(theList, theName, data->linkPath, CLIENT_COMMAND_STRING_SIZE) > 0)
         {
-            //printf("\nis directory");
-            //fflush(0);
-            data.isDirectory = 1;
-            data.isFile = 0;
-            data.isLink = 0;
-            data.fileSize = 4096;
-            data.numberOfSubDirectories = FILE_GetDirectoryInodeCount(fileList[i]);
+            FILE_AppendToString(&data->finalStringPath, " -> ", &*memoryTable);
+            FILE_AppendToString(&data->finalStringPath, data->linkPath, &*memoryTable);
         }
-        else if (FILE_IsFile(fileList[i]) == 1)
+    }
+
+    FILE_GetListDateString(data->lastModifiedData, data->lastModifiedDataString, LIST_DATA_TYPE_MODIFIED_DATA_STR_SIZE);
+
+    return 1;
+}
+
+/* NLST sends only the names, the entry type comes from d_type and fstatat runs only for links and unknown types */
+static int writeNlstDataEntries(ftpDataType *ftpData, int clientId, int maximumEntries, DYNMEM_MemoryTable_DataType **memoryTable)
+{
+    int bufferIndex = 0, nameLen, isLink, entriesNumber = 0;
+    unsigned char theType;
+    char *theName, *theBuffer = ftpData->clients[clientId].workerData.listBuffer;
+    struct stat info;
+    FILE_DirectoryList_DataType *theList = &ftpData->clients[clientId].workerData.listData;
+
+    while (entriesNumber < maximumEntries &&
+           (theName = FILE_GetNextDirectoryListName(theList, &theType)) != NULL)
+    {
+        entriesNumber++;
+
+        if (theType == DT_LNK || theType == DT_UNKNOWN)
         {
-            //printf("\nis file");
-            //fflush(0);
-            data.isDirectory = 0;
-            data.isFile = 1;
-            data.isLink = 0;
-            data.numberOfSubDirectories = 1; /* to Do*/
-            data.fileSize = FILE_GetFileSizeFromPath(fileList[i]);
+            if (FILE_StatDirectoryListEntry(theList, theName, &info, &isLink) == 0)
+                continue;
+
+            theType = S_ISDIR(info.st_mode) ? DT_DIR : (S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN);
         }
-        if (data.isDirectory == 0 && data.isFile == 0)
-        {
-            //printf("\nNot a directory, not a file, broken link");
+
+        //Like LIST only files and directories
+        if (theType != DT_DIR && theType != DT_REG)
             continue;
-        }
-        
-      
-        //printf("\nFILE SIZE : %lld", data.fileSize);
 
-        data.owner = FILE_GetOwner(fileList[i], &*memoryTable);
-        data.groupOwner = FILE_GetGroupOwner(fileList[i], &*memoryTable);
-        data.fileNameWithPath = fileList[i];
-        data.fileNameNoPath = FILE_GetFilenameFromPath(fileList[i]);
-        data.inodePermissionString = FILE_GetListPermissionsString(fileList[i], &*memoryTable);
-        data.lastModifiedData = FILE_GetLastModifiedData(fileList[i]);
+        theName = FILE_GetFilenameFromPath(theName);
+        nameLen = strlen(theName);
 
-        if (strlen(data.fileNameNoPath) > 0)
+        if (bufferIndex + nameLen + 2 > LIST_NLST_BUFFER_SIZE)
         {
-            data.finalStringPath = (char *) DYNMEM_malloc (strlen(data.fileNameNoPath)+1, &*memoryTable, "dataFinalPath");
-            strcpy(data.finalStringPath, data.fileNameNoPath);
-        }
-        
-        if (data.inodePermissionString != NULL &&
-            strlen(data.inodePermissionString) > 0 &&
-            data.inodePermissionString[0] == 'l')
+            if (bufferIndex > 0 &&
+                socketWorkerWrite(ftpData, clientId, theBuffer, bufferIndex) < 0)
             {
-                int len = 0;
-                data.isLink = 1;
-                data.linkPath = (char *) DYNMEM_malloc (CLIENT_COMMAND_STRING_SIZE*sizeof(char), &*memoryTable, "dataLinkPath");
-                if ((len = readlink (fileList[i], data.linkPath, CLIENT_COMMAND_STRING_SIZE)) > 0)
-                {
-                    data.linkPath[len] = 0;
-                    FILE_AppendToString(&data.finalStringPath, " -> ", &*memoryTable);
-                    FILE_AppendToString(&data.finalStringPath, data.linkPath, &*memoryTable);
-                }
+                return -1;
             }
 
-        memset(data.lastModifiedDataString, 0, LIST_DATA_TYPE_MODIFIED_DATA_STR_SIZE);       
-        strftime(data.lastModifiedDataString, LIST_DATA_TYPE_MODIFIED_DATA_STR_SIZE, "%b %d %Y", localtime(&data.lastModifiedData));
-        
-        
-        switch (commandType)
-        {
-            case COMMAND_TYPE_LIST:
-            {
-            			returnCode = socketWorkerPrintf(ftpData, clientId, "ssdssssslsssss",
-                        data.inodePermissionString == NULL? "Unknown" : data.inodePermissionString
-                        ," "
-                        ,data.numberOfSubDirectories
-                        ," "
-                        ,data.owner == NULL? "Unknown" : data.owner
-						," "
-                        ,data.groupOwner == NULL? "Unknown" : data.groupOwner
-						," "
-                        ,data.fileSize
-                        ," "
-                        ,data.lastModifiedDataString == NULL? "Unknown" : data.lastModifiedDataString
-						," "
-                        ,data.finalStringPath == NULL? "Unknown" : data.finalStringPath
-						,"\r\n");
-            		/*
-                returnCode = dprintf(theSocket, "%s %d %s %s %lld %s %s\r\n", 
-                data.inodePermissionString == NULL? "Unknown" : data.inodePermissionString
-                ,data.numberOfSubDirectories
-                ,data.owner == NULL? "Unknown" : data.owner
-                ,data.groupOwner == NULL? "Unknown" : data.groupOwner
-                ,data.fileSize
-                ,data.lastModifiedDataString == NULL? "Unknown" : data.lastModifiedDataString
-                ,data.finalStringPath == NULL? "Unknown" : data.finalStringPath);
-                */
-            }
-            break;
-            
-            case COMMAND_TYPE_NLST:
-            {
-            	returnCode = socketWorkerPrintf(ftpData, clientId, "ss", data.fileNameNoPath, "\r\n");
-            }
-            break;
+            bufferIndex = 0;
 
-            
-            default:
-            {
-                printf("\nWarning switch default in function writeListDataInfoToSocket (%d)", commandType);
-            }
-            break;
+            //Names can't be longer than the buffer, anyway don't overflow it
+            if (nameLen + 2 > LIST_NLST_BUFFER_SIZE)
+                continue;
         }
-        
-       
-        if (data.fileNameWithPath != NULL)
-            DYNMEM_free(data.fileNameWithPath, &*memoryTable);
-        
+
+        memcpy(theBuffer + bufferIndex, theName, nameLen);
+        bufferIndex += nameLen;
+        theBuffer[bufferIndex++] = '\r';
+        theBuffer[bufferIndex++] = '\n';
+        ftpData->clients[clientId].workerData.listFilesNumber++;
+    }
+
+    if (bufferIndex > 0 &&
+        socketWorkerWrite(ftpData, clientId, theBuffer, bufferIndex) < 0)
+    {
+        return -1;
+    }
+
+    return (entriesNumber == maximumEntries) ? 1 : 0;
+}
+
+/* Open the LIST or NLST directory of the client, LIST starts with the total when the directory is sorted. Returns -1 on write errors */
+int openListData(ftpDataType *ftpData, int clientId, int commandType, DYNMEM_MemoryTable_DataType **memoryTable)
+{
+    int returnCode;
+    workerDataType *theWorker = &ftpData->clients[clientId].workerData;
+    char *thePath = (commandType == COMMAND_TYPE_NLST) ? ftpData->clients[clientId].nlistPath.text : ftpData->clients[clientId].listPath.text;
+
+    FILE_OpenDirectoryList(thePath, &theWorker->listData, (long long int) ftpData->ftpParameters.listSortMemoryLimit * 1024, &*memoryTable);
+    theWorker->listIsOpen = 1;
+    theWorker->listCommandType = commandType;
+    theWorker->listFilesNumber = 0;
+
+    if (commandType == COMMAND_TYPE_NLST)
+    {
+        theWorker->listBuffer = (char *) DYNMEM_malloc(LIST_NLST_BUFFER_SIZE, &*memoryTable, "nlstBuffer");
+        return 1;
+    }
+
+    //A streamed list doesn't know the total before the end
+    if (theWorker->listData.isSorted == 1)
+    {
+        returnCode = socketWorkerPrintf(ftpData, clientId, "sds", "total ", theWorker->listData.filesNumber ,"\r\n");
+        if (returnCode <= 0)
+            return -1;
+    }
+
+    return 1;
+}
+
+/* Send up to maximumEntries directory entries, returns 1 while entries are left, 0 at the end and -1 on write errors */
+int writeListDataEntries(ftpDataType *ftpData, int clientId, int maximumEntries, DYNMEM_MemoryTable_DataType **memoryTable)
+{
+    int returnCode, entriesNumber = 0;
+    char *theName;
+    FILE_DirectoryList_DataType *theList = &ftpData->clients[clientId].workerData.listData;
+
+    if (ftpData->clients[clientId].workerData.listCommandType == COMMAND_TYPE_NLST)
+        return writeNlstDataEntries(ftpData, clientId, maximumEntries, &*memoryTable);
+
+    while (entriesNumber < maximumEntries &&
+           (theName = FILE_GetNextDirectoryListName(theList, NULL)) != NULL)
+    {
+        ftpListDataType data;
+
+        entriesNumber++;
+
+        if (getListDataFromDirectoryList(theList, theName, &data, &*memoryTable) == 0)
+        {
+            continue;
+        }
+
+        returnCode = socketWorkerPrintf(ftpData, clientId, "ssdssssslsssss",
+                    data.inodePermissionString
+                    ," "
+                    ,data.numberOfSubDirectories
+                    ," "
+                    ,data.owner[0] == '\0'? "Unknown" : data.owner
+                    ," "
+                    ,data.groupOwner[0] == '\0'? "Unknown" : data.groupOwner
+                    ," "
+                    ,data.fileSize
+                    ," "
+                    ,data.lastModifiedDataString
+                    ," "
+                    ,data.finalStringPath == NULL? "Unknown" : data.finalStringPath
+                    ,"\r\n");
+
         if (data.linkPath != NULL)
         	DYNMEM_free(data.linkPath, &*memoryTable);
 
         if (data.finalStringPath != NULL)
         	DYNMEM_free(data.finalStringPath, &*memoryTable);
 
-        if (data.owner != NULL)
-        	DYNMEM_free(data.owner, &*memoryTable);
-        
-        if (data.groupOwner != NULL)
-        	DYNMEM_free(data.groupOwner, &*memoryTable);
-        
-        if (data.inodePermissionString != NULL)
-        	DYNMEM_free(data.inodePermissionString, &*memoryTable);
-          
         if (returnCode <= 0)
-        {
-            for (x = i+1; x < fileAndFoldersCount; x++)
-            	DYNMEM_free (fileList[x], &*memoryTable);
-            DYNMEM_free (fileList, &*memoryTable);
             return -1;
-        }
-        
-        }
-
-		if (fileList != NULL)
-		{
-			DYNMEM_free (fileList, &*memoryTable);
-		}
+    }
 
+    if (entriesNumber == maximumEntries)
         return 1;
+
+    ftpData->clients[clientId].workerData.listFilesNumber = theList->filesNumber;
+    return 0;
+}
+
+void closeListData(ftpDataType *ftpData, int clientId, DYNMEM_MemoryTable_DataType **memoryTable)
+{
+    workerDataType *theWorker = &ftpData->clients[clientId].workerData;
+
+    if (theWorker->listIsOpen == 0)
+        return;
+
+    if (theWorker->listBuffer != NULL)
+    {
+        DYNMEM_free(theWorker->listBuffer, &*memoryTable);
+        theWorker->listBuffer = NULL;
     }
 
+    FILE_CloseDirectoryList(&theWorker->listData, &*memoryTable);
+    theWorker->listIsOpen = 0;
+}
+
+int writeListDataInfoToSocket(ftpDataType *ftpData, int clientId, int *filesNumber, int commandType, DYNMEM_MemoryTable_DataType **memoryTable)
+{
+    int returnCode;
+
+    returnCode = openListData(ftpData, clientId, commandType, &*memoryTable);
+
+    while (returnCode == 1)
+    {
+        returnCode = writeListDataEntries(ftpData, clientId, INT_MAX, &*memoryTable);
+    }
+
+    *filesNumber = ftpData->clients[clientId].workerData.listFilesNumber;
+    closeListData(ftpData, clientId, &*memoryTable);
+
+    return (returnCode == 0) ? 1 : -1;
+}
+
 int searchInLoginFailsVector(void * loginFailsVector, void *element)
 {
     int i = 0;
@@ -416,155 +471,99 @@ void deleteLoginFailsData(void *element)
     ; //NOP
 }
 
-void getListDataInfo(char * thePath, DYNV_VectorGenericDataType *directoryInfo, DYNMEM_MemoryTable_DataType **memoryTable)
+/* Add a login fail for the element ip address, the vector is shared by all the reactors */
+void recordLoginFail(ftpDataType *data, loginFailsDataType *element)
 {
-    int i;
-    int fileAndFoldersCount = 0;
-    ftpListDataType data;
-    FILE_GetDirectoryInodeList(thePath, &data.fileList, &fileAndFoldersCount, 0, &*memoryTable);
-    
-    //printf("\nNUMBER OF FILES: %d", fileAndFoldersCount);
-    //fflush(0);
-    
-    for (i = 0; i < fileAndFoldersCount; i++)
-    {
-        data.owner = NULL;
-        data.groupOwner = NULL;
-        data.inodePermissionString = NULL;
-        data.fileNameWithPath = NULL;
-        data.finalStringPath = NULL;
-        data.linkPath = NULL;       
-
-        data.numberOfSubDirectories = 1; /* to Do*/
-        data.isFile = 0;
-        data.isDirectory = 0;
-        
-        
-        //printf("\nPROCESSING: %s", data.fileList[i]);
-        //fflush(0);
-        
-        if (FILE_IsDirectory(data.fileList[i]) == 1)
-        {
-            //printf("\nis file");
-            //fflush(0);
-            data.isDirectory = 1;
-            data.isFile = 0;
-            data.isLink = 0;
-            data.fileSize = 4096;
-        }
-        else if (FILE_IsFile(data.fileList[i]) == 1)
-        {
-            //printf("\nis file");
-            //fflush(0);
-            data.isDirectory = 0;
-            data.isFile = 1;
-            data.isLink = 0;
-            data.fileSize = FILE_GetFileSizeFromPath(data.fileList[i]);
-        }
-        if (data.isDirectory == 0 && data.isFile == 0)
-        {
-            //printf("\nNot a directory, not a file, broken link");
-            continue;
-        }
-        
-       // printf("\nFILE SIZE : %lld", data.fileSize);
+    int searchPosition;
 
-        data.owner = FILE_GetOwner(data.fileList[i], &*memoryTable);
-        data.groupOwner = FILE_GetGroupOwner(data.fileList[i], &*memoryTable);
-        data.fileNameWithPath = data.fileList[i];
-        data.fileNameNoPath = FILE_GetFilenameFromPath(data.fileList[i]);
-        data.inodePermissionString = FILE_GetListPermissionsString(data.fileList[i], &*memoryTable);
-        data.lastModifiedData = FILE_GetLastModifiedData(data.fileList[i]);
+    pthread_mutex_lock(&data->loginFailsMutex);
+    searchPosition = data->loginFailsVector.SearchElement(&data->loginFailsVector, element);
 
-        if (strlen(data.fileNameNoPath) > 0)
+    if (searchPosition == -1)
+    {
+        if (data->ftpParameters.maximumUserAndPassowrdLoginTries != 0)
         {
-            data.finalStringPath = (char *) DYNMEM_malloc (strlen(data.fileNameNoPath)+1, &*memoryTable, "FinalStringPath");
-            strcpy(data.finalStringPath, data.fileNameNoPath);
-        }
-        
-        if (data.inodePermissionString != NULL &&
-            strlen(data.inodePermissionString) > 0 &&
-            data.inodePermissionString[0] == 'l')
-            {
-                int len = 0;
-                data.isLink = 1;
-                data.linkPath = (char *) DYNMEM_malloc (CLIENT_COMMAND_STRING_SIZE*sizeof(char), &*memoryTable, "data.linkPath");
-                if ((len = readlink (data.fileList[i], data.linkPath, CLIENT_COMMAND_STRING_SIZE)) > 0)
-                {
-                    data.linkPath[len] = 0;
-                    FILE_AppendToString(&data.finalStringPath, " -> ", &*memoryTable);
-                    FILE_AppendToString(&data.finalStringPath, data.linkPath, &*memoryTable);
-                }
-            }
+            loginFailsDataType *theLoginFail;
 
-        memset(data.lastModifiedDataString, 0, LIST_DATA_TYPE_MODIFIED_DATA_STR_SIZE);       
-        strftime(data.lastModifiedDataString, 80, "%b %d %Y", localtime(&data.lastModifiedData));
-
-        /*
-        -1 List one file per line
-        -A List all files except "." and ".."
-        -a List all files including those whose names start with "."
-        -C List entries by columns
-        -d List directory entries instead of directory contents
-        -F Append file type indicator (one of "*", "/", "=", "@" or "|") to names
-        -h Print file sizes in human-readable format (e.g. 1K, 234M, 2G)
-        -L List files pointed to by symlinks
-        -l Use a long listing format
-        -n List numeric UIDs/GIDs instead of user/group names
-        -R List subdirectories recursively
-        -r Sort filenames in reverse order
-        -S Sort by file size
-        -t Sort by modification time 
-         */
-
-        directoryInfo->PushBack(directoryInfo, &data, sizeof(ftpListDataType));
+            data->loginFailsVector.PushBack(&data->loginFailsVector, element, sizeof(loginFailsDataType));
+            theLoginFail = (loginFailsDataType *) data->loginFailsVector.Data[data->loginFailsVector.Size - 1];
+            TWHEEL_InitTimer(&theLoginFail->expireTimer, data->loginFailsVector.Size - 1, loginFailsTimeout);
+            TWHEEL_Start(&data->loginFailsTimers, &theLoginFail->expireTimer, theLoginFail->failTimeStamp + WRONG_PASSWORD_ALLOWED_RETRY_TIME + 1);
+        }
+    }
+    else
+    {
+        //The timer is moved forward when it expires
+        ((loginFailsDataType *) data->loginFailsVector.Data[searchPosition])->failureNumbers++;
+        ((loginFailsDataType *) data->loginFailsVector.Data[searchPosition])->failTimeStamp = TWHEEL_GetCoarseTime();
     }
+    pthread_mutex_unlock(&data->loginFailsMutex);
 }
 
-void deleteListDataInfoVector(DYNV_VectorGenericDataType *theVector)
+/* Login fail timer function, called with loginFailsMutex held */
+void loginFailsTimeout(void *theOwner, int loginFailIndex)
 {
+    ftpDataType *data = (ftpDataType *) theOwner;
+    loginFailsDataType *theLoginFail = (loginFailsDataType *) data->loginFailsVector.Data[loginFailIndex];
 
-    int i;
-    for (i = 0; i < theVector->Size; i++)
+    if (theLoginFail->failTimeStamp + WRONG_PASSWORD_ALLOWED_RETRY_TIME >= data->loginFailsTimers.currentTime)
     {
-		ftpListDataType *data = (ftpListDataType *)theVector->Data[i];
-
-		if (data->owner != NULL)
-		{
-			DYNMEM_free(data->owner, &theVector->memoryTable);
-		}
-		if (data->groupOwner != NULL)
-		{
-			DYNMEM_free(data->groupOwner, &theVector->memoryTable);
-		}
-		if (data->inodePermissionString != NULL)
-		{
-			DYNMEM_free(data->inodePermissionString, &theVector->memoryTable);
-		}
-		if (data->fileNameWithPath != NULL)
-		{
-			DYNMEM_free(data->fileNameWithPath, &theVector->memoryTable);
-		}
-		if (data->finalStringPath != NULL)
-		{
-			DYNMEM_free(data->finalStringPath, &theVector->memoryTable);
-		}
-		if (data->linkPath != NULL)
-		{
-			DYNMEM_free(data->linkPath, &theVector->memoryTable);
-		}
+        TWHEEL_Start(&data->loginFailsTimers, &theLoginFail->expireTimer, theLoginFail->failTimeStamp + WRONG_PASSWORD_ALLOWED_RETRY_TIME + 1);
+        return;
     }
+
+    //The last element takes the deleted position
+    data->loginFailsVector.SwapDeleteAt(&data->loginFailsVector, loginFailIndex, deleteLoginFailsData);
+
+    if (loginFailIndex < data->loginFailsVector.Size)
+        ((loginFailsDataType *) data->loginFailsVector.Data[loginFailIndex])->expireTimer.timerId = loginFailIndex;
 }
 
 void cancelWorker(ftpDataType *data, int clientId)
 {
-	void *pReturn;
-	int returnCode = pthread_cancel(data->clients[clientId].workerData.workerThread);
-	returnCode = pthread_join(data->clients[clientId].workerData.workerThread, &pReturn);
-	data->clients[clientId].workerData.threadHasBeenCreated = 0;
+	//The reactor of the client runs the event driven transfers, nothing to wait
+	if (data->clients[clientId].workerData.eventTransferState != EVENT_TRANSFER_STATE_NONE)
+	{
+		stopEventTransfer(data, clientId);
+		return;
+	}
+
+	//The job didn't start yet, no pool thread is using the worker data
+	if (WPOOL_RemoveQueuedJob(&data->workerPool, clientId) == 1)
+	{
+		releasePassiveSocket(data, data->clients[clientId].workerData.passiveListeningSocket, data->clients[clientId].workerData.connectionPort);
+		resetWorkerData(data, clientId, 0);
+		data->clients[clientId].workerData.threadIsAlive = 0;
+		return;
+	}
+
+	//Wake up the pool thread from accept, connect, read, write or the command wait, it releases the data connection itself
+	pthread_mutex_lock(&data->clients[clientId].conditionMutex);
+	if (data->clients[clientId].workerData.threadIsAlive == 1)
+	{
+		data->clients[clientId].workerData.abortTransfer = 1;
+
+		if (data->clients[clientId].workerData.passiveListeningSocket != -1)
+			shutdown(data->clients[clientId].workerData.passiveListeningSocket, SHUT_RDWR);
+
+		if (data->clients[clientId].workerData.socketConnection != -1)
+			shutdown(data->clients[clientId].workerData.socketConnection, SHUT_RDWR);
+
+		pthread_cond_signal(&data->clients[clientId].conditionVariable);
+	}
+	pthread_mutex_unlock(&data->clients[clientId].conditionMutex);
 }
 
 
+/* The buffer of the running transfer, taken from the pool the first time it is needed */
+char *getTransferBuffer(ftpDataType *data, int clientId)
+{
+    if (data->clients[clientId].workerData.transferBuffer == NULL)
+        data->clients[clientId].workerData.transferBuffer = BUFPOOL_Get(&data->transferBuffers);
+
+    return data->clients[clientId].workerData.transferBuffer;
+}
+
 void resetWorkerData(ftpDataType *data, int clientId, int isInitialization)
 {
 
@@ -573,17 +572,26 @@ void resetWorkerData(ftpDataType *data, int clientId, int isInitialization)
       data->clients[clientId].workerData.passiveModeOn = 0;
       data->clients[clientId].workerData.socketIsConnected = 0;
       data->clients[clientId].workerData.commandIndex = 0;
-      data->clients[clientId].workerData.passiveListeningSocket = 0;
-      data->clients[clientId].workerData.socketConnection = 0;
+      data->clients[clientId].workerData.commandCode = 0;
+      data->clients[clientId].workerData.passiveListeningSocket = -1;
+      data->clients[clientId].workerData.socketConnection = -1;
+      TRANSPORT_InitPlain(&data->clients[clientId].workerData.transport, -1);
       data->clients[clientId].workerData.bufferIndex = 0;
       data->clients[clientId].workerData.commandReceived = 0;
       data->clients[clientId].workerData.retrRestartAtByte = 0;
-      data->clients[clientId].workerData.threadIsAlive = 0;
+      data->clients[clientId].workerData.abortTransfer = 0;
       data->clients[clientId].workerData.activeModeOn = 0;
       data->clients[clientId].workerData.passiveModeOn = 0;
       data->clients[clientId].workerData.activeIpAddressIndex = 0;
+      data->clients[clientId].workerData.eventTransferState = EVENT_TRANSFER_STATE_NONE;
+      data->clients[clientId].workerData.eventSocket = -1;
+      data->clients[clientId].workerData.eventMask = 0;
+      data->clients[clientId].workerData.eventIsReadWrite = 0;
+      data->clients[clientId].workerData.eventFileOffset = 0;
+      data->clients[clientId].workerData.eventFileSize = 0;
+      data->clients[clientId].workerData.eventBufferStart = 0;
+      data->clients[clientId].workerData.eventBufferEnd = 0;
 
-      memset(data->clients[clientId].workerData.buffer, 0, CLIENT_BUFFER_STRING_SIZE);
       memset(data->clients[clientId].workerData.activeIpAddress, 0, CLIENT_BUFFER_STRING_SIZE);
       memset(data->clients[clientId].workerData.theCommandReceived, 0, CLIENT_BUFFER_STRING_SIZE);
 
@@ -599,6 +607,32 @@ void resetWorkerData(ftpDataType *data, int clientId, int isInitialization)
             data->clients[clientId].workerData.theStorFile = NULL;
         }
 
+        if (data->clients[clientId].workerData.storPipe[0] != -1)
+        {
+            close(data->clients[clientId].workerData.storPipe[0]);
+            close(data->clients[clientId].workerData.storPipe[1]);
+            data->clients[clientId].workerData.storPipe[0] = -1;
+            data->clients[clientId].workerData.storPipe[1] = -1;
+        }
+
+        closeListData(data, clientId, &data->clients[clientId].workerData.memoryTable);
+
+        //Only a grown event buffer is owned by the worker, the transfer buffer goes back to the pool
+        if (data->clients[clientId].workerData.eventBuffer != NULL &&
+            data->clients[clientId].workerData.eventBuffer != data->clients[clientId].workerData.transferBuffer)
+        {
+            DYNMEM_free(data->clients[clientId].workerData.eventBuffer, &data->clients[clientId].workerData.memoryTable);
+        }
+
+        data->clients[clientId].workerData.eventBuffer = NULL;
+        data->clients[clientId].workerData.eventBufferSize = 0;
+
+        if (data->clients[clientId].workerData.transferBuffer != NULL)
+        {
+            BUFPOOL_Release(&data->transferBuffers, data->clients[clientId].workerData.transferBuffer);
+            data->clients[clientId].workerData.transferBuffer = NULL;
+        }
+
 			#ifdef OPENSSL_ENABLED
 
         	if (data->clients[clientId].workerData.serverSsl != NULL)
@@ -619,28 +653,67 @@ void resetWorkerData(ftpDataType *data, int clientId, int isInitialization)
       }
       else
       {
-        DYNV_VectorGeneric_Init(&data->clients[clientId].workerData.directoryInfo);
         data->clients[clientId].workerData.theStorFile = NULL;
-        data->clients[clientId].workerData.threadHasBeenCreated = 0;
+        data->clients[clientId].workerData.storPipe[0] = -1;
+        data->clients[clientId].workerData.storPipe[1] = -1;
+        data->clients[clientId].workerData.transferBuffer = NULL;
+        data->clients[clientId].workerData.threadIsAlive = 0;
+        data->clients[clientId].workerData.listIsOpen = 0;
+        data->clients[clientId].workerData.listBuffer = NULL;
+        data->clients[clientId].workerData.eventBuffer = NULL;
+        data->clients[clientId].workerData.eventBufferSize = 0;
       }
 
 
-    //Clear the dynamic vector structure
-    int theSize = data->clients[clientId].workerData.directoryInfo.Size;
-    char ** lastToDestroy = NULL;
-    if (theSize > 0)
-    {
-        lastToDestroy = ((ftpListDataType *)data->clients[clientId].workerData.directoryInfo.Data[0])->fileList;
-        data->clients[clientId].workerData.directoryInfo.Destroy(&data->clients[clientId].workerData.directoryInfo, deleteListDataInfoVector);
-        DYNMEM_free(lastToDestroy, &data->clients[clientId].workerData.memoryTable);
-    }
-
 		#ifdef OPENSSL_ENABLED
 		data->clients[clientId].workerData.serverSsl = SSL_new(data->serverCtx);
 		data->clients[clientId].workerData.clientSsl = SSL_new(data->clientCtx);
+
+		//OpenSSL hands the keys to the kernel after the handshake when the tls module is there, else it stays in user space
+		#ifdef SSL_OP_ENABLE_KTLS
+		if (data->ftpParameters.kernelTlsEnabled == 1)
+		{
+			SSL_set_options(data->clients[clientId].workerData.serverSsl, SSL_OP_ENABLE_KTLS);
+			SSL_set_options(data->clients[clientId].workerData.clientSsl, SSL_OP_ENABLE_KTLS);
+		}
+		#endif
 		#endif
 }
 
+#ifdef OPENSSL_ENABLED
+/* In active mode the server is the TLS client of the data connection, it offers the session of the previous one */
+void resumeActiveDataSession(ftpDataType *data, int clientId)
+{
+    if (data->clients[clientId].activeDataSession != NULL)
+        SSL_set_session(data->clients[clientId].workerData.clientSsl, data->clients[clientId].activeDataSession);
+}
+
+/* Called once the data connection handshake is done */
+void dataTlsHandshakeDone(ftpDataType *data, int clientId, SSL *theSsl)
+{
+    //OpenSSL before 3.0 has no kernel TLS, every session stays in user space
+    #ifdef SSL_OP_ENABLE_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(theSsl)))
+        __atomic_add_fetch(&data->tlsStatistics.kernelTlsSessions, 1, __ATOMIC_RELAXED);
+    else
+    #endif
+        __atomic_add_fetch(&data->tlsStatistics.userTlsSessions, 1, __ATOMIC_RELAXED);
+
+    if (SSL_session_reused(theSsl))
+        __atomic_add_fetch(&data->tlsStatistics.resumedTlsSessions, 1, __ATOMIC_RELAXED);
+    else
+        __atomic_add_fetch(&data->tlsStatistics.fullTlsHandshakes, 1, __ATOMIC_RELAXED);
+
+    if (SSL_is_server(theSsl) == 0)
+    {
+        if (data->clients[clientId].activeDataSession != NULL)
+            SSL_SESSION_free(data->clients[clientId].activeDataSession);
+
+        data->clients[clientId].activeDataSession = SSL_get1_session(theSsl);
+    }
+}
+#endif
+
 void resetClientData(ftpDataType *data, int clientId, int isInitialization)
 {
     if (isInitialization != 1)
@@ -661,6 +734,9 @@ void resetClientData(ftpDataType *data, int clientId, int isInitialization)
 		SSL_free(data->clients[clientId].ssl);
 		data->clients[clientId].ssl = NULL;
 	}
+
+	if (data->clients[clientId].activeDataSession != NULL)
+		SSL_SESSION_free(data->clients[clientId].activeDataSession);
 	#endif
     }
     else
@@ -687,14 +763,25 @@ void resetClientData(ftpDataType *data, int clientId, int isInitialization)
 	}
 
     data->clients[clientId].tlsIsNegotiating = 0;
+    data->clients[clientId].tlsIsClosing = 0;
     data->clients[clientId].tlsIsEnabled = 0;
     data->clients[clientId].dataChannelIsTls = 0;
     data->clients[clientId].socketDescriptor = -1;
+    TRANSPORT_InitPlain(&data->clients[clientId].transport, -1);
     data->clients[clientId].socketCommandReceived = 0;
     data->clients[clientId].socketIsConnected = 0;
     data->clients[clientId].bufferIndex = 0;
     data->clients[clientId].commandIndex = 0;
+    data->clients[clientId].commandCode = 0;
     data->clients[clientId].closeTheClient = 0;
+    data->clients[clientId].ipConnectionIsCounted = 0;
+    data->clients[clientId].outputHead = NULL;
+    data->clients[clientId].outputTail = NULL;
+    data->clients[clientId].outputBytes = 0;
+    data->clients[clientId].outputIsHeld = 0;
+    data->clients[clientId].outputEventIsEnabled = 0;
+    data->clients[clientId].eventsArePaused = 0;
+    data->clients[clientId].commandIsDeferred = 0;
     data->clients[clientId].sockaddr_in_size = sizeof(struct sockaddr_in);
     data->clients[clientId].sockaddr_in_server_size = sizeof(struct sockaddr_in);
     
@@ -707,8 +794,9 @@ void resetClientData(ftpDataType *data, int clientId, int isInitialization)
     memset(&data->clients[clientId].client_sockaddr_in, 0, data->clients[clientId].sockaddr_in_size);
     memset(&data->clients[clientId].server_sockaddr_in, 0, data->clients[clientId].sockaddr_in_server_size);
     memset(data->clients[clientId].clientIpAddress, 0, INET_ADDRSTRLEN);
-    memset(data->clients[clientId].buffer, 0, CLIENT_BUFFER_STRING_SIZE);
-    memset(data->clients[clientId].theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
+    data->clients[clientId].buffer[0] = '\0';
+    data->clients[clientId].theCommandReceived = data->clients[clientId].buffer;
+    data->clients[clientId].commandIsTooLong = 0;
     cleanLoginData(&data->clients[clientId].login, isInitialization, &data->clients[clientId].memoryTable);
     
     //Rename from and to data init
@@ -722,12 +810,12 @@ void resetClientData(ftpDataType *data, int clientId, int isInitialization)
     cleanDynamicStringDataType(&data->clients[clientId].ftpCommand.commandOps, isInitialization, &data->clients[clientId].memoryTable);
 
     data->clients[clientId].connectionTimeStamp = 0;
-    data->clients[clientId].tlsNegotiatingTimeStart = 0;
     data->clients[clientId].lastActivityTimeStamp = 0;
 
 	#ifdef OPENSSL_ENABLED
 	//data->clients[clientId].workerData.ssl = SSL_new(data->ctx);
 	data->clients[clientId].ssl = SSL_new(data->serverCtx);
+	data->clients[clientId].activeDataSession = NULL;
 	#endif
 
 	//printf("\nclient memory table :%lld", data->clients[clientId].memoryTable);
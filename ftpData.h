@@ -27,6 +27,7 @@
 #define FTPDATA_H
 
 #include <netinet/in.h>
+#include <sys/epoll.h>
 
 #ifdef OPENSSL_ENABLED
 	#include <openssl/ssl.h>
@@ -35,18 +36,48 @@
 
 #include "library/dynamicVectors.h"
 #include "library/dynamicMemory.h"
+#include "library/fileManagement.h"
+#include "library/workerPool.h"
+#include "library/timerWheel.h"
+#include "library/portPool.h"
+#include "library/bufferPool.h"
+#include "library/transport.h"
 
 
 #define CLIENT_COMMAND_STRING_SIZE                  4096
 #define CLIENT_BUFFER_STRING_SIZE                   4096
+#define CLIENT_OUTPUT_BLOCK_SIZE                    4096
+#define CLIENT_OUTPUT_IOVEC_SIZE                    64
+#define CLIENT_OUTPUT_QUEUE_LIMIT                   (256*1024)
 #define MAXIMUM_INODE_NAME							4096
 
 #define LIST_DATA_TYPE_MODIFIED_DATA_STR_SIZE       1024
+#define LIST_DATA_TYPE_OWNER_STR_SIZE               256
+#define LIST_DATA_TYPE_PERMISSION_STR_SIZE          11
+#define LIST_NLST_BUFFER_SIZE                       (64*1024)
 
 #define COMMAND_TYPE_LIST                           0
 #define COMMAND_TYPE_NLST                           1
 #define WRONG_PASSWORD_ALLOWED_RETRY_TIME           60
 
+#define MAXIMUM_READY_EVENTS                        1024
+#define MAIN_SOCKET_EVENT_ID                        -1
+
+/* The epoll events of the data sockets carry the client id with this flag */
+#define DATA_SOCKET_EVENT_FLAG                      0x40000000
+
+/* Event driven data connections, the work done for each socket event is bounded */
+#define EVENT_TRANSFER_STATE_NONE                   0
+#define EVENT_TRANSFER_STATE_ACCEPTING              1
+#define EVENT_TRANSFER_STATE_CONNECTING             2
+#define EVENT_TRANSFER_STATE_HANDSHAKING            3
+#define EVENT_TRANSFER_STATE_READY                  4
+#define EVENT_TRANSFER_STATE_RETR                   5
+#define EVENT_TRANSFER_STATE_STOR                   6
+#define EVENT_TRANSFER_STATE_LIST                   7
+#define EVENT_TRANSFER_BYTES_PER_EVENT              (256*1024)
+#define EVENT_TRANSFER_LIST_ENTRIES                 256
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -91,11 +122,43 @@ struct ftpParameters
     int maximumUserAndPassowrdLoginTries;
     char certificatePath[MAXIMUM_INODE_NAME];
     char privateCertificatePath[MAXIMUM_INODE_NAME];
+
+    /* TLS data connections are offloaded to the kernel when it supports it */
+    int kernelTlsEnabled;
+
+    /* Server side TLS session cache, 0 entries to disable it, the timeout is in seconds */
+    int tlsSessionCacheSize;
+    int tlsSessionTimeout;
+    int tlsSessionTickets;
     int pamAuthEnabled;
 
     /* If specified, use a port range for pasv connections */
     int connectionPortMin;
     int connectionPortMax;
+
+    /* Passive sockets kept listening on a free port of the range, ready for PASV */
+    int passivePortWarmSockets;
+
+    /* Number of threads accepting and processing the control connections */
+    int reactorThreads;
+
+    /* Pending connections queue of each listening socket, and connections accepted for each wake up */
+    int listenBacklog;
+    int acceptBatchSize;
+
+    /* Data transfer thread pool, the stack size is in KB */
+    int workerThreads;
+    int workerThreadStackSize;
+
+    /* Directories are sorted for LIST and NLST within this memory in KB, 0 to stream them unsorted */
+    int listSortMemoryLimit;
+
+    /* Data connections run by the reactors instead of the worker pool */
+    int eventDrivenTransfers;
+
+    /* Size in KB of the buffers used by the transfers, optionally backed by huge pages */
+    int transferBufferSize;
+    int transferBufferHugePages;
 } typedef ftpParameters_DataType;
     
 struct dynamicStringData
@@ -126,6 +189,14 @@ struct ipData
     int ip[4];
 } typedef ipDataType;
 
+/* Block of the control connection output queue, data from startIndex to endIndex is still to be written */
+struct clientOutputBlock
+{
+    struct clientOutputBlock *nextBlock;
+    int startIndex, endIndex;
+    char data[CLIENT_OUTPUT_BLOCK_SIZE];
+} typedef clientOutputBlockDataType;
+
 struct workerData
 {
 	#ifdef OPENSSL_ENABLED
@@ -133,32 +204,56 @@ struct workerData
 	SSL *clientSsl;
 	#endif
 
+    /* Set while a pool thread owns the data connection, abortTransfer asks it to stop */
     int threadIsAlive;
-    int threadHasBeenCreated;
+    int abortTransfer;
     int connectionPort;
     int passiveModeOn;
     int activeModeOn;
 
-    pthread_t workerThread;
     int passiveListeningSocket;
     int socketConnection;
+    TRANSPORT_DataType transport;
     int socketIsConnected;
     int bufferIndex;
-    char buffer[CLIENT_BUFFER_STRING_SIZE];
 
     int activeIpAddressIndex;
     char activeIpAddress[CLIENT_BUFFER_STRING_SIZE];
     
     int commandIndex;
     char theCommandReceived[CLIENT_COMMAND_STRING_SIZE];    
+    unsigned int commandCode;
     int commandReceived;
 
     long long int retrRestartAtByte;
 
     /* The PASV thread will wait the signal before start */
     ftpCommandDataType    ftpCommand;
-    DYNV_VectorGenericDataType directoryInfo;
     FILE *theStorFile;
+
+    /* Pipe of the STOR splice engine, released on worker reset */
+    int storPipe[2];
+
+    /* Buffer of the transfer taken from the global pool, it goes back to the pool on worker reset */
+    char *transferBuffer;
+
+    /* LIST and NLST directory being sent, the entries are written in batches */
+    FILE_DirectoryList_DataType listData;
+    int listIsOpen;
+    int listCommandType;
+    int listFilesNumber;
+    char *listBuffer;
+
+    /* Event driven transfer, the reactor of the client runs it on the eventSocket events.
+       Data written while it runs waits in eventBuffer from eventBufferStart to eventBufferEnd,
+       eventBuffer is the transferBuffer until more room is needed */
+    int eventTransferState;
+    int eventSocket;
+    uint32_t eventMask;
+    int eventIsReadWrite;
+    long long int eventFileOffset, eventFileSize;
+    char *eventBuffer;
+    int eventBufferStart, eventBufferEnd, eventBufferSize;
     DYNMEM_MemoryTable_DataType *memoryTable;
 } typedef workerDataType;
 
@@ -166,25 +261,48 @@ struct clientData
 {
 	#ifdef OPENSSL_ENABLED
     SSL *ssl;
+
+    /* Session of the last active mode data connection, the next one resumes it */
+    SSL_SESSION *activeDataSession;
 	#endif
 
     int tlsIsEnabled;
     int tlsIsNegotiating;
-    unsigned long long int tlsNegotiatingTimeStart;
+    int tlsIsClosing;
     int dataChannelIsTls;
+
+    /* Replies waiting for the control socket, only the reactor writes them. writeMutex protects the queue */
     pthread_mutex_t writeMutex;
+    clientOutputBlockDataType *outputHead, *outputTail;
+    int outputBytes;
+    int outputIsHeld, outputEventIsEnabled;
+    DYNMEM_MemoryTable_DataType *outputMemoryTable;
+
+    /* Set while the reactor waits the worker releasing the data connection: the client events are
+       removed from epoll until releaseClientWorker, the deferred command is processed again after it */
+    int eventsArePaused;
+    int commandIsDeferred;
     
     int clientProgressiveNumber;
+    int reactorId;
+
+    /* Links of the reactor free or live clients list, isLive tells which one */
+    int previousClientId, nextClientId, isLive;
     int socketDescriptor;
+    TRANSPORT_DataType transport;
     int socketIsConnected;
     
+    /* Received bytes not yet framed in a complete line */
     int bufferIndex;
     char buffer[CLIENT_BUFFER_STRING_SIZE];
     
     int socketCommandReceived;
     
+    /* The line being processed, terminated in place inside the buffer */
     int commandIndex;
-    char theCommandReceived[CLIENT_COMMAND_STRING_SIZE];
+    char *theCommandReceived;
+    unsigned int commandCode;
+    int commandIsTooLong;
     
     dynamicStringDataType renameFromFile;
     dynamicStringDataType renameToFile;
@@ -204,6 +322,9 @@ struct clientData
     int clientPort;
     char clientIpAddress[INET_ADDRSTRLEN];
 
+    /* Set when the client is counted in the per ip connections table */
+    int ipConnectionIsCounted;
+
     int serverPort;
     char serverIpAddress[INET_ADDRSTRLEN];
     int serverIpAddressInteger[4];
@@ -211,7 +332,11 @@ struct clientData
     int closeTheClient;
 
     unsigned long long int connectionTimeStamp;
+
+    /* Coarse monotonic time of the last command, the idle timer is moved forward when it expires */
     unsigned long long int lastActivityTimeStamp;
+    TWHEEL_TimerDataType idleTimer;
+    TWHEEL_TimerDataType tlsNegotiatingTimer;
 
     pthread_mutex_t conditionMutex;
     pthread_cond_t conditionVariable;
@@ -224,28 +349,68 @@ struct loginFails
     char ipAddress[INET_ADDRSTRLEN];
     unsigned long long int failTimeStamp;
     int failureNumbers;
+
+    /* The timer id is the position in loginFailsVector */
+    TWHEEL_TimerDataType expireTimer;
 } typedef loginFailsDataType;
 
+/* Entry of the open addressing table of the connections per client ip, empty when connectionsNumber is 0 */
+struct ipConnections
+{
+    in_addr_t ipAddress;
+    int connectionsNumber;
+} typedef ipConnectionsDataType;
+
 struct ConnectionParameters
 {
-    int theMainSocket, maxSocketFD;
-    fd_set rset, wset, eset, rsetAll, wsetAll, esetAll;
+    int theMainSocket, epollFd, readyEventsNumber;
+
+    /* Idle and TLS negotiation timeouts of the reactor clients */
+    TWHEEL_WheelDataType timers;
+
+    /* Each reactor owns the clients from firstClientId to firstClientId + clientsNumber - 1 */
+    int reactorId, firstClientId, clientsNumber;
+
+    /* Heads of the intrusive lists of the reactor clients, -1 when empty */
+    int firstFreeClientId, firstLiveClientId;
+    pthread_t reactorThread;
+    struct epoll_event readyEvents[MAXIMUM_READY_EVENTS];
 } typedef ConnectionData_DataType;
 
+/* TLS data connections by the engine that encrypts them and by handshake type, updated with the atomic builtins */
+struct tlsStatistics
+{
+    unsigned long long int kernelTlsSessions;
+    unsigned long long int userTlsSessions;
+    unsigned long long int resumedTlsSessions;
+    unsigned long long int fullTlsHandshakes;
+} typedef tlsStatisticsDataType;
+
 struct ftpData
 {
 	#ifdef OPENSSL_ENABLED
 	SSL_CTX *serverCtx;
 	SSL_CTX *clientCtx;
 	#endif
+    tlsStatisticsDataType tlsStatistics;
 
     int connectedClients;
     char welcomeMessage[1024];
-    ConnectionData_DataType connectionData;
+    ConnectionData_DataType *connectionData;
+    pthread_mutex_t connectionsMutex;
+    pthread_mutex_t loginFailsMutex;
+
+    /* Live connections per client ip, ipConnectionsMask + 1 entries, protected by connectionsMutex */
+    ipConnectionsDataType *ipConnections;
+    unsigned int ipConnectionsMask;
+    WPOOL_PoolDataType workerPool;
+    PORTPOOL_PoolDataType passivePorts;
+    BUFPOOL_PoolDataType transferBuffers;
     clientDataType *clients;
     ipDataType serverIp;
     ftpParameters_DataType ftpParameters;
     DYNV_VectorGenericDataType loginFailsVector;
+    TWHEEL_WheelDataType loginFailsTimers;
     DYNMEM_MemoryTable_DataType *generalDynamicMemoryTable;
 } typedef ftpDataType;
 
@@ -259,11 +424,10 @@ struct ftpListData
     int isDirectory;
     int isFile;
     int isLink;
-    char *owner;
-    char *groupOwner;
+    char owner[LIST_DATA_TYPE_OWNER_STR_SIZE];
+    char groupOwner[LIST_DATA_TYPE_OWNER_STR_SIZE];
     long long int fileSize;
-    char *inodePermissionString;
-    char **fileList;
+    char inodePermissionString[LIST_DATA_TYPE_PERMISSION_STR_SIZE];
     time_t lastModifiedData;
     char lastModifiedDataString[LIST_DATA_TYPE_MODIFIED_DATA_STR_SIZE];
 } typedef ftpListDataType;
@@ -277,14 +441,22 @@ int getSafePath(dynamicStringDataType *safePath, char *theDirectoryName, loginDa
 void appendToDynamicStringDataType(dynamicStringDataType *dynamicString, char *theString, int stringLen, DYNMEM_MemoryTable_DataType **memoryTable);
 
 
-void setRandomicPort(ftpDataType *data, int socketPosition);
-void getListDataInfo(char * thePath, DYNV_VectorGenericDataType *directoryInfo, DYNMEM_MemoryTable_DataType **memoryTable);
+int openListData(ftpDataType *ftpData, int clientId, int commandType, DYNMEM_MemoryTable_DataType **memoryTable);
+int writeListDataEntries(ftpDataType *ftpData, int clientId, int maximumEntries, DYNMEM_MemoryTable_DataType **memoryTable);
+void closeListData(ftpDataType *ftpData, int clientId, DYNMEM_MemoryTable_DataType **memoryTable);
 int writeListDataInfoToSocket(ftpDataType *data, int clientId, int *filesNumber, int commandType, DYNMEM_MemoryTable_DataType **memoryTable);
 
 int searchInLoginFailsVector(void *loginFailsVector, void *element);
 void deleteLoginFailsData(void *element);
-void deleteListDataInfoVector(DYNV_VectorGenericDataType *theVector);
+void recordLoginFail(ftpDataType *data, loginFailsDataType *element);
+void loginFailsTimeout(void *theOwner, int loginFailIndex);
+char *getTransferBuffer(ftpDataType *data, int clientId);
 void resetWorkerData(ftpDataType *data, int clientId, int isInitialization);
+#ifdef OPENSSL_ENABLED
+void resumeActiveDataSession(ftpDataType *data, int clientId);
+void dataTlsHandshakeDone(ftpDataType *data, int clientId, SSL *theSsl);
+#endif
+void releasePassiveSocket(ftpDataType *data, int theSocket, int thePort);
 void cancelWorker(ftpDataType *data, int clientId);
 void resetClientData(ftpDataType *data, int clientId, int isInitialization);
 int compareStringCaseInsensitive(char *stringIn, char* stringRef, int stringLenght);
@@ -34,6 +34,7 @@
 #include <pthread.h>
 #include <netdb.h>
 #include <errno.h>
+#include <time.h>
 
 /* FTP LIBS */
 #include "library/fileManagement.h"
@@ -48,6 +49,7 @@
 
 #include "ftpServer.h"
 #include "ftpData.h"
+#include "ftpTransfer.h"
 #include "ftpCommandsElaborate.h"
 
 ftpDataType ftpData;
@@ -56,58 +58,42 @@ ftpDataType ftpData;
 pthread_t watchDogThread;
 
 static int processCommand(int processingElement);
+static int receiveCommands(ConnectionData_DataType *reactor, int processingSock);
+static void processReceivedLines(ConnectionData_DataType *reactor, int processingSock);
+static void resumeDeferredCommand(ConnectionData_DataType *reactor, int processingSock);
 
 void workerCleanup(void *socketId)
 {
 	int theSocketId = *(int *)socketId;
 	int returnCode = 0;
+	int socketConnection, passiveListeningSocket, passivePort;
 
 
 	//printf("\nWorker %d cleanup", theSocketId);
 
-	#ifdef OPENSSL_ENABLED
-    int error;
-    error = fcntl(ftpData.clients[theSocketId].workerData.socketConnection, F_SETFL, O_NONBLOCK);
-
-	if (ftpData.clients[theSocketId].dataChannelIsTls == 1)
-	{
-		if(ftpData.clients[theSocketId].workerData.passiveModeOn == 1)
-		{
-			//printf("\nSSL worker Shutdown 1");
-			returnCode = SSL_shutdown(ftpData.clients[theSocketId].workerData.serverSsl);
-			//printf("\nnSSL worker Shutdown 1 return code : %d", returnCode);
-
-			if (!returnCode)
-			{
-			    shutdown(ftpData.clients[theSocketId].workerData.socketConnection, SHUT_RDWR);
-			    shutdown(ftpData.clients[theSocketId].workerData.passiveListeningSocket, SHUT_RDWR);
-
-				//printf("\nSSL worker Shutdown 2");
-				returnCode = SSL_shutdown(ftpData.clients[theSocketId].workerData.serverSsl);
-				//printf("\nnSSL worker Shutdown 2 return code : %d", returnCode);
-			}
-		}
-
-		if(ftpData.clients[theSocketId].workerData.activeModeOn == 1)
-		{
-			returnCode = SSL_shutdown(ftpData.clients[theSocketId].workerData.clientSsl);
-
-			if (!returnCode)
-			{
-			    shutdown(ftpData.clients[theSocketId].workerData.socketConnection, SHUT_RDWR);
-			    shutdown(ftpData.clients[theSocketId].workerData.passiveListeningSocket, SHUT_RDWR);
-			    returnCode = SSL_shutdown(ftpData.clients[theSocketId].workerData.clientSsl);
-			}
-		}
-	}
-	#endif
+    //The TLS close notify must not block the worker
+    if (ftpData.clients[theSocketId].workerData.socketIsConnected == 1)
+    {
+        fcntl(ftpData.clients[theSocketId].workerData.socketConnection, F_SETFL, O_NONBLOCK);
+        TRANSPORT_Shutdown(&ftpData.clients[theSocketId].workerData.transport);
+    }
 
-    shutdown(ftpData.clients[theSocketId].workerData.socketConnection, SHUT_RDWR);
+    //cancelWorker may be shutting down the same descriptors
+    pthread_mutex_lock(&ftpData.clients[theSocketId].conditionMutex);
+    socketConnection = ftpData.clients[theSocketId].workerData.socketConnection;
+    passiveListeningSocket = ftpData.clients[theSocketId].workerData.passiveListeningSocket;
+    passivePort = ftpData.clients[theSocketId].workerData.connectionPort;
+    ftpData.clients[theSocketId].workerData.socketConnection = -1;
+    ftpData.clients[theSocketId].workerData.passiveListeningSocket = -1;
+    pthread_mutex_unlock(&ftpData.clients[theSocketId].conditionMutex);
 
-    shutdown(ftpData.clients[theSocketId].workerData.passiveListeningSocket, SHUT_RDWR);
+    if (socketConnection != -1)
+    {
+        shutdown(socketConnection, SHUT_RDWR);
+        returnCode = close(socketConnection);
+    }
 
-    returnCode = close(ftpData.clients[theSocketId].workerData.socketConnection);
-    returnCode = close(ftpData.clients[theSocketId].workerData.passiveListeningSocket);
+    releasePassiveSocket(&ftpData, passiveListeningSocket, passivePort);
 
     resetWorkerData(&ftpData, theSocketId, 0);
 
@@ -120,122 +106,118 @@ void workerCleanup(void *socketId)
     	;//printf("\nNo data to print");
 }
 
+/* The client didn't use the data connection in time, the pool thread gives it up but the client stays connected.
+   The transfer commands received from now on are refused by the reactor, a command already handed over is refused here */
+static void expireDataConnection(int theSocketId)
+{
+    int commandIsPending;
+
+    pthread_mutex_lock(&ftpData.clients[theSocketId].conditionMutex);
+    ftpData.clients[theSocketId].workerData.abortTransfer = 1;
+    commandIsPending = ftpData.clients[theSocketId].workerData.commandReceived;
+    pthread_mutex_unlock(&ftpData.clients[theSocketId].conditionMutex);
+
+    if (commandIsPending == 1)
+        socketPrintf(&ftpData, theSocketId, "s", "425 No data connection\r\n");
+}
+
 void *connectionWorkerHandle(void * socketId)
 {
   int theSocketId = *(int *)socketId;
-  pthread_cleanup_push(workerCleanup,  (void *) &theSocketId);
-  ftpData.clients[theSocketId].workerData.threadIsAlive = 1;
-  ftpData.clients[theSocketId].workerData.threadHasBeenCreated = 1;
   int returnCode;
+  struct timespec commandDeadline;
 
   //printf("\nWORKER CREATED!");
 
   //Passive data connection mode
   if (ftpData.clients[theSocketId].workerData.passiveModeOn == 1)
   {
-    int tries = 30;
-    while (tries > 0)
+    if (ftpData.clients[theSocketId].workerData.abortTransfer == 1)
     {
-        setRandomicPort(&ftpData, theSocketId);
-        ftpData.clients[theSocketId].workerData.passiveListeningSocket = createPassiveSocket(ftpData.clients[theSocketId].workerData.connectionPort);
-
-        if (ftpData.clients[theSocketId].workerData.passiveListeningSocket != -1)
-        {
-            break;
-        }
-
-        tries--;
-    }
-
-    if (ftpData.clients[theSocketId].workerData.passiveListeningSocket == -1)
-    {
-        ftpData.clients[theSocketId].closeTheClient = 1;
-        //printf("\n Closing the client 1");
-        pthread_exit(NULL);
+        return NULL;
     }
 
+    //parseCommandPasv has created the listening socket and sent the 227 reply
     if (ftpData.clients[theSocketId].workerData.socketIsConnected == 0)
     {
-    	returnCode = socketPrintf(&ftpData, theSocketId, "sdsdsdsdsdsds", "227 Entering Passive Mode (", ftpData.clients[theSocketId].serverIpAddressInteger[0], ",", ftpData.clients[theSocketId].serverIpAddressInteger[1], ",", ftpData.clients[theSocketId].serverIpAddressInteger[2], ",", ftpData.clients[theSocketId].serverIpAddressInteger[3], ",", (ftpData.clients[theSocketId].workerData.connectionPort / 256), ",", (ftpData.clients[theSocketId].workerData.connectionPort % 256), ")\r\n");
-        if (returnCode <= 0)
-        {
-            ftpData.clients[theSocketId].closeTheClient = 1;
-            //printf("\n Closing the client 2");
-            pthread_exit(NULL);
-        }
-
         //Wait for sockets
-        if ((ftpData.clients[theSocketId].workerData.socketConnection = accept(ftpData.clients[theSocketId].workerData.passiveListeningSocket, 0, 0))!=-1)
+        if ((ftpData.clients[theSocketId].workerData.socketConnection = waitClientDataSocket(&ftpData, theSocketId, DATA_CONNECTION_TIMEOUT))!=-1)
         {
             ftpData.clients[theSocketId].workerData.socketIsConnected = 1;
+            TRANSPORT_InitPlain(&ftpData.clients[theSocketId].workerData.transport, ftpData.clients[theSocketId].workerData.socketConnection);
 			#ifdef OPENSSL_ENABLED
             if (ftpData.clients[theSocketId].dataChannelIsTls == 1)
             {
+                TRANSPORT_InitTls(&ftpData.clients[theSocketId].workerData.transport, ftpData.clients[theSocketId].workerData.socketConnection, ftpData.clients[theSocketId].workerData.serverSsl);
 
-            	returnCode = SSL_set_fd(ftpData.clients[theSocketId].workerData.serverSsl, ftpData.clients[theSocketId].workerData.socketConnection);
-
-        		if (returnCode == 0)
-        		{
-        			printf("\nSSL ERRORS ON WORKER SSL_set_fd");
-        			ftpData.clients[theSocketId].closeTheClient = 1;
-        		}
-
-                returnCode = SSL_accept(ftpData.clients[theSocketId].workerData.serverSsl);
+                //A client that never completes the handshake must not hold the pool thread
+                returnCode = TRANSPORT_TlsHandshake(ftpData.clients[theSocketId].workerData.serverSsl, ftpData.clients[theSocketId].workerData.socketConnection, 1, DATA_CONNECTION_TIMEOUT);
 
 				if (returnCode <= 0)
 				{
 					printf("\nSSL ERRORS ON WORKER");
 					ERR_print_errors_fp(stderr);
 					ftpData.clients[theSocketId].closeTheClient = 1;
+					return NULL;
 				}
-				else
-				{
-					//printf("\nSSL ACCEPTED ON WORKER");
-				}
+
+				dataTlsHandshakeDone(&ftpData, theSocketId, ftpData.clients[theSocketId].workerData.serverSsl);
             }
 			#endif
         }
+        else if (errno == ETIMEDOUT)
+        {
+            expireDataConnection(theSocketId);
+            return NULL;
+        }
         else
         {
             ftpData.clients[theSocketId].closeTheClient = 1;
             printf("\n Closing the client 3");
-            pthread_exit(NULL);
+            return NULL;
         }
     }
   }
   else if (ftpData.clients[theSocketId].workerData.activeModeOn == 1)
   {
-    ftpData.clients[theSocketId].workerData.socketConnection = createActiveSocket(ftpData.clients[theSocketId].workerData.connectionPort, ftpData.clients[theSocketId].workerData.activeIpAddress);
+    if (ftpData.clients[theSocketId].workerData.abortTransfer == 1)
+    {
+        return NULL;
+    }
+
+    returnCode = createActiveSocket(ftpData.clients[theSocketId].workerData.connectionPort, ftpData.clients[theSocketId].workerData.activeIpAddress, &ftpData.clients[theSocketId].workerData.socketConnection);
+    TRANSPORT_InitPlain(&ftpData.clients[theSocketId].workerData.transport, ftpData.clients[theSocketId].workerData.socketConnection);
 
 	#ifdef OPENSSL_ENABLED
-	if (ftpData.clients[theSocketId].dataChannelIsTls == 1)
+	if (ftpData.clients[theSocketId].dataChannelIsTls == 1 &&
+		ftpData.clients[theSocketId].workerData.socketConnection >= 0)
 	{
-		returnCode = SSL_set_fd(ftpData.clients[theSocketId].workerData.clientSsl, ftpData.clients[theSocketId].workerData.socketConnection);
-
-		if (returnCode == 0)
-		{
-			printf("\nSSL ERRORS ON WORKER SSL_set_fd");
-			ftpData.clients[theSocketId].closeTheClient = 1;
-		}
+		TRANSPORT_InitTls(&ftpData.clients[theSocketId].workerData.transport, ftpData.clients[theSocketId].workerData.socketConnection, ftpData.clients[theSocketId].workerData.clientSsl);
 		//SSL_set_connect_state(ftpData.clients[theSocketId].workerData.clientSsl);
-		returnCode = SSL_connect(ftpData.clients[theSocketId].workerData.clientSsl);
+		resumeActiveDataSession(&ftpData, theSocketId);
+		returnCode = TRANSPORT_TlsHandshake(ftpData.clients[theSocketId].workerData.clientSsl, ftpData.clients[theSocketId].workerData.socketConnection, 0, DATA_CONNECTION_TIMEOUT);
+
 		if (returnCode <= 0)
 		{
-			printf("\nSSL ERRORS ON WORKER %d error code: %d", returnCode, SSL_get_error(ftpData.clients[theSocketId].workerData.clientSsl, returnCode));
+			printf("\nSSL ERRORS ON WORKER %d", returnCode);
 			ERR_print_errors_fp(stderr);
+
+			//The control connection is still fine, only this data connection failed
+			if (ftpData.clients[theSocketId].workerData.abortTransfer == 0)
+				socketPrintf(&ftpData, theSocketId, "s", "425 Can't open data connection\r\n");
+
+			return NULL;
 		}
-		else
-		{
-			//printf("\nSSL ACCEPTED ON WORKER");
-		}
+
+		dataTlsHandshakeDone(&ftpData, theSocketId, ftpData.clients[theSocketId].workerData.clientSsl);
 	}
 	#endif
 
-    if (ftpData.clients[theSocketId].workerData.socketConnection < 0)
+    if (ftpData.clients[theSocketId].workerData.socketConnection < 0 || returnCode < 0)
     {
         ftpData.clients[theSocketId].closeTheClient = 1;
         printf("\n Closing the client 4");
-        pthread_exit(NULL);
+        return NULL;
     }
 
     returnCode = socketPrintf(&ftpData, theSocketId, "s", "200 connection accepted\r\n");
@@ -244,7 +226,7 @@ void *connectionWorkerHandle(void * socketId)
     {
         ftpData.clients[theSocketId].closeTheClient = 1;
         printf("\n Closing the client 5");
-        pthread_exit(NULL);
+        return NULL;
     }
 
     ftpData.clients[theSocketId].workerData.socketIsConnected = 1;
@@ -260,24 +242,38 @@ void *connectionWorkerHandle(void * socketId)
     if (ftpData.clients[theSocketId].workerData.socketIsConnected > 0)
     {
     	printf("\nWorker %d is waiting for commands!", theSocketId);
+        clock_gettime(CLOCK_REALTIME, &commandDeadline);
+        commandDeadline.tv_sec += DATA_CONNECTION_TIMEOUT;
+
         //Conditional lock on tconditionVariablehread actions
         pthread_mutex_lock(&ftpData.clients[theSocketId].conditionMutex);
     	//int sleepTime = 1000;
-        while (ftpData.clients[theSocketId].workerData.commandReceived == 0)
+        while (ftpData.clients[theSocketId].workerData.commandReceived == 0 &&
+               ftpData.clients[theSocketId].workerData.abortTransfer == 0)
         {
         	//usleep(sleepTime);
         	//if (sleepTime < 200000)
         	//{
         		//sleepTime+= 1000;
         	//}
-            pthread_cond_wait(&ftpData.clients[theSocketId].conditionVariable, &ftpData.clients[theSocketId].conditionMutex);
+            if (pthread_cond_timedwait(&ftpData.clients[theSocketId].conditionVariable, &ftpData.clients[theSocketId].conditionMutex, &commandDeadline) == ETIMEDOUT &&
+                ftpData.clients[theSocketId].workerData.commandReceived == 0)
+            {
+                //The idle data connection must not keep the pool thread, the reactor refuses the next transfer command
+                ftpData.clients[theSocketId].workerData.abortTransfer = 1;
+            }
         }
         pthread_mutex_unlock(&ftpData.clients[theSocketId].conditionMutex);
 
+        if (ftpData.clients[theSocketId].workerData.abortTransfer == 1)
+        {
+            break;
+        }
+
         //printf("\nWorker %d unlocked", theSocketId);
 
         if (ftpData.clients[theSocketId].workerData.commandReceived == 1 &&
-            (compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "STOR", strlen("STOR")) == 1 || compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "APPE", strlen("APPE")) == 1) &&
+            (ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_STOR || ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_APPE) &&
             ftpData.clients[theSocketId].fileToStor.textLen > 0)
         {
 
@@ -289,13 +285,13 @@ void *connectionWorkerHandle(void * socketId)
                 {
                     ftpData.clients[theSocketId].closeTheClient = 1;
                     printf("\n Closing the client 6");
-                    pthread_exit(NULL);
+                    return NULL;
                 }
 
                 break;
         	}
 
-        	if (compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "APPE", strlen("APPE")) == 1)
+        	if (ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_APPE)
         	{
 				#ifdef LARGE_FILE_SUPPORT_ENABLED
 						//#warning LARGE FILE SUPPORT IS ENABLED!
@@ -328,7 +324,7 @@ void *connectionWorkerHandle(void * socketId)
                 {
                     ftpData.clients[theSocketId].closeTheClient = 1;
                     printf("\n Closing the client 6");
-                    pthread_exit(NULL);
+                    return NULL;
                 }
 
                 break;
@@ -340,44 +336,17 @@ void *connectionWorkerHandle(void * socketId)
             {
                 ftpData.clients[theSocketId].closeTheClient = 1;
                 printf("\n Closing the client 7");
-                pthread_exit(NULL);
+                return NULL;
             }
 
-            while(1)
-            {
+            long long int storedSize = 0;
 
-            	if (ftpData.clients[theSocketId].dataChannelIsTls != 1)
-            	{
-            		ftpData.clients[theSocketId].workerData.bufferIndex = read(ftpData.clients[theSocketId].workerData.socketConnection, ftpData.clients[theSocketId].workerData.buffer, CLIENT_BUFFER_STRING_SIZE);
-            	}
-            	else if (ftpData.clients[theSocketId].dataChannelIsTls == 1)
-            	{
-
-					#ifdef OPENSSL_ENABLED
-            		if (ftpData.clients[theSocketId].workerData.passiveModeOn == 1)
-            			ftpData.clients[theSocketId].workerData.bufferIndex = SSL_read(ftpData.clients[theSocketId].workerData.serverSsl, ftpData.clients[theSocketId].workerData.buffer, CLIENT_BUFFER_STRING_SIZE);
-            		else if(ftpData.clients[theSocketId].workerData.activeModeOn == 1)
-            			ftpData.clients[theSocketId].workerData.bufferIndex = SSL_read(ftpData.clients[theSocketId].workerData.clientSsl, ftpData.clients[theSocketId].workerData.buffer, CLIENT_BUFFER_STRING_SIZE);
-					#endif
-            	}
-            	else
-            	{
-            		printf("\nError state");
-            	}
-
-                if (ftpData.clients[theSocketId].workerData.bufferIndex == 0)
-                {
-                    break;
-                }
-                else if (ftpData.clients[theSocketId].workerData.bufferIndex > 0)
-                {
-                    fwrite(ftpData.clients[theSocketId].workerData.buffer, ftpData.clients[theSocketId].workerData.bufferIndex, 1, ftpData.clients[theSocketId].workerData.theStorFile);
-                    usleep(100);
-                }
-                else if (ftpData.clients[theSocketId].workerData.bufferIndex < 0)
-                {
-                    break;
-                }
+            /* Socket to file without user space copies if the transport can */
+            storedSize = TRANSPORT_ReceiveFile(&ftpData.clients[theSocketId].workerData.transport, fileno(ftpData.clients[theSocketId].workerData.theStorFile), ftpData.clients[theSocketId].workerData.storPipe);
+
+            if (storedSize == TRANSPORT_NOT_SUPPORTED)
+            {
+                storedSize = readWriteStorFile(&ftpData.clients[theSocketId].workerData.transport, fileno(ftpData.clients[theSocketId].workerData.theStorFile), getTransferBuffer(&ftpData, theSocketId), ftpData.transferBuffers.bufferSize);
             }
 
             int theReturnCode;
@@ -389,37 +358,50 @@ void *connectionWorkerHandle(void * socketId)
                 FILE_doChownFromUidGid(ftpData.clients[theSocketId].fileToStor.text, ftpData.clients[theSocketId].login.ownerShip.uid, ftpData.clients[theSocketId].login.ownerShip.gid);
             }
 
-            returnCode = socketPrintf(&ftpData, theSocketId, "s", "226 file stor ok\r\n");
+            //ABOR has already replied to the client
+            if (ftpData.clients[theSocketId].workerData.abortTransfer == 1)
+            {
+                break;
+            }
+
+            if (storedSize < 0)
+                returnCode = socketPrintf(&ftpData, theSocketId, "s", "451 Error while writing the file\r\n");
+            else
+                returnCode = socketPrintf(&ftpData, theSocketId, "s", "226 file stor ok\r\n");
             if (returnCode <= 0)
             {
                 ftpData.clients[theSocketId].closeTheClient = 1;
                 printf("\n Closing the client 8");
-                pthread_exit(NULL);
+                return NULL;
             }
 
             break;
         }
       else if (ftpData.clients[theSocketId].workerData.commandReceived == 1 &&
-               (  (compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "LIST", strlen("LIST")) == 1)
-               || (compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "NLST", strlen("NLST")) == 1))
+               (  (ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_LIST)
+               || (ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_NLST))
               )
         {
           int theFiles = 0, theCommandType;
+          char *thePathToList = ftpData.clients[theSocketId].listPath.text;
 
-          if (compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "LIST", strlen("LIST")) == 1)
+          if (ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_LIST)
               theCommandType = COMMAND_TYPE_LIST;
-          else if (compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "NLST", strlen("NLST")) == 1)
+          else if (ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_NLST)
+          {
               theCommandType = COMMAND_TYPE_NLST;
+              thePathToList = ftpData.clients[theSocketId].nlistPath.text;
+          }
 
 
-      	if ((checkUserFilePermissions(ftpData.clients[theSocketId].listPath.text, ftpData.clients[theSocketId].login.ownerShip.uid, ftpData.clients[theSocketId].login.ownerShip.gid) & FILE_PERMISSION_R) != FILE_PERMISSION_R)
+      	if ((checkUserFilePermissions(thePathToList, ftpData.clients[theSocketId].login.ownerShip.uid, ftpData.clients[theSocketId].login.ownerShip.gid) & FILE_PERMISSION_R) != FILE_PERMISSION_R)
           {
               returnCode = socketPrintf(&ftpData, theSocketId, "s", "550 No permissions\r\n");
               if (returnCode <= 0)
               {
                   ftpData.clients[theSocketId].closeTheClient = 1;
                   printf("\n Closing the client 8");
-                  pthread_exit(NULL);
+                  return NULL;
               }
               break;
           }
@@ -429,16 +411,21 @@ void *connectionWorkerHandle(void * socketId)
           {
               ftpData.clients[theSocketId].closeTheClient = 1;
               printf("\n Closing the client 8");
-              pthread_exit(NULL);
+              return NULL;
           }
 
           //returnCode = writeListDataInfoToSocket(ftpData.clients[theSocketId].listPath.text, ftpData.clients[theSocketId].workerData.socketConnection, &theFiles, theCommandType);
           returnCode = writeListDataInfoToSocket(&ftpData, theSocketId, &theFiles, theCommandType, &ftpData.clients[theSocketId].workerData.memoryTable);
+          if (ftpData.clients[theSocketId].workerData.abortTransfer == 1)
+          {
+              break;
+          }
+
           if (returnCode <= 0)
           {
               ftpData.clients[theSocketId].closeTheClient = 1;
               printf("\n Closing the client 9");
-              pthread_exit(NULL);
+              return NULL;
           }
 
           returnCode = socketPrintf(&ftpData, theSocketId, "sds", "226 ", theFiles, " matches total\r\n");
@@ -446,13 +433,13 @@ void *connectionWorkerHandle(void * socketId)
           {
               ftpData.clients[theSocketId].closeTheClient = 1;
               printf("\n Closing the client 10");
-              pthread_exit(NULL);
+              return NULL;
           }
 
           break;
       }
         else if (ftpData.clients[theSocketId].workerData.commandReceived == 1 &&
-                 compareStringCaseInsensitive(ftpData.clients[theSocketId].workerData.theCommandReceived, "RETR", strlen("RETR")) == 1)
+                 ftpData.clients[theSocketId].workerData.commandCode == FTP_COMMAND_CODE_RETR)
         {
             long long int writenSize = 0, writeReturn = 0;
             writeReturn = socketPrintf(&ftpData, theSocketId, "s", "150 Accepted data connection\r\n");
@@ -460,7 +447,7 @@ void *connectionWorkerHandle(void * socketId)
             {
                 ftpData.clients[theSocketId].closeTheClient = 1;
                 printf("\n Closing the client 11");
-                pthread_exit(NULL);
+                return NULL;
             }
 
         	if ((checkUserFilePermissions(ftpData.clients[theSocketId].fileToRetr.text, ftpData.clients[theSocketId].login.ownerShip.uid, ftpData.clients[theSocketId].login.ownerShip.gid) & FILE_PERMISSION_R) != FILE_PERMISSION_R)
@@ -470,7 +457,7 @@ void *connectionWorkerHandle(void * socketId)
                 {
                   ftpData.clients[theSocketId].closeTheClient = 1;
                   printf("\n Closing the client 12");
-                  pthread_exit(NULL);
+                  return NULL;
                 }
 
                 break;
@@ -479,6 +466,11 @@ void *connectionWorkerHandle(void * socketId)
             writenSize = writeRetrFile(&ftpData, theSocketId, ftpData.clients[theSocketId].workerData.retrRestartAtByte, ftpData.clients[theSocketId].workerData.theStorFile);
             ftpData.clients[theSocketId].workerData.retrRestartAtByte = 0;
 
+            if (ftpData.clients[theSocketId].workerData.abortTransfer == 1)
+            {
+                break;
+            }
+
             if (writenSize <= -1)
             {
               writeReturn = socketPrintf(&ftpData, theSocketId, "s", "550 unable to open the file for reading\r\n");
@@ -487,7 +479,7 @@ void *connectionWorkerHandle(void * socketId)
               {
                 ftpData.clients[theSocketId].closeTheClient = 1;
                 printf("\n Closing the client 12");
-                pthread_exit(NULL);
+                return NULL;
               }
               break;
             }
@@ -498,7 +490,7 @@ void *connectionWorkerHandle(void * socketId)
             {
               ftpData.clients[theSocketId].closeTheClient = 1;
               printf("\n Closing the client 13");
-              pthread_exit(NULL);
+              return NULL;
             }
             break;
         }
@@ -511,19 +503,32 @@ void *connectionWorkerHandle(void * socketId)
 
   }
 
-  pthread_exit((void *)1);
-  pthread_cleanup_pop(0);
-  pthread_exit((void *)2);
   return NULL;
 }
 
+/* Worker pool job, serves one data connection of the client then releases it */
+void connectionWorkerJob(int theSocketId)
+{
+  int closeTheClient = ftpData.clients[theSocketId].closeTheClient;
+
+  connectionWorkerHandle((void *) &theSocketId);
+
+  //A cancelled transfer fails on purpose, the control connection stays open
+  if (ftpData.clients[theSocketId].workerData.abortTransfer == 1)
+      ftpData.clients[theSocketId].closeTheClient = closeTheClient;
+
+  workerCleanup((void *) &theSocketId);
+
+  //Wake up the reactor, it closes the client or processes its deferred command
+  releaseClientWorker(&ftpData, theSocketId);
+}
+
 void runFtpServer(void)
 {
     printf("\nHello uFTP server %s starting..\n", UFTP_SERVER_VERSION);
 
 
-    /* Needed for Select*/
-    static int processingSock = 0, returnCode = 0;
+    int returnCode = 0, reactorId = 0;
 
     /* Handle signals */
     signalHandlerInstall();
@@ -542,15 +547,28 @@ void runFtpServer(void)
     //Fork the process
     respawnProcess();
 
-    //Socket main creator
-    ftpData.connectionData.theMainSocket = createSocket(&ftpData);
+    //Socket main creator, every reactor has its own listening socket on the same port
+    for (reactorId = 0; reactorId < ftpData.ftpParameters.reactorThreads; reactorId++)
+    {
+        ftpData.connectionData[reactorId].theMainSocket = createSocket(&ftpData);
+
+        /* init the epoll set with the main socket */
+        fdInit(&ftpData, reactorId);
+    }
     printf("\nuFTP server starting..");
 
-    /* init fd set needed for select */
-    fdInit(&ftpData);
+    /* PASV takes its port and listening socket from the pool on the control thread */
+    PORTPOOL_Init(&ftpData.passivePorts, ftpData.ftpParameters.connectionPortMin, ftpData.ftpParameters.connectionPortMax, ftpData.ftpParameters.passivePortWarmSockets, createPassiveSocket);
 
-    /* the maximum socket fd is now the main socket descriptor */
-    ftpData.connectionData.maxSocketFD = ftpData.connectionData.theMainSocket+1;
+    /* Transfers take their buffer from the pool while they run */
+    BUFPOOL_Init(&ftpData.transferBuffers, ftpData.ftpParameters.transferBufferSize * 1024, ftpData.ftpParameters.transferBufferHugePages);
+
+    /* Data connections are served by the worker pool, one job per PASV or PORT */
+    if (WPOOL_Init(&ftpData.workerPool, ftpData.ftpParameters.workerThreads, (size_t) ftpData.ftpParameters.workerThreadStackSize * 1024, ftpData.ftpParameters.maxClients, connectionWorkerJob) <= 0)
+    {
+        printf("\nUnable to start the worker pool");
+        exit(0);
+    }
 
     returnCode = pthread_create(&watchDogThread, NULL, watchDog, NULL);
 
@@ -560,11 +578,34 @@ void runFtpServer(void)
 		exit(0);
 		}
 
+    for (reactorId = 1; reactorId < ftpData.ftpParameters.reactorThreads; reactorId++)
+    {
+        returnCode = pthread_create(&ftpData.connectionData[reactorId].reactorThread, NULL, reactorHandle, &ftpData.connectionData[reactorId].reactorId);
+
+        if (returnCode != 0)
+        {
+            printf("pthread_create reactor %d Error %d", reactorId, returnCode);
+            exit(0);
+        }
+    }
+
+    /* The main thread runs the first reactor */
+    reactorHandle(&ftpData.connectionData[0].reactorId);
+    return;
+}
+
+void *reactorHandle(void * reactorIdPointer)
+{
+    int reactorId = *(int *)reactorIdPointer;
+    int processingSock = 0, returnCode = 0, readyEvent = 0, acceptIsPending = 0;
+    ConnectionData_DataType *reactor = &ftpData.connectionData[reactorId];
+
   //Endless loop ftp process
     while (1)
     {
     //Update watchdog timer
-   	updateWatchDogTime((int)time(NULL));
+    if (reactorId == 0)
+   	    updateWatchDogTime((int)time(NULL));
 
 
 	/*
@@ -580,48 +621,84 @@ void runFtpServer(void)
 		{
 			printf("\nftpData.clients[%d].workerData.memoryTable = %s", memCount, ftpData.clients[memCount].workerData.memoryTable->theName);
 		}
-
-		if (ftpData.clients[memCount].workerData.directoryInfo.memoryTable != NULL)
-		{
-			printf("\nftpData.clients[%d].workerData.directoryInfo.memoryTable = %s", memCount, ftpData.clients[memCount].workerData.directoryInfo.memoryTable->theName);
-		}
 	}
 	*/
 
-        /* waits for socket activity, if no activity then checks for client socket timeouts */
-        if (selectWait(&ftpData) == 0)
+        /* waits for socket activity, then runs the expired timeouts */
+        selectWait(&ftpData, reactorId);
+        checkClientConnectionTimeout(&ftpData, reactorId);
+
+        if (reactorId == 0 &&
+            reactor->timers.currentTime != ftpData.loginFailsTimers.currentTime)
         {
-            checkClientConnectionTimeout(&ftpData);
             flushLoginWrongTriesData(&ftpData);
         }
 
+        /*Main loop handle client commands, only the ready sockets are processed */
+        for (readyEvent = 0; readyEvent < reactor->readyEventsNumber; readyEvent++)
+        {
+            processingSock = getReadyClientId(&ftpData, reactorId, readyEvent);
 
+            /* Pending connections are accepted after the ready clients have been served */
+            if (processingSock == MAIN_SOCKET_EVENT_ID)
+            {
+                acceptIsPending = 1;
+                continue;
+            }
 
-        /*Main loop handle client commands */
-        for (processingSock = 0; processingSock < ftpData.ftpParameters.maxClients; processingSock++)
-        {
-            /* close the connection if quit flag has been set */
-            if (ftpData.clients[processingSock].closeTheClient == 1)
+            /* Event driven data connection, the replies are written together at the end */
+            if ((processingSock & DATA_SOCKET_EVENT_FLAG) == DATA_SOCKET_EVENT_FLAG)
             {
-                closeClient(&ftpData, processingSock);
+                processingSock = processingSock & ~DATA_SOCKET_EVENT_FLAG;
+
+                if (isClientConnected(&ftpData, processingSock) == 0)
+                    continue;
+
+                holdClientOutput(&ftpData, processingSock);
+                processDataSocketEvent(&ftpData, processingSock, reactor->readyEvents[readyEvent].events);
+
+                if (flushClientOutput(&ftpData, processingSock) < 0 ||
+                    ftpData.clients[processingSock].closeTheClient == 1)
+                {
+                    closeClient(&ftpData, processingSock);
+                }
+
                 continue;
             }
 
-            /* Check if there are client pending connections, accept the connection if possible otherwise reject */  
-            if ((returnCode = evaluateClientSocketConnection(&ftpData)) == 1)
+            /* close the connection if quit flag has been set */
+            if (ftpData.clients[processingSock].closeTheClient == 1)
             {
-                break;
+                closeClient(&ftpData, processingSock);
+                continue;
             }
 
-            /* no data to check client is not connected, continue to check other clients */
+            /* the client has been closed while processing a previous event */
           if (isClientConnected(&ftpData, processingSock) == 0) 
           {
               /* socket is not conneted */
               continue;
           }
 
-          if (FD_ISSET(ftpData.clients[processingSock].socketDescriptor, &ftpData.connectionData.rset) || 
-              FD_ISSET(ftpData.clients[processingSock].socketDescriptor, &ftpData.connectionData.eset))
+          /* The control socket can take the queued replies, or the worker has released the data connection */
+          if (reactor->readyEvents[readyEvent].events & EPOLLOUT)
+          {
+              if (flushClientOutput(&ftpData, processingSock) < 0)
+              {
+                  closeClient(&ftpData, processingSock);
+                  continue;
+              }
+
+              resumeDeferredCommand(reactor, processingSock);
+
+              if (ftpData.clients[processingSock].closeTheClient == 1)
+              {
+                  closeClient(&ftpData, processingSock);
+                  continue;
+              }
+          }
+
+          if (reactor->readyEvents[readyEvent].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
           {
 
 			#ifdef OPENSSL_ENABLED
@@ -634,328 +711,260 @@ void runFtpServer(void)
 						//printf("\nSSL NOT YET ACCEPTED: %d", returnCode);
 						ftpData.clients[processingSock].tlsIsEnabled = 0;
 						ftpData.clients[processingSock].tlsIsNegotiating = 1;
-
-						if ( ((int)time(NULL) - ftpData.clients[processingSock].tlsNegotiatingTimeStart) > TLS_NEGOTIATING_TIMEOUT )
-						{
-							ftpData.clients[processingSock].closeTheClient = 1;
-							//printf("\nTLS timeout closing the client time:%lld, start time: %lld..", (int)time(NULL), ftpData.clients[processingSock].tlsNegotiatingTimeStart);
-						}
-
 					}
 					else
 					{
 						//printf("\nSSL ACCEPTED");
 						ftpData.clients[processingSock].tlsIsEnabled = 1;
 						ftpData.clients[processingSock].tlsIsNegotiating = 0;
+						TRANSPORT_InitTls(&ftpData.clients[processingSock].transport, ftpData.clients[processingSock].socketDescriptor, ftpData.clients[processingSock].ssl);
+						TWHEEL_Stop(&reactor->timers, &ftpData.clients[processingSock].tlsNegotiatingTimer);
 					}
 
 
+					continue;
+				}
+
+				//CCC, the client close notify ends the TLS session
+				if (ftpData.clients[processingSock].tlsIsClosing == 1)
+				{
+					ERR_clear_error();
+					returnCode = SSL_shutdown(ftpData.clients[processingSock].ssl);
+
+					if (returnCode == 1)
+					{
+						ftpData.clients[processingSock].tlsIsClosing = 0;
+						TRANSPORT_InitPlain(&ftpData.clients[processingSock].transport, ftpData.clients[processingSock].socketDescriptor);
+					}
+					else if (SSL_get_error(ftpData.clients[processingSock].ssl, returnCode) != SSL_ERROR_WANT_READ)
+					{
+						closeClient(&ftpData, processingSock);
+					}
+
 					continue;
 				}
 			#endif
 
-        	  if (ftpData.clients[processingSock].tlsIsEnabled == 1)
-        	  {
-				  #ifdef OPENSSL_ENABLED
-        		  ftpData.clients[processingSock].bufferIndex = SSL_read(ftpData.clients[processingSock].ssl, ftpData.clients[processingSock].buffer, CLIENT_BUFFER_STRING_SIZE);
-				  #endif
-        	  }
-        	  else
-        	  {
-        		  ftpData.clients[processingSock].bufferIndex = read(ftpData.clients[processingSock].socketDescriptor, ftpData.clients[processingSock].buffer, CLIENT_BUFFER_STRING_SIZE);
-        	  }
-
-            //The client is not connected anymore
-            if ((ftpData.clients[processingSock].bufferIndex) == 0)
+            //Some commands has been received, their replies are written together at the end
+            holdClientOutput(&ftpData, processingSock);
+            returnCode = receiveCommands(reactor, processingSock);
+
+            if (returnCode == 0)
             {
               closeClient(&ftpData, processingSock);
+              continue;
             }
 
-            //Debug print errors
-            if (ftpData.clients[processingSock].bufferIndex < 0)
+            if (flushClientOutput(&ftpData, processingSock) < 0)
+                ftpData.clients[processingSock].closeTheClient = 1;
+
+            resumeDeferredCommand(reactor, processingSock);
+
+            /* close the connection if a command has set the quit flag */
+            if (ftpData.clients[processingSock].closeTheClient == 1)
+            {
+                closeClient(&ftpData, processingSock);
+            }
+        }
+      }
+
+        /* Accept the client pending connections if possible otherwise reject, a batch for each wake up */
+        if (acceptIsPending == 1)
+        {
+            acceptIsPending = 0;
+            evaluateClientSocketConnection(&ftpData, reactorId);
+        }
+  }
+
+  //Server Close
+  close(reactor->epollFd);
+  shutdown(reactor->theMainSocket, SHUT_RDWR);
+  close(reactor->theMainSocket);
+  return NULL;
+}
+
+/* Read the control socket and process the complete lines, returns 0 if the client has disconnected */
+static int receiveCommands(ConnectionData_DataType *reactor, int processingSock)
+{
+    int readSize = 0;
+    clientDataType *theClient = &ftpData.clients[processingSock];
+
+    do
+    {
+        readSize = TRANSPORT_Read(&theClient->transport, theClient->buffer + theClient->bufferIndex, CLIENT_BUFFER_STRING_SIZE - theClient->bufferIndex);
+
+        //The client is not connected anymore
+        if (readSize == 0)
+            return 0;
+
+        //Debug print errors
+        if (readSize < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
             {
-                //ftpData.clients[processingSock].closeTheClient = 1;
                 printf("\n1 Errno = %d", errno);
                 perror("1 Error: ");
-                continue;
             }
 
-            //Some commands has been received
-            if (ftpData.clients[processingSock].bufferIndex > 0)
+            return 1;
+        }
+
+        theClient->bufferIndex += readSize;
+        processReceivedLines(reactor, processingSock);
+    }
+    /* The TLS layer may hold decrypted records the socket won't signal again */
+    while (theClient->closeTheClient == 0 &&
+           TRANSPORT_Pending(&theClient->transport) > 0);
+
+    return 1;
+}
+
+/* Process again the command deferred until the previous data connection worker was gone, releaseClientWorker wakes up the reactor */
+static void resumeDeferredCommand(ConnectionData_DataType *reactor, int processingSock)
+{
+    clientDataType *theClient = &ftpData.clients[processingSock];
+
+    //threadIsAlive is read after the flush, a wake up disabled by it is not lost
+    while (theClient->commandIsDeferred == 1 &&
+           theClient->closeTheClient == 0 &&
+           theClient->workerData.threadIsAlive == 0)
+    {
+        theClient->commandIsDeferred = 0;
+        holdClientOutput(&ftpData, processingSock);
+        processReceivedLines(reactor, processingSock);
+
+        if (flushClientOutput(&ftpData, processingSock) < 0)
+            theClient->closeTheClient = 1;
+    }
+}
+
+/* Process every complete line of the buffer in place, the partial line left is moved at the buffer start */
+static void processReceivedLines(ConnectionData_DataType *reactor, int processingSock)
+{
+    int commandProcessStatus = 0;
+    clientDataType *theClient = &ftpData.clients[processingSock];
+    char *lineStart = theClient->buffer;
+    char *bufferEnd = theClient->buffer + theClient->bufferIndex;
+    char *lineEnd;
+
+    while (theClient->closeTheClient == 0 &&
+           theClient->commandIsDeferred == 0 &&
+           (lineEnd = memchr(lineStart, '\n', bufferEnd - lineStart)) != NULL)
+    {
+        theClient->theCommandReceived = lineStart;
+        theClient->commandIndex = lineEnd - lineStart;
+        lineStart = lineEnd + 1;
+
+        if (theClient->commandIndex > 0 && theClient->theCommandReceived[theClient->commandIndex - 1] == '\r')
+            theClient->commandIndex--;
+
+        theClient->theCommandReceived[theClient->commandIndex] = '\0';
+
+        //The tail of a line too long to be processed
+        if (theClient->commandIsTooLong == 1)
+        {
+            theClient->commandIsTooLong = 0;
+            continue;
+        }
+
+        theClient->socketCommandReceived = 1;
+        //printf("\n Processing the command: %s", theClient->theCommandReceived);
+        commandProcessStatus = processCommand(processingSock);
+        //Echo unrecognized commands
+        if (commandProcessStatus == FTP_COMMAND_NOT_RECONIZED)
+        {
+            int returnCode = 0;
+            returnCode = socketPrintf(&ftpData, processingSock, "s", "500 Unknown command\r\n");
+            if (returnCode < 0)
             {
-              int i = 0;
-              int commandProcessStatus = 0;
-              for (i = 0; i < ftpData.clients[processingSock].bufferIndex; i++)
-              {
-                  if (ftpData.clients[processingSock].commandIndex < CLIENT_COMMAND_STRING_SIZE)
-                  {
-                      if (ftpData.clients[processingSock].buffer[i] != '\r' && ftpData.clients[processingSock].buffer[i] != '\n')
-                      {
-                          ftpData.clients[processingSock].theCommandReceived[ftpData.clients[processingSock].commandIndex++] = ftpData.clients[processingSock].buffer[i];
-                      }
-
-                      if (ftpData.clients[processingSock].buffer[i] == '\n') 
-                          {
-                              ftpData.clients[processingSock].socketCommandReceived = 1;
-                              //printf("\n Processing the command: %s", ftpData.clients[processingSock].theCommandReceived);
-                              commandProcessStatus = processCommand(processingSock);
-                              //Echo unrecognized commands
-                              if (commandProcessStatus == FTP_COMMAND_NOT_RECONIZED) 
-                              {
-                                  int returnCode = 0;
-                                  returnCode = socketPrintf(&ftpData, processingSock, "s", "500 Unknown command\r\n");
-                                  if (returnCode < 0)
-                                  {
-                                	  ftpData.clients[processingSock].closeTheClient = 1;
-                                  }
-                                  printf("\n COMMAND NOT SUPPORTED ********* %s", ftpData.clients[processingSock].buffer);
-                              }
-                              else if (commandProcessStatus == FTP_COMMAND_PROCESSED)
-                              {
-                                  ftpData.clients[processingSock].lastActivityTimeStamp = (int)time(NULL);
-                                  
-                              }
-                              else if (commandProcessStatus == FTP_COMMAND_PROCESSED_WRITE_ERROR)
-                              {
-                                  ftpData.clients[processingSock].closeTheClient = 1;
-                                  printf("\n Write error WARNING!");
-                              }
-                          }
-                  }
-                  else
-                  {
-                      //Command overflow can't be processed
-                      int returnCode;
-                      ftpData.clients[processingSock].commandIndex = 0;
-                      memset(ftpData.clients[processingSock].theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
-                      returnCode = socketPrintf(&ftpData, processingSock, "s", "500 Unknown command\r\n");
-                      if (returnCode <= 0) 
-                          ftpData.clients[processingSock].closeTheClient = 1;
-                      
-                      printf("\n Command too long closing the client.");
-                      break;
-                  }
-              }
-              usleep(100);
-              memset(ftpData.clients[processingSock].buffer, 0, CLIENT_BUFFER_STRING_SIZE);
+                theClient->closeTheClient = 1;
             }
+            printf("\n COMMAND NOT SUPPORTED ********* %s", theClient->theCommandReceived);
+        }
+        else if (commandProcessStatus == FTP_COMMAND_PROCESSED)
+        {
+            theClient->lastActivityTimeStamp = reactor->timers.currentTime;
+        }
+        else if (commandProcessStatus == FTP_COMMAND_PROCESSED_WRITE_ERROR)
+        {
+            theClient->closeTheClient = 1;
+            printf("\n Write error WARNING!");
+        }
+        else if (commandProcessStatus == FTP_COMMAND_DEFERRED)
+        {
+            //The line stays in the buffer with its terminator, resumeDeferredCommand processes it again
+            theClient->theCommandReceived[theClient->commandIndex] = (theClient->theCommandReceived + theClient->commandIndex == lineEnd) ? '\n' : '\r';
+            theClient->commandIsDeferred = 1;
+            lineStart = theClient->theCommandReceived;
+            break;
         }
-      }
-  }
 
-  //Server Close
-  shutdown(ftpData.connectionData.theMainSocket, SHUT_RDWR);
-  close(ftpData.connectionData.theMainSocket);
-  return;
+        //What follows AUTH TLS in the same read has not been encrypted, it is dropped
+        if (theClient->tlsIsNegotiating == 1)
+        {
+            lineStart = bufferEnd;
+            break;
+        }
+    }
+
+    theClient->bufferIndex = bufferEnd - lineStart;
+
+    if (theClient->bufferIndex == CLIENT_BUFFER_STRING_SIZE)
+    {
+        //Command overflow can't be processed, the rest of the line is skipped
+        theClient->bufferIndex = 0;
+
+        if (theClient->commandIsTooLong == 0)
+        {
+            int returnCode;
+            theClient->commandIsTooLong = 1;
+            returnCode = socketPrintf(&ftpData, processingSock, "s", "500 Unknown command\r\n");
+            if (returnCode <= 0)
+                theClient->closeTheClient = 1;
+
+            printf("\n Command too long closing the client.");
+        }
+    }
+    else if (theClient->bufferIndex > 0 && lineStart != theClient->buffer)
+    {
+        memmove(theClient->buffer, lineStart, theClient->bufferIndex);
+    }
 }
 
 static int processCommand(int processingElement)
 {
     int toReturn = 0;
+    ftpCommandEntryDataType *theCommand;
     //printTimeStamp();
     //printf ("\nCommand received from (%d): %s", processingElement, ftpData.clients[processingElement].theCommandReceived);
 
     cleanDynamicStringDataType(&ftpData.clients[processingElement].ftpCommand.commandArgs, 0, &ftpData.clients[processingElement].memoryTable);
     cleanDynamicStringDataType(&ftpData.clients[processingElement].ftpCommand.commandOps, 0, &ftpData.clients[processingElement].memoryTable);
 
+    ftpData.clients[processingElement].commandCode = getFtpCommandCode(ftpData.clients[processingElement].theCommandReceived);
+    theCommand = searchFtpCommand(ftpData.clients[processingElement].commandCode, ftpData.clients[processingElement].theCommandReceived);
+
     if (ftpData.clients[processingElement].login.userLoggedIn == 0 &&
-        (compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "USER", strlen("USER")) != 1 &&
-         compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PASS", strlen("PASS")) != 1 &&
-         compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "QUIT", strlen("QUIT")) != 1 &&
-		 compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PBSZ", strlen("PBSZ")) != 1 &&
-		 compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PROT", strlen("PROT")) != 1 &&
-		 compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "CCC", strlen("CCC")) != 1 &&
-         compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "AUTH", strlen("AUTH")) != 1))
+        (theCommand == NULL || (theCommand->flags & FTP_COMMAND_FLAG_NO_LOGIN) == 0))
         {
             toReturn = notLoggedInMessage(&ftpData, processingElement);
-            ftpData.clients[processingElement].commandIndex = 0;
-            memset(ftpData.clients[processingElement].theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
             return 1;
         }
 
     //Process Command
-    if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "USER", strlen("USER")) == 1)
-    {
-        //printf("\nUSER COMMAND RECEIVED");
-        toReturn = parseCommandUser(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PASS", strlen("PASS")) == 1)
-    {
-        //printf("\nPASS COMMAND RECEIVED");
-        toReturn = parseCommandPass(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "SITE", strlen("SITE")) == 1)
-    {
-        //printf("\nSITE COMMAND RECEIVED");
-        toReturn = parseCommandSite(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "AUTH", strlen("AUTH")) == 1)
-    {
-        //printf("\nAUTH COMMAND RECEIVED");
-        toReturn = parseCommandAuth(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PROT", strlen("PROT")) == 1)
-    {
-        //printf("\nPROT COMMAND RECEIVED");
-        toReturn = parseCommandProt(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PBSZ", strlen("PBSZ")) == 1)
-    {
-        //printf("\nPBSZ COMMAND RECEIVED");
-        toReturn = parseCommandPbsz(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "CCC", strlen("CCC")) == 1)
-    {
-        //printf("\nCCC COMMAND RECEIVED");
-        toReturn = parseCommandCcc(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PWD", strlen("PWD")) == 1)
-    {
-        //printf("\nPWD COMMAND RECEIVED");
-        toReturn = parseCommandPwd(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "SYST", strlen("SYST")) == 1)
-    {
-        //printf("\nSYST COMMAND RECEIVED");
-        toReturn = parseCommandSyst(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "FEAT", strlen("FEAT")) == 1)
-    {
-        //printf("\nFEAT COMMAND RECEIVED");
-        toReturn = parseCommandFeat(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "TYPE I", strlen("TYPE I")) == 1)
-    {
-        //printf("\nTYPE I COMMAND RECEIVED");
-        toReturn = parseCommandTypeI(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "STRU F", strlen("STRU F")) == 1)
-    {
-        //printf("\nTYPE I COMMAND RECEIVED");
-        toReturn = parseCommandStruF(&ftpData, processingElement);
-    }    
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "MODE S", strlen("MODE S")) == 1)
-    {
-        //printf("\nMODE S COMMAND RECEIVED");
-        toReturn = parseCommandModeS(&ftpData, processingElement);
-    }    
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "TYPE A", strlen("TYPE A")) == 1)
-    {
-        //printf("\nTYPE A COMMAND RECEIVED");
-        toReturn = parseCommandTypeI(&ftpData, processingElement);
-    }    
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PASV", strlen("PASV")) == 1)
-    {
-        //printf("\nPASV COMMAND RECEIVED");
-        toReturn = parseCommandPasv(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "PORT", strlen("PORT")) == 1)
-    {
-        //printf("\nPORT COMMAND RECEIVED");
-        toReturn = parseCommandPort(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "LIST", strlen("LIST")) == 1)
+    if (theCommand != NULL)
     {
-        //printf("\nLIST COMMAND RECEIVED");
-        toReturn = parseCommandList(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "CWD", strlen("CWD")) == 1)
-    {
-        //printf("\nCWD COMMAND RECEIVED");
-        toReturn = parseCommandCwd(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "CDUP", strlen("CDUP")) == 1)
-    {
-        //printf("\nCDUP COMMAND RECEIVED");
-        toReturn = parseCommandCdup(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "REST", strlen("REST")) == 1)
-    {
-        //printf("\nREST COMMAND RECEIVED");
-        toReturn = parseCommandRest(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "RETR", strlen("RETR")) == 1)
-    {
-        //printf("\nRETR COMMAND RECEIVED");
-        toReturn = parseCommandRetr(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "STOR", strlen("STOR")) == 1)
-    {
-        //printf("\nSTOR COMMAND RECEIVED");
-        toReturn = parseCommandStor(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "MKD", strlen("MKD")) == 1)
-    {
-        //printf("\nMKD command received");
-        toReturn = parseCommandMkd(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "ABOR", strlen("ABOR")) == 1)
-    {
-        //printf("\nABOR command received");
-        toReturn = parseCommandAbor(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "DELE", strlen("DELE")) == 1)
-    {
-        //printf("\nDELE comman200 OKd received");
-        toReturn = parseCommandDele(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "OPTS", strlen("OPTS")) == 1)
-    {
-        //printf("\nOPTS command received");
-        toReturn = parseCommandOpts(&ftpData, processingElement);
-    }    
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "MDTM", strlen("MDTM")) == 1)
-    {
-        printf("\nMTDM command received");
-    	toReturn = parseCommandMdtm(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "NLST", strlen("NLST")) == 1)
-    {
-       // printf("\nNLST command received");
-        toReturn = parseCommandNlst(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "QUIT", strlen("QUIT")) == 1)
-    {
-        //printf("\nQUIT command received");
-        toReturn = parseCommandQuit(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "RMD", strlen("RMD")) == 1)
-    {
-       // printf("\nRMD command received");
-        toReturn = parseCommandRmd(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "RNFR", strlen("RNFR")) == 1)
-    {
-       // printf("\nRNFR command received");
-        toReturn = parseCommandRnfr(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "RNTO", strlen("RNTO")) == 1)
-    {
-       // printf("\nRNTO command received");
-        toReturn = parseCommandRnto(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "SIZE", strlen("SIZE")) == 1)
-    {
-        //printf("\nSIZE command received");
-        toReturn = parseCommandSize(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "APPE", strlen("APPE")) == 1)
-    {
-       // printf("\nAPPE command received");
-    	toReturn = parseCommandAppe(&ftpData, processingElement);
-    }
-    else if(compareStringCaseInsensitive(ftpData.clients[processingElement].theCommandReceived, "NOOP", strlen("NOOP")) == 1)
-    {
-        //printf("\nNOOP command received");
-        toReturn = parseCommandNoop(&ftpData, processingElement);
+        toReturn = theCommand->CommandFunction(&ftpData, processingElement);
+
+        //An event driven data connection may be waiting the command
+        if ((theCommand->flags & FTP_COMMAND_FLAG_WORKER) == FTP_COMMAND_FLAG_WORKER)
+            runEventTransfer(&ftpData, processingElement);
     }
     else
     {
         ; //Parse unsupported command not needed
     }
 
-    ftpData.clients[processingElement].commandIndex = 0;
-    memset(ftpData.clients[processingElement].theCommandReceived, 0, CLIENT_COMMAND_STRING_SIZE);
     return toReturn;
 }
 
@@ -31,7 +31,9 @@
 
 
 void runFtpServer(void);
+void *reactorHandle(void * reactorIdPointer);
 void *connectionWorkerHandle(void * socketId);
+void connectionWorkerJob(int theSocketId);
 void workerCleanup(void *socketId);
 void signal_callback_handler(int signum);
 void deallocateMemory(void);
@@ -0,0 +1,776 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* accept4 is a Linux extension */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#include "ftpData.h"
+#include "ftpTransfer.h"
+#include "ftpCommandsElaborate.h"
+#include "library/connection.h"
+#include "library/fileManagement.h"
+#include "library/dynamicMemory.h"
+
+/*
+ * Event driven data connections. The reactor owning the client runs them on the events of
+ * the data socket, a state for each step a pool thread would block on. Every event moves at
+ * most EVENT_TRANSFER_BYTES_PER_EVENT bytes or EVENT_TRANSFER_LIST_ENTRIES entries, the
+ * level triggered epoll reports the socket again while the transfer has work to do.
+ */
+
+/* Register theSocket for theEvents in the reactor of the client, 0 removes it */
+static void setDataSocketEvents(ftpDataType *data, int clientId, int theSocket, uint32_t theEvents)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    int epollFd = data->connectionData[data->clients[clientId].reactorId].epollFd;
+    struct epoll_event theEvent;
+
+    if (theWorker->eventSocket != theSocket && theWorker->eventMask != 0)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, theWorker->eventSocket, NULL);
+        theWorker->eventMask = 0;
+    }
+
+    theWorker->eventSocket = theSocket;
+
+    if (theEvents == theWorker->eventMask)
+        return;
+
+    if (theEvents == 0)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, theSocket, NULL);
+        theWorker->eventMask = 0;
+        return;
+    }
+
+    memset(&theEvent, 0, sizeof(struct epoll_event));
+    theEvent.events = theEvents;
+    theEvent.data.u32 = (uint32_t) clientId | DATA_SOCKET_EVENT_FLAG;
+
+    if (epoll_ctl(epollFd, (theWorker->eventMask == 0) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, theSocket, &theEvent) == -1)
+    {
+        printf("\nepoll_ctl failed on the data socket of client %d errno = %d", clientId, errno);
+        return;
+    }
+
+    theWorker->eventMask = theEvents;
+}
+
+/* Room for theSize more bytes after the buffered data, the transfer buffer of the pool is used first.
+   Returns 0 when there is no memory for the buffer */
+static int reserveEventBuffer(ftpDataType *data, int clientId, int theSize)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    char *newBuffer;
+    int newSize;
+
+    if (theWorker->eventBufferStart > 0)
+    {
+        memmove(theWorker->eventBuffer, theWorker->eventBuffer + theWorker->eventBufferStart, theWorker->eventBufferEnd - theWorker->eventBufferStart);
+        theWorker->eventBufferEnd -= theWorker->eventBufferStart;
+        theWorker->eventBufferStart = 0;
+    }
+
+    if (theWorker->eventBuffer == NULL)
+    {
+        theWorker->eventBuffer = getTransferBuffer(data, clientId);
+
+        if (theWorker->eventBuffer == NULL)
+            return 0;
+
+        theWorker->eventBufferSize = data->transferBuffers.bufferSize;
+    }
+
+    if (theWorker->eventBufferEnd + theSize <= theWorker->eventBufferSize)
+        return 1;
+
+    //Long listings can outgrow the transfer buffer, the data moves to a private one
+    newSize = theWorker->eventBufferSize;
+    while (newSize < theWorker->eventBufferEnd + theSize)
+        newSize = newSize * 2;
+
+    if (theWorker->eventBuffer == theWorker->transferBuffer)
+    {
+        newBuffer = (char *) DYNMEM_malloc(newSize, &theWorker->memoryTable, "EventTransferBuffer");
+        memcpy(newBuffer, theWorker->eventBuffer, theWorker->eventBufferEnd);
+    }
+    else
+    {
+        newBuffer = (char *) DYNMEM_realloc(theWorker->eventBuffer, newSize, &theWorker->memoryTable);
+    }
+
+    theWorker->eventBuffer = newBuffer;
+    theWorker->eventBufferSize = newSize;
+    return 1;
+}
+
+/* Write the buffered data, returns 1 when the buffer is empty, 0 when the socket is full and -1 on errors */
+static int flushEventBuffer(workerDataType *theWorker)
+{
+    ssize_t writtenSize;
+
+    while (theWorker->eventBufferStart < theWorker->eventBufferEnd)
+    {
+        writtenSize = TRANSPORT_Write(&theWorker->transport, theWorker->eventBuffer + theWorker->eventBufferStart, theWorker->eventBufferEnd - theWorker->eventBufferStart);
+
+        if (writtenSize > 0)
+        {
+            theWorker->eventBufferStart += writtenSize;
+            continue;
+        }
+
+        if (writtenSize < 0 && errno == EINTR)
+            continue;
+
+        if (writtenSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return 0;
+
+        return -1;
+    }
+
+    theWorker->eventBufferStart = 0;
+    theWorker->eventBufferEnd = 0;
+    return 1;
+}
+
+/* Called by socketWorkerWrite, the data is sent on the next events of the data socket */
+int appendEventTransferData(ftpDataType *data, int clientId, char *theData, int theDataSize)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    if (reserveEventBuffer(data, clientId, theDataSize) == 0)
+        return -1;
+
+    memcpy(theWorker->eventBuffer + theWorker->eventBufferEnd, theData, theDataSize);
+    theWorker->eventBufferEnd += theDataSize;
+
+    return theDataSize;
+}
+
+/* Close the data connection, then send the final reply of the transfer */
+static void endEventTransfer(ftpDataType *data, int clientId, char *theReply)
+{
+    stopEventTransfer(data, clientId);
+
+    if (theReply != NULL &&
+        socketPrintf(data, clientId, "s", theReply) <= 0)
+    {
+        data->clients[clientId].closeTheClient = 1;
+    }
+}
+
+static void startRetr(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    if (socketPrintf(data, clientId, "s", "150 Accepted data connection\r\n") <= 0)
+    {
+        data->clients[clientId].closeTheClient = 1;
+        return;
+    }
+
+    if ((checkUserFilePermissions(data->clients[clientId].fileToRetr.text, data->clients[clientId].login.ownerShip.uid, data->clients[clientId].login.ownerShip.gid) & FILE_PERMISSION_R) != FILE_PERMISSION_R)
+    {
+        endEventTransfer(data, clientId, "550 no reading permission on the file\r\n");
+        return;
+    }
+
+    #ifdef LARGE_FILE_SUPPORT_ENABLED
+        theWorker->theStorFile = fopen64(data->clients[clientId].fileToRetr.text, "rb");
+    #endif
+
+    #ifndef LARGE_FILE_SUPPORT_ENABLED
+        theWorker->theStorFile = fopen(data->clients[clientId].fileToRetr.text, "rb");
+    #endif
+
+    if (theWorker->theStorFile == NULL)
+    {
+        endEventTransfer(data, clientId, "550 unable to open the file for reading\r\n");
+        return;
+    }
+
+    theWorker->eventFileSize = FILE_GetFileSize(theWorker->theStorFile);
+    theWorker->eventFileOffset = theWorker->retrRestartAtByte;
+    theWorker->retrRestartAtByte = 0;
+    theWorker->eventTransferState = EVENT_TRANSFER_STATE_RETR;
+    setDataSocketEvents(data, clientId, theWorker->socketConnection, EPOLLOUT);
+}
+
+static void sendRetrData(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    long long int toSend, sentSize, budget = EVENT_TRANSFER_BYTES_PER_EVENT;
+    ssize_t readSize;
+    int returnCode;
+
+    while (1)
+    {
+        returnCode = flushEventBuffer(theWorker);
+
+        if (returnCode < 0)
+        {
+            endEventTransfer(data, clientId, "426 Connection closed; transfer aborted\r\n");
+            return;
+        }
+
+        if (returnCode == 0 || budget <= 0)
+            return;
+
+        //The file may have been truncated while sending, what has been read is sent
+        if (theWorker->eventFileOffset >= theWorker->eventFileSize)
+            break;
+
+        toSend = theWorker->eventFileSize - theWorker->eventFileOffset;
+        if (toSend > budget)
+            toSend = budget;
+
+        if (theWorker->eventIsReadWrite == 0)
+        {
+            sentSize = TRANSPORT_SendFile(&theWorker->transport, fileno(theWorker->theStorFile), theWorker->eventFileOffset, theWorker->eventFileOffset + toSend);
+
+            if (sentSize == TRANSPORT_NOT_SUPPORTED)
+            {
+                theWorker->eventIsReadWrite = 1;
+                continue;
+            }
+
+            if (sentSize < 0)
+            {
+                if (errno == EAGAIN)
+                    return;
+
+                endEventTransfer(data, clientId, "426 Connection closed; transfer aborted\r\n");
+                return;
+            }
+
+            if (sentSize == 0)
+                break;
+
+            theWorker->eventFileOffset += sentSize;
+            budget -= sentSize;
+            continue;
+        }
+
+        if (reserveEventBuffer(data, clientId, 1) == 0)
+        {
+            endEventTransfer(data, clientId, "451 Error while reading the file\r\n");
+            return;
+        }
+
+        if (toSend > theWorker->eventBufferSize)
+            toSend = theWorker->eventBufferSize;
+
+        #ifdef LARGE_FILE_SUPPORT_ENABLED
+            readSize = pread64(fileno(theWorker->theStorFile), theWorker->eventBuffer, toSend, theWorker->eventFileOffset);
+        #endif
+
+        #ifndef LARGE_FILE_SUPPORT_ENABLED
+            readSize = pread(fileno(theWorker->theStorFile), theWorker->eventBuffer, toSend, theWorker->eventFileOffset);
+        #endif
+
+        if (readSize < 0 && errno == EINTR)
+            continue;
+
+        if (readSize < 0)
+        {
+            endEventTransfer(data, clientId, "451 Error while reading the file\r\n");
+            return;
+        }
+
+        if (readSize == 0)
+            break;
+
+        theWorker->eventBufferEnd = readSize;
+        theWorker->eventFileOffset += readSize;
+        budget -= readSize;
+    }
+
+    endEventTransfer(data, clientId, "226-File successfully transferred\r\n226 done\r\n");
+}
+
+static void startStor(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    if ((checkParentDirectoryPermissions(data->clients[clientId].fileToStor.text, data->clients[clientId].login.ownerShip.uid, data->clients[clientId].login.ownerShip.gid) & FILE_PERMISSION_W) != FILE_PERMISSION_W)
+    {
+        endEventTransfer(data, clientId, "550 No permissions to write the file\r\n");
+        return;
+    }
+
+    #ifdef LARGE_FILE_SUPPORT_ENABLED
+        theWorker->theStorFile = fopen64(data->clients[clientId].fileToStor.text, (theWorker->commandCode == FTP_COMMAND_CODE_APPE) ? "ab" : "wb");
+    #endif
+
+    #ifndef LARGE_FILE_SUPPORT_ENABLED
+        theWorker->theStorFile = fopen(data->clients[clientId].fileToStor.text, (theWorker->commandCode == FTP_COMMAND_CODE_APPE) ? "ab" : "wb");
+    #endif
+
+    if (theWorker->theStorFile == NULL)
+    {
+        endEventTransfer(data, clientId, "553 Unable to write the file\r\n");
+        return;
+    }
+
+    if (socketPrintf(data, clientId, "s", "150 Accepted data connection\r\n") <= 0)
+    {
+        data->clients[clientId].closeTheClient = 1;
+        return;
+    }
+
+    theWorker->eventTransferState = EVENT_TRANSFER_STATE_STOR;
+    setDataSocketEvents(data, clientId, theWorker->socketConnection, EPOLLIN);
+}
+
+static void receiveStorData(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    long long int receivedSize, budget = EVENT_TRANSFER_BYTES_PER_EVENT;
+    ssize_t readSize, writtenSize;
+    int isWriteError = 0, isFinished = 0, bytesWritten;
+
+    //TLS records already decrypted are not reported by the socket, they are read anyway
+    while (budget > 0 || TRANSPORT_Pending(&theWorker->transport) > 0)
+    {
+        if (theWorker->eventIsReadWrite == 0)
+        {
+            receivedSize = TRANSPORT_ReceiveFile(&theWorker->transport, fileno(theWorker->theStorFile), theWorker->storPipe);
+
+            if (receivedSize == TRANSPORT_NOT_SUPPORTED)
+            {
+                theWorker->eventIsReadWrite = 1;
+                continue;
+            }
+
+            if (receivedSize < 0 && errno == EAGAIN)
+                return;
+
+            if (receivedSize <= 0)
+            {
+                isWriteError = (receivedSize < 0) ? 1 : 0;
+                isFinished = 1;
+                break;
+            }
+
+            budget -= receivedSize;
+            continue;
+        }
+
+        if (reserveEventBuffer(data, clientId, 1) == 0)
+        {
+            isWriteError = 1;
+            isFinished = 1;
+            break;
+        }
+
+        readSize = TRANSPORT_Read(&theWorker->transport, theWorker->eventBuffer, theWorker->eventBufferSize);
+
+        if (readSize < 0 && errno == EINTR)
+            continue;
+
+        if (readSize < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+
+        //Connection errors end the transfer as the end of the stream
+        if (readSize <= 0)
+        {
+            isFinished = 1;
+            break;
+        }
+
+        for (bytesWritten = 0; bytesWritten < readSize; bytesWritten += writtenSize)
+        {
+            writtenSize = write(fileno(theWorker->theStorFile), theWorker->eventBuffer + bytesWritten, readSize - bytesWritten);
+
+            if (writtenSize < 0 && errno == EINTR)
+            {
+                writtenSize = 0;
+                continue;
+            }
+
+            if (writtenSize <= 0)
+            {
+                isWriteError = 1;
+                break;
+            }
+        }
+
+        if (isWriteError == 1)
+        {
+            isFinished = 1;
+            break;
+        }
+
+        budget -= readSize;
+    }
+
+    //The budget is over, the socket still has data for the next event
+    if (isFinished == 0)
+        return;
+
+    fclose(theWorker->theStorFile);
+    theWorker->theStorFile = NULL;
+
+    if (data->clients[clientId].login.ownerShip.ownerShipSet == 1)
+    {
+        FILE_doChownFromUidGid(data->clients[clientId].fileToStor.text, data->clients[clientId].login.ownerShip.uid, data->clients[clientId].login.ownerShip.gid);
+    }
+
+    if (isWriteError == 1)
+        endEventTransfer(data, clientId, "451 Error while writing the file\r\n");
+    else
+        endEventTransfer(data, clientId, "226 file stor ok\r\n");
+}
+
+static void startList(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    int theCommandType = COMMAND_TYPE_LIST;
+    char *thePathToList = data->clients[clientId].listPath.text;
+
+    if (theWorker->commandCode == FTP_COMMAND_CODE_NLST)
+    {
+        theCommandType = COMMAND_TYPE_NLST;
+        thePathToList = data->clients[clientId].nlistPath.text;
+    }
+
+    if ((checkUserFilePermissions(thePathToList, data->clients[clientId].login.ownerShip.uid, data->clients[clientId].login.ownerShip.gid) & FILE_PERMISSION_R) != FILE_PERMISSION_R)
+    {
+        endEventTransfer(data, clientId, "550 No permissions\r\n");
+        return;
+    }
+
+    if (socketPrintf(data, clientId, "s", "150 Accepted data connection\r\n") <= 0)
+    {
+        data->clients[clientId].closeTheClient = 1;
+        return;
+    }
+
+    //The total line is only buffered
+    openListData(data, clientId, theCommandType, &theWorker->memoryTable);
+    theWorker->eventTransferState = EVENT_TRANSFER_STATE_LIST;
+    setDataSocketEvents(data, clientId, theWorker->socketConnection, EPOLLOUT);
+}
+
+static void sendListData(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    int returnCode, batchIsWritten = 0;
+
+    while (1)
+    {
+        returnCode = flushEventBuffer(theWorker);
+
+        if (returnCode < 0)
+        {
+            endEventTransfer(data, clientId, "426 Connection closed; transfer aborted\r\n");
+            return;
+        }
+
+        if (returnCode == 0)
+            return;
+
+        //All the entries have been sent
+        if (theWorker->listIsOpen == 0)
+            break;
+
+        if (batchIsWritten == 1)
+            return;
+
+        //The entries are appended to eventBuffer by socketWorkerWrite
+        if (writeListDataEntries(data, clientId, EVENT_TRANSFER_LIST_ENTRIES, &theWorker->memoryTable) == 0)
+            closeListData(data, clientId, &theWorker->memoryTable);
+
+        batchIsWritten = 1;
+    }
+
+    stopEventTransfer(data, clientId);
+
+    if (socketPrintf(data, clientId, "sds", "226 ", theWorker->listFilesNumber, " matches total\r\n") <= 0)
+        data->clients[clientId].closeTheClient = 1;
+}
+
+/* The data connection can take the command received on the control connection */
+static void dataConnectionIsReady(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    theWorker->eventTransferState = EVENT_TRANSFER_STATE_READY;
+    setDataSocketEvents(data, clientId, theWorker->socketConnection, 0);
+
+    if (theWorker->activeModeOn == 1 &&
+        socketPrintf(data, clientId, "s", "200 connection accepted\r\n") <= 0)
+    {
+        data->clients[clientId].closeTheClient = 1;
+        return;
+    }
+
+    runEventTransfer(data, clientId);
+}
+
+static void handshakeDataConnection(ftpDataType *data, int clientId)
+{
+    #ifdef OPENSSL_ENABLED
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    SSL *theSsl = (theWorker->passiveModeOn == 1) ? theWorker->serverSsl : theWorker->clientSsl;
+    int returnCode;
+
+    ERR_clear_error();
+    returnCode = SSL_do_handshake(theSsl);
+
+    if (returnCode == 1)
+    {
+        TRANSPORT_InitTls(&theWorker->transport, theWorker->socketConnection, theSsl);
+        theWorker->transport.isEventDriven = 1;
+        dataTlsHandshakeDone(data, clientId, theSsl);
+        dataConnectionIsReady(data, clientId);
+        return;
+    }
+
+    switch (SSL_get_error(theSsl, returnCode))
+    {
+        case SSL_ERROR_WANT_READ:
+            setDataSocketEvents(data, clientId, theWorker->socketConnection, EPOLLIN);
+            return;
+
+        case SSL_ERROR_WANT_WRITE:
+            setDataSocketEvents(data, clientId, theWorker->socketConnection, EPOLLOUT);
+            return;
+
+        default:
+            printf("\nSSL ERRORS ON WORKER");
+            ERR_print_errors_fp(stderr);
+            endEventTransfer(data, clientId, "425 TLS negotiation failed on the data connection\r\n");
+            return;
+    }
+    #endif
+}
+
+static void dataConnectionIsOpen(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    theWorker->socketIsConnected = 1;
+    TRANSPORT_InitPlain(&theWorker->transport, theWorker->socketConnection);
+    theWorker->transport.isEventDriven = 1;
+
+    #ifdef OPENSSL_ENABLED
+    if (data->clients[clientId].dataChannelIsTls == 1)
+    {
+        SSL *theSsl = (theWorker->passiveModeOn == 1) ? theWorker->serverSsl : theWorker->clientSsl;
+
+        if (SSL_set_fd(theSsl, theWorker->socketConnection) == 0)
+        {
+            printf("\nSSL ERRORS ON WORKER SSL_set_fd");
+            endEventTransfer(data, clientId, "425 TLS negotiation failed on the data connection\r\n");
+            return;
+        }
+
+        if (theWorker->passiveModeOn == 1)
+            SSL_set_accept_state(theSsl);
+        else
+        {
+            SSL_set_connect_state(theSsl);
+            resumeActiveDataSession(data, clientId);
+        }
+
+        theWorker->eventTransferState = EVENT_TRANSFER_STATE_HANDSHAKING;
+        handshakeDataConnection(data, clientId);
+        return;
+    }
+    #endif
+
+    dataConnectionIsReady(data, clientId);
+}
+
+static void acceptDataConnection(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    int theSocket;
+
+    theSocket = acceptClientDataSocket(data, clientId, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (theSocket == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+            return;
+
+        endEventTransfer(data, clientId, "425 Unable to open the data connection\r\n");
+        return;
+    }
+
+    theWorker->socketConnection = theSocket;
+    setDataSocketEvents(data, clientId, theSocket, 0);
+    dataConnectionIsOpen(data, clientId);
+}
+
+static void completeDataConnection(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+    int socketError = 0;
+    socklen_t errorSize = sizeof(socketError);
+
+    if (getsockopt(theWorker->socketConnection, SOL_SOCKET, SO_ERROR, &socketError, &errorSize) == -1 ||
+        socketError != 0)
+    {
+        endEventTransfer(data, clientId, "425 Unable to open the data connection\r\n");
+        return;
+    }
+
+    dataConnectionIsOpen(data, clientId);
+}
+
+/* Called by PASV and PORT instead of queueing a worker job, returns -1 when the connection can't start */
+int startEventTransfer(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    if (theWorker->passiveModeOn == 1)
+    {
+        fcntl(theWorker->passiveListeningSocket, F_SETFL, fcntl(theWorker->passiveListeningSocket, F_GETFL) | O_NONBLOCK);
+        theWorker->eventTransferState = EVENT_TRANSFER_STATE_ACCEPTING;
+        setDataSocketEvents(data, clientId, theWorker->passiveListeningSocket, EPOLLIN);
+
+        //The reactor can't watch the listener, the caller releases it
+        if (theWorker->eventMask == 0)
+        {
+            theWorker->eventTransferState = EVENT_TRANSFER_STATE_NONE;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    theWorker->socketConnection = createActiveSocketNonBlocking(theWorker->connectionPort, theWorker->activeIpAddress);
+
+    if (theWorker->socketConnection == -1)
+        return -1;
+
+    theWorker->eventTransferState = EVENT_TRANSFER_STATE_CONNECTING;
+    setDataSocketEvents(data, clientId, theWorker->socketConnection, EPOLLOUT);
+
+    if (theWorker->eventMask == 0)
+    {
+        theWorker->eventTransferState = EVENT_TRANSFER_STATE_NONE;
+        close(theWorker->socketConnection);
+        theWorker->socketConnection = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Start the command received on the control connection once the data connection is ready */
+void runEventTransfer(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    if (theWorker->eventTransferState != EVENT_TRANSFER_STATE_READY ||
+        theWorker->commandReceived == 0)
+        return;
+
+    if ((theWorker->commandCode == FTP_COMMAND_CODE_STOR || theWorker->commandCode == FTP_COMMAND_CODE_APPE) &&
+        data->clients[clientId].fileToStor.textLen > 0)
+    {
+        startStor(data, clientId);
+    }
+    else if (theWorker->commandCode == FTP_COMMAND_CODE_LIST ||
+             theWorker->commandCode == FTP_COMMAND_CODE_NLST)
+    {
+        startList(data, clientId);
+    }
+    else if (theWorker->commandCode == FTP_COMMAND_CODE_RETR)
+    {
+        startRetr(data, clientId);
+    }
+    else
+    {
+        stopEventTransfer(data, clientId);
+    }
+}
+
+void processDataSocketEvent(ftpDataType *data, int clientId, uint32_t theEvents)
+{
+    switch (data->clients[clientId].workerData.eventTransferState)
+    {
+        case EVENT_TRANSFER_STATE_ACCEPTING:
+            acceptDataConnection(data, clientId);
+            break;
+
+        case EVENT_TRANSFER_STATE_CONNECTING:
+            completeDataConnection(data, clientId);
+            break;
+
+        case EVENT_TRANSFER_STATE_HANDSHAKING:
+            handshakeDataConnection(data, clientId);
+            break;
+
+        case EVENT_TRANSFER_STATE_RETR:
+            sendRetrData(data, clientId);
+            break;
+
+        case EVENT_TRANSFER_STATE_STOR:
+            receiveStorData(data, clientId);
+            break;
+
+        case EVENT_TRANSFER_STATE_LIST:
+            sendListData(data, clientId);
+            break;
+
+        //Events of a data connection already closed in the same epoll wait
+        default:
+            break;
+    }
+}
+
+/* Close the data connection at once, the caller is the reactor of the client */
+void stopEventTransfer(ftpDataType *data, int clientId)
+{
+    workerDataType *theWorker = &data->clients[clientId].workerData;
+
+    setDataSocketEvents(data, clientId, theWorker->eventSocket, 0);
+
+    if (theWorker->socketIsConnected == 1)
+        TRANSPORT_Shutdown(&theWorker->transport);
+
+    if (theWorker->socketConnection != -1)
+    {
+        shutdown(theWorker->socketConnection, SHUT_RDWR);
+        close(theWorker->socketConnection);
+    }
+
+    releasePassiveSocket(data, theWorker->passiveListeningSocket, theWorker->connectionPort);
+    resetWorkerData(data, clientId, 0);
+    theWorker->threadIsAlive = 0;
+}
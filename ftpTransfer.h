@@ -0,0 +1,45 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef FTPTRANSFER_H
+#define FTPTRANSFER_H
+
+#include <stdint.h>
+#include "ftpData.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int startEventTransfer(ftpDataType *data, int clientId);
+void runEventTransfer(ftpDataType *data, int clientId);
+void processDataSocketEvent(ftpDataType *data, int clientId, uint32_t theEvents);
+void stopEventTransfer(ftpDataType *data, int clientId);
+int appendEventTransferData(ftpDataType *data, int clientId, char *theData, int theDataSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FTPTRANSFER_H */
@@ -0,0 +1,159 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "bufferPool.h"
+#include "errorHandling.h"
+
+/* A few buffers are kept by each thread, most transfers get and release them without the mutex */
+static __thread struct
+{
+    BUFPOOL_PoolDataType *pool;
+    int size;
+    char *buffers[BUFPOOL_THREAD_CACHE_SIZE];
+} threadCache;
+
+/* Map a new slab and add its buffers to the free list, called with the mutex locked */
+static int BUFPOOL_AddSlab(BUFPOOL_PoolDataType *ThePool)
+{
+    char *theSlab = MAP_FAILED;
+    size_t slabSize;
+    int i, buffersInSlab;
+
+    slabSize = ((ThePool->bufferSize + BUFPOOL_SLAB_SIZE - 1) / BUFPOOL_SLAB_SIZE) * BUFPOOL_SLAB_SIZE;
+    buffersInSlab = slabSize / ThePool->bufferSize;
+
+    #ifdef MAP_HUGETLB
+    if (ThePool->useHugePages == 1)
+    {
+        theSlab = mmap(NULL, slabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        //No huge pages reserved on the system, the next slabs use normal pages
+        if (theSlab == MAP_FAILED)
+        {
+            printf("\nHuge pages not available for the transfer buffers (errno %d), using normal pages", errno);
+            ThePool->useHugePages = 0;
+        }
+    }
+    #endif
+
+    if (theSlab == MAP_FAILED)
+        theSlab = mmap(NULL, slabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (theSlab == MAP_FAILED)
+        return 0;
+
+    for (i = buffersInSlab - 1; i >= 0; i--)
+    {
+        BUFPOOL_FreeBufferDataType *theBuffer = (BUFPOOL_FreeBufferDataType *) (theSlab + (size_t) i * ThePool->bufferSize);
+        theBuffer->next = ThePool->freeList;
+        ThePool->freeList = theBuffer;
+    }
+
+    ThePool->buffersNumber += buffersInSlab;
+    ThePool->freeBuffers += buffersInSlab;
+    return buffersInSlab;
+}
+
+int BUFPOOL_Init(BUFPOOL_PoolDataType *ThePool, int bufferSize, int useHugePages)
+{
+    long pageSize = sysconf(_SC_PAGESIZE);
+
+    if (pageSize <= 0)
+        pageSize = 4096;
+
+    if (bufferSize < BUFPOOL_MIN_BUFFER_SIZE)
+        bufferSize = BUFPOOL_MIN_BUFFER_SIZE;
+
+    if (bufferSize > BUFPOOL_MAX_BUFFER_SIZE)
+        bufferSize = BUFPOOL_MAX_BUFFER_SIZE;
+
+    ThePool->bufferSize = ((bufferSize + pageSize - 1) / pageSize) * pageSize;
+    ThePool->useHugePages = useHugePages;
+    ThePool->freeList = NULL;
+    ThePool->buffersNumber = 0;
+    ThePool->freeBuffers = 0;
+
+    if (pthread_mutex_init(&ThePool->poolMutex, NULL) != 0)
+    {
+        report_error_q("Unable to init the buffer pool mutex", __FILE__, __LINE__, 0);
+    }
+
+    return ThePool->bufferSize;
+}
+
+/* Returns a buffer of bufferSize bytes, NULL when the memory is over */
+char *BUFPOOL_Get(BUFPOOL_PoolDataType *ThePool)
+{
+    BUFPOOL_FreeBufferDataType *theBuffer = NULL;
+
+    if (threadCache.pool == ThePool && threadCache.size > 0)
+    {
+        threadCache.size--;
+        return threadCache.buffers[threadCache.size];
+    }
+
+    pthread_mutex_lock(&ThePool->poolMutex);
+
+    if (ThePool->freeList != NULL || BUFPOOL_AddSlab(ThePool) > 0)
+    {
+        theBuffer = ThePool->freeList;
+        ThePool->freeList = theBuffer->next;
+        ThePool->freeBuffers--;
+    }
+
+    pthread_mutex_unlock(&ThePool->poolMutex);
+
+    return (char *) theBuffer;
+}
+
+void BUFPOOL_Release(BUFPOOL_PoolDataType *ThePool, char *theBuffer)
+{
+    BUFPOOL_FreeBufferDataType *theFreeBuffer = (BUFPOOL_FreeBufferDataType *) theBuffer;
+
+    if (theBuffer == NULL)
+        return;
+
+    if (threadCache.pool == NULL)
+        threadCache.pool = ThePool;
+
+    if (threadCache.pool == ThePool && threadCache.size < BUFPOOL_THREAD_CACHE_SIZE)
+    {
+        threadCache.buffers[threadCache.size++] = theBuffer;
+        return;
+    }
+
+    pthread_mutex_lock(&ThePool->poolMutex);
+    theFreeBuffer->next = ThePool->freeList;
+    ThePool->freeList = theFreeBuffer;
+    ThePool->freeBuffers++;
+    pthread_mutex_unlock(&ThePool->poolMutex);
+}
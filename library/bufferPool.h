@@ -0,0 +1,65 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BUFPOOL_MIN_BUFFER_SIZE                     (64 * 1024)
+#define BUFPOOL_MAX_BUFFER_SIZE                     (1024 * 1024)
+#define BUFPOOL_SLAB_SIZE                           (2 * 1024 * 1024)
+#define BUFPOOL_THREAD_CACHE_SIZE                   2
+
+/* A free buffer keeps the link to the next one in its first bytes */
+struct BUFPOOL_FreeBuffer
+{
+    struct BUFPOOL_FreeBuffer *next;
+} typedef BUFPOOL_FreeBufferDataType;
+
+struct BUFPOOL_Pool
+{
+    pthread_mutex_t poolMutex;
+    BUFPOOL_FreeBufferDataType *freeList;
+
+    /* Page aligned size of each buffer, the slabs are mapped with MAP_HUGETLB when useHugePages is set */
+    int bufferSize;
+    int useHugePages;
+    int buffersNumber;
+    int freeBuffers;
+} typedef BUFPOOL_PoolDataType;
+
+int BUFPOOL_Init(BUFPOOL_PoolDataType *ThePool, int bufferSize, int useHugePages);
+char *BUFPOOL_Get(BUFPOOL_PoolDataType *ThePool);
+void BUFPOOL_Release(BUFPOOL_PoolDataType *ThePool, char *theBuffer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUFFER_POOL_H */
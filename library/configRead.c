@@ -26,6 +26,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "configRead.h"
 #include "../ftpData.h"
@@ -38,6 +39,7 @@
 #include "fileManagement.h"
 #include "daemon.h"
 #include "dynamicMemory.h"
+#include "connection.h"
 
 #define PARAMETER_SIZE_LIMIT        1024
 
@@ -143,6 +145,7 @@ void initFtpData(ftpDataType *ftpData)
 	ftpData->clientCtx = createClientContext();
 	configureContext(ftpData->serverCtx, ftpData->ftpParameters.certificatePath, ftpData->ftpParameters.privateCertificatePath);
 	configureClientContext(ftpData->clientCtx, ftpData->ftpParameters.certificatePath, ftpData->ftpParameters.privateCertificatePath);
+	configureSessionCache(ftpData->serverCtx, ftpData->ftpParameters.tlsSessionCacheSize, ftpData->ftpParameters.tlsSessionTimeout, ftpData->ftpParameters.tlsSessionTickets);
 	#endif
 
     ftpData->connectedClients = 0;
@@ -165,6 +168,38 @@ void initFtpData(ftpDataType *ftpData)
     strcpy(ftpData->welcomeMessage, "220 Hello\r\n");
 
     DYNV_VectorGeneric_InitWithSearchFunction(&ftpData->loginFailsVector, searchInLoginFailsVector);
+    TWHEEL_Init(&ftpData->loginFailsTimers, ftpData);
+
+    if (pthread_mutex_init(&ftpData->connectionsMutex, NULL) != 0 ||
+        pthread_mutex_init(&ftpData->loginFailsMutex, NULL) != 0)
+    {
+        printf("\nftpData mutex init failed\n");
+        exit(0);
+    }
+
+    //Table of the connections per ip, at most half full
+    ftpData->ipConnectionsMask = 1;
+    while (ftpData->ipConnectionsMask < (unsigned int) ftpData->ftpParameters.maxClients * 2)
+        ftpData->ipConnectionsMask <<= 1;
+
+    ftpData->ipConnections = (ipConnectionsDataType *) DYNMEM_malloc((sizeof(ipConnectionsDataType) * ftpData->ipConnectionsMask), &ftpData->generalDynamicMemoryTable, "IpConnections");
+    memset(ftpData->ipConnections, 0, sizeof(ipConnectionsDataType) * ftpData->ipConnectionsMask);
+    ftpData->ipConnectionsMask--;
+
+    //Split the clients table between the reactors
+    ftpData->connectionData = (ConnectionData_DataType *) DYNMEM_malloc((sizeof(ConnectionData_DataType) * ftpData->ftpParameters.reactorThreads), &ftpData->generalDynamicMemoryTable, "ConnectionData");
+    for (i = 0; i < ftpData->ftpParameters.reactorThreads; i++)
+    {
+        ftpData->connectionData[i].reactorId = i;
+        ftpData->connectionData[i].theMainSocket = -1;
+        ftpData->connectionData[i].epollFd = -1;
+        TWHEEL_Init(&ftpData->connectionData[i].timers, ftpData);
+        ftpData->connectionData[i].firstClientId = i * (ftpData->ftpParameters.maxClients / ftpData->ftpParameters.reactorThreads);
+        ftpData->connectionData[i].clientsNumber = ftpData->ftpParameters.maxClients / ftpData->ftpParameters.reactorThreads;
+    }
+
+    //The last reactor gets the remainder
+    ftpData->connectionData[ftpData->ftpParameters.reactorThreads - 1].clientsNumber += ftpData->ftpParameters.maxClients % ftpData->ftpParameters.reactorThreads;
 
     //Client data reset to zero
     for (i = 0; i < ftpData->ftpParameters.maxClients; i++)
@@ -172,6 +207,28 @@ void initFtpData(ftpDataType *ftpData)
         resetWorkerData(ftpData, i, 1);
         resetClientData(ftpData, i, 1);
         ftpData->clients[i].clientProgressiveNumber = i;
+        TWHEEL_InitTimer(&ftpData->clients[i].idleTimer, i, clientIdleTimeout);
+        TWHEEL_InitTimer(&ftpData->clients[i].tlsNegotiatingTimer, i, clientTlsNegotiatingTimeout);
+        ftpData->clients[i].reactorId = i / (ftpData->ftpParameters.maxClients / ftpData->ftpParameters.reactorThreads);
+
+        if (ftpData->clients[i].reactorId >= ftpData->ftpParameters.reactorThreads)
+            ftpData->clients[i].reactorId = ftpData->ftpParameters.reactorThreads - 1;
+    }
+
+    //At start all the clients of a reactor are in its free list
+    for (i = 0; i < ftpData->ftpParameters.reactorThreads; i++)
+    {
+        int clientId, lastClientId = ftpData->connectionData[i].firstClientId + ftpData->connectionData[i].clientsNumber - 1;
+
+        ftpData->connectionData[i].firstLiveClientId = -1;
+        ftpData->connectionData[i].firstFreeClientId = (ftpData->connectionData[i].clientsNumber > 0) ? ftpData->connectionData[i].firstClientId : -1;
+
+        for (clientId = ftpData->connectionData[i].firstClientId; clientId <= lastClientId; clientId++)
+        {
+            ftpData->clients[clientId].isLive = 0;
+            ftpData->clients[clientId].previousClientId = (clientId > ftpData->connectionData[i].firstClientId) ? clientId - 1 : -1;
+            ftpData->clients[clientId].nextClientId = (clientId < lastClientId) ? clientId + 1 : -1;
+        }
     }
 
     return;
@@ -548,6 +605,52 @@ static int parseConfigurationFile(ftpParameters_DataType *ftpParameters, DYNV_Ve
         //printf("\nPRIVATE_CERTIFICATE_PATH parameter not found in the configuration file, using the default value: %s", ftpParameters->privateCertificatePath);
     }
 
+    ftpParameters->kernelTlsEnabled = 1;
+    searchIndex = searchParameter("ENABLE_KERNEL_TLS", parametersVector);
+    if (searchIndex != -1)
+    {
+        if(compareStringCaseInsensitive(((parameter_DataType *) parametersVector->Data[searchIndex])->value, "false", strlen("false")) == 1)
+            ftpParameters->kernelTlsEnabled = 0;
+    }
+
+    searchIndex = searchParameter("TLS_SESSION_CACHE_SIZE", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->tlsSessionCacheSize = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nTLS_SESSION_CACHE_SIZE: %d", ftpParameters->tlsSessionCacheSize);
+    }
+    else
+    {
+        ftpParameters->tlsSessionCacheSize = 10240;
+        //printf("\nTLS_SESSION_CACHE_SIZE parameter not found in the configuration file, using the default value: %d", ftpParameters->tlsSessionCacheSize);
+    }
+
+    if (ftpParameters->tlsSessionCacheSize < 0)
+        ftpParameters->tlsSessionCacheSize = 0;
+
+    searchIndex = searchParameter("TLS_SESSION_TIMEOUT", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->tlsSessionTimeout = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nTLS_SESSION_TIMEOUT: %d", ftpParameters->tlsSessionTimeout);
+    }
+    else
+    {
+        ftpParameters->tlsSessionTimeout = 300;
+        //printf("\nTLS_SESSION_TIMEOUT parameter not found in the configuration file, using the default value: %d", ftpParameters->tlsSessionTimeout);
+    }
+
+    if (ftpParameters->tlsSessionTimeout < 1)
+        ftpParameters->tlsSessionTimeout = 1;
+
+    ftpParameters->tlsSessionTickets = 1;
+    searchIndex = searchParameter("TLS_SESSION_TICKETS", parametersVector);
+    if (searchIndex != -1)
+    {
+        if(compareStringCaseInsensitive(((parameter_DataType *) parametersVector->Data[searchIndex])->value, "false", strlen("false")) == 1)
+            ftpParameters->tlsSessionTickets = 0;
+    }
+
 
     searchIndex = searchParameter("RANDOM_PORT_START", parametersVector);
     if (searchIndex != -1)
@@ -574,6 +677,145 @@ static int parseConfigurationFile(ftpParameters_DataType *ftpParameters, DYNV_Ve
         printf("\n RANDOM_PORT_END parameter not found in the configuration file, using the default value: %d", ftpParameters->connectionPortMax);
     }
 
+    searchIndex = searchParameter("PASSIVE_PORT_WARM_SOCKETS", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->passivePortWarmSockets = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nPASSIVE_PORT_WARM_SOCKETS: %d", ftpParameters->passivePortWarmSockets);
+    }
+    else
+    {
+        ftpParameters->passivePortWarmSockets = 4;
+        //printf("\nPASSIVE_PORT_WARM_SOCKETS parameter not found in the configuration file, using the default value: %d", ftpParameters->passivePortWarmSockets);
+    }
+
+    if (ftpParameters->passivePortWarmSockets < 0)
+        ftpParameters->passivePortWarmSockets = 0;
+
+    searchIndex = searchParameter("REACTOR_THREADS", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->reactorThreads = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nREACTOR_THREADS: %d", ftpParameters->reactorThreads);
+    }
+    else
+    {
+        ftpParameters->reactorThreads = 1;
+        //printf("\nREACTOR_THREADS parameter not found in the configuration file, using the default value: %d", ftpParameters->reactorThreads);
+    }
+
+    if (ftpParameters->reactorThreads < 1)
+        ftpParameters->reactorThreads = 1;
+
+    if (ftpParameters->reactorThreads > ftpParameters->maxClients)
+        ftpParameters->reactorThreads = ftpParameters->maxClients;
+
+    searchIndex = searchParameter("LISTEN_BACKLOG", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->listenBacklog = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nLISTEN_BACKLOG: %d", ftpParameters->listenBacklog);
+    }
+    else
+    {
+        ftpParameters->listenBacklog = ftpParameters->maxClients + 1;
+        //printf("\nLISTEN_BACKLOG parameter not found in the configuration file, using the default value: %d", ftpParameters->listenBacklog);
+    }
+
+    if (ftpParameters->listenBacklog < 1)
+        ftpParameters->listenBacklog = ftpParameters->maxClients + 1;
+
+    searchIndex = searchParameter("ACCEPT_BATCH_SIZE", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->acceptBatchSize = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nACCEPT_BATCH_SIZE: %d", ftpParameters->acceptBatchSize);
+    }
+    else
+    {
+        ftpParameters->acceptBatchSize = 64;
+        //printf("\nACCEPT_BATCH_SIZE parameter not found in the configuration file, using the default value: %d", ftpParameters->acceptBatchSize);
+    }
+
+    if (ftpParameters->acceptBatchSize < 1)
+        ftpParameters->acceptBatchSize = 1;
+
+    searchIndex = searchParameter("WORKER_THREADS", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->workerThreads = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nWORKER_THREADS: %d", ftpParameters->workerThreads);
+    }
+    else
+    {
+        ftpParameters->workerThreads = 32;
+        //printf("\nWORKER_THREADS parameter not found in the configuration file, using the default value: %d", ftpParameters->workerThreads);
+    }
+
+    if (ftpParameters->workerThreads < 1)
+        ftpParameters->workerThreads = 1;
+
+    searchIndex = searchParameter("WORKER_THREAD_STACK_SIZE", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->workerThreadStackSize = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nWORKER_THREAD_STACK_SIZE: %d", ftpParameters->workerThreadStackSize);
+    }
+    else
+    {
+        ftpParameters->workerThreadStackSize = 512;
+        //printf("\nWORKER_THREAD_STACK_SIZE parameter not found in the configuration file, using the default value: %d", ftpParameters->workerThreadStackSize);
+    }
+
+    searchIndex = searchParameter("LIST_SORT_MEMORY_LIMIT", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->listSortMemoryLimit = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nLIST_SORT_MEMORY_LIMIT: %d", ftpParameters->listSortMemoryLimit);
+    }
+    else
+    {
+        ftpParameters->listSortMemoryLimit = 16384;
+        //printf("\nLIST_SORT_MEMORY_LIMIT parameter not found in the configuration file, using the default value: %d", ftpParameters->listSortMemoryLimit);
+    }
+
+    if (ftpParameters->listSortMemoryLimit < 0)
+        ftpParameters->listSortMemoryLimit = 0;
+
+    ftpParameters->eventDrivenTransfers = 0;
+    searchIndex = searchParameter("EVENT_DRIVEN_TRANSFERS", parametersVector);
+    if (searchIndex != -1)
+    {
+        if(compareStringCaseInsensitive(((parameter_DataType *) parametersVector->Data[searchIndex])->value, "true", strlen("true")) == 1)
+            ftpParameters->eventDrivenTransfers = 1;
+    }
+
+    searchIndex = searchParameter("TRANSFER_BUFFER_SIZE", parametersVector);
+    if (searchIndex != -1)
+    {
+        ftpParameters->transferBufferSize = atoi(((parameter_DataType *) parametersVector->Data[searchIndex])->value);
+        //printf("\nTRANSFER_BUFFER_SIZE: %d", ftpParameters->transferBufferSize);
+    }
+    else
+    {
+        ftpParameters->transferBufferSize = 256;
+        //printf("\nTRANSFER_BUFFER_SIZE parameter not found in the configuration file, using the default value: %d", ftpParameters->transferBufferSize);
+    }
+
+    if (ftpParameters->transferBufferSize < 64)
+        ftpParameters->transferBufferSize = 64;
+
+    if (ftpParameters->transferBufferSize > 1024)
+        ftpParameters->transferBufferSize = 1024;
+
+    ftpParameters->transferBufferHugePages = 0;
+    searchIndex = searchParameter("TRANSFER_BUFFER_HUGE_PAGES", parametersVector);
+    if (searchIndex != -1)
+    {
+        if(compareStringCaseInsensitive(((parameter_DataType *) parametersVector->Data[searchIndex])->value, "true", strlen("true")) == 1)
+            ftpParameters->transferBufferHugePages = 1;
+    }
+
 
     /* USER SETTINGS */
     userIndex = 0;
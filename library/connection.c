@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  */
 
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <sys/types.h>
@@ -35,30 +36,254 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdarg.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <poll.h>
 
 
 #include "../ftpData.h"
+#include "../ftpTransfer.h"
 #include "connection.h"
+#include "errorHandling.h"
+
+/* Enable or disable the EPOLLOUT notification of the control socket, epoll_ctl can be called by any thread */
+static void setClientOutputEvent(ftpDataType * ftpData, int clientId, int isEnabled)
+{
+    struct epoll_event theEvent;
+
+    if (ftpData->clients[clientId].outputEventIsEnabled == isEnabled)
+        return;
+
+    memset(&theEvent, 0, sizeof(struct epoll_event));
+    theEvent.events = EPOLLIN | EPOLLRDHUP | ((isEnabled == 1) ? EPOLLOUT : 0);
+    theEvent.data.u32 = (uint32_t) clientId;
+
+    if (epoll_ctl(ftpData->connectionData[ftpData->clients[clientId].reactorId].epollFd, EPOLL_CTL_MOD, ftpData->clients[clientId].socketDescriptor, &theEvent) == 0)
+        ftpData->clients[clientId].outputEventIsEnabled = isEnabled;
+}
+
+/* Write the queued replies until the socket is full, writeMutex must be held. Returns -1 on errors */
+static int writeClientOutput(ftpDataType * ftpData, int clientId)
+{
+    clientDataType *theClient = &ftpData->clients[clientId];
+
+    while (theClient->outputBytes > 0)
+    {
+        clientOutputBlockDataType *theBlock;
+        int bytesWritten = 0;
+
+        struct iovec theVectors[CLIENT_OUTPUT_IOVEC_SIZE];
+        int vectorsNumber = 0;
+
+        //All the replies queued so far go out with one call
+        for (theBlock = theClient->outputHead; theBlock != NULL && vectorsNumber < CLIENT_OUTPUT_IOVEC_SIZE; theBlock = theBlock->nextBlock)
+        {
+            theVectors[vectorsNumber].iov_base = theBlock->data + theBlock->startIndex;
+            theVectors[vectorsNumber].iov_len = theBlock->endIndex - theBlock->startIndex;
+            vectorsNumber++;
+        }
+
+        bytesWritten = TRANSPORT_Writev(&theClient->transport, theVectors, vectorsNumber);
+
+        if (bytesWritten < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return 0;
+
+            return -1;
+        }
+
+        //Release the written blocks, the last one is kept for the next replies
+        theClient->outputBytes -= bytesWritten;
+        while (bytesWritten > 0)
+        {
+            theBlock = theClient->outputHead;
+
+            if (bytesWritten < theBlock->endIndex - theBlock->startIndex)
+            {
+                theBlock->startIndex += bytesWritten;
+                break;
+            }
+
+            bytesWritten -= theBlock->endIndex - theBlock->startIndex;
+            theBlock->startIndex = 0;
+            theBlock->endIndex = 0;
+
+            if (theBlock->nextBlock != NULL)
+            {
+                theClient->outputHead = theBlock->nextBlock;
+                DYNMEM_free(theBlock, &theClient->outputMemoryTable);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* Called by the reactor before serving the client, the replies queued until flushClientOutput are written together */
+void holdClientOutput(ftpDataType * ftpData, int clientId)
+{
+    pthread_mutex_lock(&ftpData->clients[clientId].writeMutex);
+    ftpData->clients[clientId].outputIsHeld = 1;
+    pthread_mutex_unlock(&ftpData->clients[clientId].writeMutex);
+}
+
+/* Called by the reactor, writes what the socket accepts and waits EPOLLOUT for the rest. Returns -1 on errors */
+int flushClientOutput(ftpDataType * ftpData, int clientId)
+{
+    int returnCode;
+
+    pthread_mutex_lock(&ftpData->clients[clientId].writeMutex);
+    ftpData->clients[clientId].outputIsHeld = 0;
+    returnCode = writeClientOutput(ftpData, clientId);
+
+    if (returnCode == 0)
+        setClientOutputEvent(ftpData, clientId, (ftpData->clients[clientId].outputBytes > 0) ? 1 : 0);
+
+    pthread_mutex_unlock(&ftpData->clients[clientId].writeMutex);
+    return returnCode;
+}
+
+/* Best effort write of the last replies before the socket is closed */
+void dropClientOutput(ftpDataType * ftpData, int clientId)
+{
+    clientOutputBlockDataType *theBlock;
+
+    pthread_mutex_lock(&ftpData->clients[clientId].writeMutex);
+    if (ftpData->clients[clientId].socketDescriptor >= 0)
+        writeClientOutput(ftpData, clientId);
+
+    while ((theBlock = ftpData->clients[clientId].outputHead) != NULL)
+    {
+        ftpData->clients[clientId].outputHead = theBlock->nextBlock;
+        DYNMEM_free(theBlock, &ftpData->clients[clientId].outputMemoryTable);
+    }
+
+    ftpData->clients[clientId].outputTail = NULL;
+    ftpData->clients[clientId].outputBytes = 0;
+    ftpData->clients[clientId].outputIsHeld = 0;
+    ftpData->clients[clientId].outputEventIsEnabled = 0;
+    pthread_mutex_unlock(&ftpData->clients[clientId].writeMutex);
+}
+
+/* Called by the reactor when the client must be closed while the worker is still releasing the data connection.
+   Returns 1 if the events of the client are paused until releaseClientWorker, 0 if the worker is already gone */
+static int pauseClientEvents(ftpDataType * ftpData, int clientId)
+{
+    int isPaused = 0;
+
+    pthread_mutex_lock(&ftpData->clients[clientId].writeMutex);
+    if (ftpData->clients[clientId].workerData.threadIsAlive == 1 &&
+        (ftpData->clients[clientId].eventsArePaused == 1 ||
+         epoll_ctl(ftpData->connectionData[ftpData->clients[clientId].reactorId].epollFd, EPOLL_CTL_DEL, ftpData->clients[clientId].socketDescriptor, NULL) == 0))
+    {
+        ftpData->clients[clientId].eventsArePaused = 1;
+        ftpData->clients[clientId].outputEventIsEnabled = 0;
+        isPaused = 1;
+    }
+    pthread_mutex_unlock(&ftpData->clients[clientId].writeMutex);
+
+    return isPaused;
+}
+
+/* Last action of the worker pool job, the reactor is woken up by EPOLLOUT and may reuse the worker data once it returns */
+void releaseClientWorker(ftpDataType * ftpData, int clientId)
+{
+    struct epoll_event theEvent;
+
+    //A late cancelWorker must not leave the abort to the next job
+    pthread_mutex_lock(&ftpData->clients[clientId].conditionMutex);
+    pthread_mutex_lock(&ftpData->clients[clientId].writeMutex);
+    ftpData->clients[clientId].workerData.abortTransfer = 0;
+    ftpData->clients[clientId].workerData.threadIsAlive = 0;
+    pthread_mutex_unlock(&ftpData->clients[clientId].conditionMutex);
+
+    if (ftpData->clients[clientId].eventsArePaused == 1)
+    {
+        memset(&theEvent, 0, sizeof(struct epoll_event));
+        theEvent.events = EPOLLIN | EPOLLRDHUP | EPOLLOUT;
+        theEvent.data.u32 = (uint32_t) clientId;
+
+        if (epoll_ctl(ftpData->connectionData[ftpData->clients[clientId].reactorId].epollFd, EPOLL_CTL_ADD, ftpData->clients[clientId].socketDescriptor, &theEvent) == 0)
+        {
+            ftpData->clients[clientId].eventsArePaused = 0;
+            ftpData->clients[clientId].outputEventIsEnabled = 1;
+        }
+    }
+    else
+    {
+        setClientOutputEvent(ftpData, clientId, 1);
+    }
+    pthread_mutex_unlock(&ftpData->clients[clientId].writeMutex);
+}
+
+/* Queue a reply on the control connection, safe from the reactor and the workers */
+static int queueClientOutput(ftpDataType * ftpData, int clientId, char *theData, int theDataSize)
+{
+    clientDataType *theClient = &ftpData->clients[clientId];
+    int queuedBytes = 0;
+
+    pthread_mutex_lock(&theClient->writeMutex);
+
+    //A client not reading its replies is closed instead of growing the queue
+    if (theClient->outputBytes + theDataSize > CLIENT_OUTPUT_QUEUE_LIMIT)
+    {
+        pthread_mutex_unlock(&theClient->writeMutex);
+        printf("\n Client %d output queue is full", clientId);
+        return -1;
+    }
+
+    while (queuedBytes < theDataSize)
+    {
+        int toCopy;
+
+        if (theClient->outputTail == NULL ||
+            theClient->outputTail->endIndex == CLIENT_OUTPUT_BLOCK_SIZE)
+        {
+            clientOutputBlockDataType *theBlock = (clientOutputBlockDataType *) DYNMEM_malloc(sizeof(clientOutputBlockDataType), &theClient->outputMemoryTable, "ClientOutput");
+            theBlock->nextBlock = NULL;
+            theBlock->startIndex = 0;
+            theBlock->endIndex = 0;
+
+            if (theClient->outputTail == NULL)
+                theClient->outputHead = theBlock;
+            else
+                theClient->outputTail->nextBlock = theBlock;
+
+            theClient->outputTail = theBlock;
+        }
+
+        toCopy = CLIENT_OUTPUT_BLOCK_SIZE - theClient->outputTail->endIndex;
+        if (toCopy > theDataSize - queuedBytes)
+            toCopy = theDataSize - queuedBytes;
+
+        memcpy(theClient->outputTail->data + theClient->outputTail->endIndex, theData + queuedBytes, toCopy);
+        theClient->outputTail->endIndex += toCopy;
+        queuedBytes += toCopy;
+    }
+
+    theClient->outputBytes += theDataSize;
+
+    //The reactor flushes the held clients itself, otherwise it is woken up by EPOLLOUT
+    if (theClient->outputIsHeld == 0)
+        setClientOutputEvent(ftpData, clientId, 1);
+
+    pthread_mutex_unlock(&theClient->writeMutex);
+    return theDataSize;
+}
 
 int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __fmt, ...)
 {
 	#define COMMAND_BUFFER								9600
-	#define SOCKET_PRINTF_BUFFER						2048
-	int bytesWritten = 0;
-	char theBuffer[SOCKET_PRINTF_BUFFER];
 	char commandBuffer[COMMAND_BUFFER];
 	int theStringSize = 0, theCommandSize = 0;
-	memset(&theBuffer, 0, SOCKET_PRINTF_BUFFER);
-	memset(&commandBuffer, 0, COMMAND_BUFFER);
 	//printf("\nWriting to socket id %d, TLS %d: ", clientId, ftpData->clients[clientId].tlsIsEnabled);
 
-	//pthread_mutex_lock(&ftpData->clients[clientId].writeMutex);
-
 	va_list args;
 	va_start(args, __fmt);
 	while (*__fmt != '\0')
 	{
-		int i = 0;
 		theStringSize = 0;
 		switch(*__fmt)
 		{
@@ -66,8 +291,7 @@ int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __f
 			case 'D':
 			{
 				int theInteger = va_arg(args, int);
-				memset(&theBuffer, 0, SOCKET_PRINTF_BUFFER);
-				theStringSize = snprintf(theBuffer, SOCKET_PRINTF_BUFFER, "%d", theInteger);
+				theStringSize = snprintf(commandBuffer + theCommandSize, COMMAND_BUFFER - theCommandSize, "%d", theInteger);
 			}
 			break;
 
@@ -75,8 +299,7 @@ int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __f
 			case 'C':
 			{
 				int theCharInteger = va_arg(args, int);
-				memset(&theBuffer, 0, SOCKET_PRINTF_BUFFER);
-				theStringSize = snprintf(theBuffer, SOCKET_PRINTF_BUFFER, "%c", theCharInteger);
+				theStringSize = snprintf(commandBuffer + theCommandSize, COMMAND_BUFFER - theCommandSize, "%c", theCharInteger);
 			}
 			break;
 
@@ -84,8 +307,7 @@ int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __f
 			case 'F':
 			{
 				float theDouble = va_arg(args, double);
-				memset(&theBuffer, 0, SOCKET_PRINTF_BUFFER);
-				theStringSize = snprintf(theBuffer, SOCKET_PRINTF_BUFFER, "%f", theDouble);
+				theStringSize = snprintf(commandBuffer + theCommandSize, COMMAND_BUFFER - theCommandSize, "%f", theDouble);
 			}
 			break;
 
@@ -93,8 +315,7 @@ int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __f
 			case 'S':
 			{
 				char * theString = va_arg(args, char *);
-				memset(&theBuffer, 0, SOCKET_PRINTF_BUFFER);
-				theStringSize = snprintf(theBuffer, SOCKET_PRINTF_BUFFER, "%s", theString);
+				theStringSize = snprintf(commandBuffer + theCommandSize, COMMAND_BUFFER - theCommandSize, "%s", theString);
 			}
 			break;
 
@@ -102,8 +323,7 @@ int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __f
 			case 'L':
 			{
 				long long int theLongLongInt = va_arg(args, long long int);
-				memset(&theBuffer, 0, SOCKET_PRINTF_BUFFER);
-				theStringSize = snprintf(theBuffer, SOCKET_PRINTF_BUFFER, "%lld",  theLongLongInt);
+				theStringSize = snprintf(commandBuffer + theCommandSize, COMMAND_BUFFER - theCommandSize, "%lld",  theLongLongInt);
 			}
 			break;
 
@@ -114,12 +334,12 @@ int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __f
 			break;
 		}
 
-		for (i = 0; i <theStringSize; i++)
+		//snprintf returns the size before the truncation, stop at the end of the buffer
+		if (theStringSize > 0)
 		{
-			if (theCommandSize < COMMAND_BUFFER)
-			{
-				commandBuffer[theCommandSize++] = theBuffer[i];
-			}
+			theCommandSize += theStringSize;
+			if (theCommandSize > COMMAND_BUFFER - 1)
+				theCommandSize = COMMAND_BUFFER - 1;
 		}
 
 		++__fmt;
@@ -133,24 +353,7 @@ int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __f
 		return -1;
 	}
 
-	if (ftpData->clients[clientId].tlsIsEnabled != 1)
-	{
-		//printf("\nwriting[%d] %s",theCommandSize, commandBuffer);
-		//fflush(0);
-		bytesWritten = write(ftpData->clients[clientId].socketDescriptor, commandBuffer, theCommandSize);
-	}
-	else if (ftpData->clients[clientId].tlsIsEnabled == 1)
-	{
-		#ifdef OPENSSL_ENABLED
-		bytesWritten = SSL_write(ftpData->clients[clientId].ssl, commandBuffer, theCommandSize);
-		#endif
-	}
-
-	//printf("\n%s", commandBuffer);
-
-	//pthread_mutex_unlock(&ftpData->clients[clientId].writeMutex);
-
-	return bytesWritten;
+	return queueClientOutput(ftpData, clientId, commandBuffer, theCommandSize);
 }
 
 int socketWorkerPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __fmt, ...)
@@ -235,24 +438,7 @@ int socketWorkerPrintf(ftpDataType * ftpData, int clientId, const char *__restri
 			if (theStringToWriteSize >= COMMAND_BUFFER)
 			{
 
-				int theReturnCode = 0;
-				if (ftpData->clients[clientId].dataChannelIsTls != 1)
-				{
-					theReturnCode = write(ftpData->clients[clientId].workerData.socketConnection, writeBuffer, theStringToWriteSize);
-				}
-				else if (ftpData->clients[clientId].dataChannelIsTls == 1)
-				{
-					#ifdef OPENSSL_ENABLED
-					if (ftpData->clients[clientId].workerData.passiveModeOn == 1){
-						theReturnCode = SSL_write(ftpData->clients[clientId].workerData.serverSsl, writeBuffer, theStringToWriteSize);
-						//printf("%s", writeBuffer);
-					}
-					else if (ftpData->clients[clientId].workerData.activeModeOn == 1){
-						theReturnCode = SSL_write(ftpData->clients[clientId].workerData.clientSsl, writeBuffer, theStringToWriteSize);
-						//printf("%s", writeBuffer);
-					}
-					#endif
-				}
+				int theReturnCode = socketWorkerWrite(ftpData, clientId, writeBuffer, theStringToWriteSize);
 
 				if (theReturnCode > 0)
 				{
@@ -284,25 +470,7 @@ int socketWorkerPrintf(ftpDataType * ftpData, int clientId, const char *__restri
 	if (theStringToWriteSize > 0)
 	{
 		//printf("\nwriting data size %d", theStringToWriteSize);
-		int theReturnCode = 0;
-
-		if (ftpData->clients[clientId].dataChannelIsTls != 1)
-		{
-			theReturnCode = write(ftpData->clients[clientId].workerData.socketConnection, writeBuffer, theStringToWriteSize);
-		}
-		else if (ftpData->clients[clientId].dataChannelIsTls == 1)
-		{
-			#ifdef OPENSSL_ENABLED
-			if (ftpData->clients[clientId].workerData.passiveModeOn == 1){
-				theReturnCode = SSL_write(ftpData->clients[clientId].workerData.serverSsl, writeBuffer, theStringToWriteSize);
-				//printf("%s", writeBuffer);
-			}
-			else if (ftpData->clients[clientId].workerData.activeModeOn == 1){
-				theReturnCode = SSL_write(ftpData->clients[clientId].workerData.clientSsl, writeBuffer, theStringToWriteSize);
-				//printf("%s", writeBuffer);
-			}
-			#endif
-		}
+		int theReturnCode = socketWorkerWrite(ftpData, clientId, writeBuffer, theStringToWriteSize);
 
 		if (theReturnCode > 0)
 		{
@@ -323,21 +491,20 @@ int socketWorkerPrintf(ftpDataType * ftpData, int clientId, const char *__restri
 	return bytesWritten;
 }
 
-/* Return the higher socket available*/
-int getMaximumSocketFd(int mainSocket, ftpDataType * ftpData)
+/* Write a whole buffer on the data connection, returns the bytes written or -1 */
+int socketWorkerWrite(ftpDataType * ftpData, int clientId, char *theData, int theDataSize)
 {
-    int toReturn = mainSocket;
-    int i = 0;
+	//The reactor sends it on the data socket events
+	if (ftpData->clients[clientId].workerData.eventTransferState != EVENT_TRANSFER_STATE_NONE)
+		return appendEventTransferData(ftpData, clientId, theData, theDataSize);
 
-    for (i = 0; i < ftpData->ftpParameters.maxClients; i++)
-    {
-        if (ftpData->clients[i].socketDescriptor > toReturn) {
-            toReturn = ftpData->clients[i].socketDescriptor;
-        }
-    }
-    //Must be incremented by one
-    toReturn++;
-    return toReturn;
+	if (TRANSPORT_WriteAll(&ftpData->clients[clientId].workerData.transport, theData, theDataSize) < 0)
+	{
+		printf("\nWrite error");
+		return -1;
+	}
+
+	return theDataSize;
 }
 
 int createSocket(ftpDataType * ftpData)
@@ -381,8 +548,8 @@ int createSocket(ftpDataType * ftpData)
 	  return -1;
   }
 
-  //Number of client allowed
-  errorCode = listen(sock, ftpData->ftpParameters.maxClients + 1);
+  //Pending connections allowed
+  errorCode = listen(sock, ftpData->ftpParameters.listenBacklog);
   if (errorCode == -1)
   {
 	  if (sock != -1)
@@ -418,10 +585,7 @@ int createPassiveSocket(int port)
         perror("setsockopt(SO_REUSEADDR) failed");
 #endif
 
-#ifdef SO_REUSEPORT
-   if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&reuse, sizeof(reuse)) < 0) 
-       perror("setsockopt(SO_REUSEPORT) failed");
-#endif
+  //No SO_REUSEPORT, the bind must fail when another process listens on the port
 
   //Bind socket
   returnCode = bind(sock,(struct sockaddr*) &temp,sizeof(temp));
@@ -437,23 +601,13 @@ int createPassiveSocket(int port)
 	return returnCode;
   }
 
-  //Number of client allowed
-  returnCode = listen(sock, 1);
-
-  if (returnCode == -1)
-  {
-	  printf("\n Could not listen %d errno = %d", sock, errno);
-	  if (sock != -1)
-	  {
-		  close(sock);
-	  }
-      return returnCode;
-  }
-
+  //Only bound, the port pool starts listening when a PASV takes the socket
   return sock;
 }
 
-int createActiveSocket(int port, char *ipAddress)
+/* The socket is published in theSocket before connecting, so cancelWorker can interrupt the connect.
+   The owner of theSocket closes it also when the connection fails */
+int createActiveSocket(int port, char *ipAddress, int *theSocket)
 {
   int sockfd;
   struct sockaddr_in serv_addr;
@@ -477,6 +631,8 @@ int createActiveSocket(int port, char *ipAddress)
   {
       printf("\ncreateActiveSocket created socket = %d \n", sockfd);
   }
+
+  *theSocket = sockfd;
   
   
   int reuse = 1;
@@ -494,12 +650,6 @@ int createActiveSocket(int port, char *ipAddress)
   if(connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0)
   {
      printf("\n3 Error : Connect Failed \n");
-
-   	  if (sockfd != -1)
-   	  {
-   		close(sockfd);
-   	  }
-
      return -1;
   }
 
@@ -508,81 +658,256 @@ int createActiveSocket(int port, char *ipAddress)
   return sockfd;
 }
 
-void fdInit(ftpDataType * ftpData)
+/* Start a non blocking connection, EPOLLOUT tells when it has completed. Returns the socket or -1 */
+int createActiveSocketNonBlocking(int port, char *ipAddress)
 {
-    FD_ZERO(&ftpData->connectionData.rset);
-    FD_ZERO(&ftpData->connectionData.wset);
-    FD_ZERO(&ftpData->connectionData.eset);
-    FD_ZERO(&ftpData->connectionData.rsetAll);
-    FD_ZERO(&ftpData->connectionData.wsetAll);
-    FD_ZERO(&ftpData->connectionData.esetAll);    
+  int sockfd;
+  struct sockaddr_in serv_addr;
 
-    FD_SET(ftpData->connectionData.theMainSocket, &ftpData->connectionData.rsetAll);    
-    FD_SET(ftpData->connectionData.theMainSocket, &ftpData->connectionData.wsetAll);
-    FD_SET(ftpData->connectionData.theMainSocket, &ftpData->connectionData.esetAll);
+  memset(&serv_addr, 0, sizeof(struct sockaddr_in));
+  serv_addr.sin_family = AF_INET;
+  serv_addr.sin_port = htons(port);
+  if(inet_pton(AF_INET, ipAddress, &serv_addr.sin_addr)<=0)
+  {
+      printf("\n inet_pton error occured\n");
+      return -1;
+  }
+
+  if((sockfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0)
+  {
+      printf("\n2 Error : Could not create socket \n");
+      return -1;
+  }
+
+  if(connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0 && errno != EINPROGRESS)
+  {
+     printf("\n3 Error : Connect Failed \n");
+     close(sockfd);
+     return -1;
+  }
+
+  return sockfd;
+}
+
+/* Accept the passive data connection of the client, connections from other addresses are dropped.
+   Returns the socket, or -1 with errno set (EAGAIN on a non blocking listener with nothing left) */
+int acceptClientDataSocket(ftpDataType * ftpData, int clientId, int flags)
+{
+  int theSocket;
+  struct sockaddr_in peerAddress;
+  socklen_t peerAddressSize;
+
+  while (1)
+  {
+    peerAddressSize = sizeof(peerAddress);
+    theSocket = accept4(ftpData->clients[clientId].workerData.passiveListeningSocket, (struct sockaddr *) &peerAddress, &peerAddressSize, flags);
+
+    if (theSocket == -1)
+      return -1;
+
+    if (peerAddress.sin_family == AF_INET &&
+        peerAddress.sin_addr.s_addr == ftpData->clients[clientId].client_sockaddr_in.sin_addr.s_addr)
+      return theSocket;
+
+    printf("\nData connection of client %d refused from %s", clientId, inet_ntoa(peerAddress.sin_addr));
+    close(theSocket);
+  }
+}
+
+/* Accept the passive data connection within timeoutSeconds, a shut down listener stops the wait.
+   Returns the blocking socket, or -1 with errno set (ETIMEDOUT if the client didn't connect) */
+int waitClientDataSocket(ftpDataType * ftpData, int clientId, int timeoutSeconds)
+{
+  int theSocket, returnCode = 0;
+  struct pollfd thePoll;
+  unsigned long long int currentTime, deadline = TWHEEL_GetCoarseTime() + timeoutSeconds;
+
+  //Dropped peers must not block the accept, the socket returned by accept4 stays blocking
+  thePoll.fd = ftpData->clients[clientId].workerData.passiveListeningSocket;
+  thePoll.events = POLLIN;
+  fcntl(thePoll.fd, F_SETFL, fcntl(thePoll.fd, F_GETFL) | O_NONBLOCK);
+
+  while ((currentTime = TWHEEL_GetCoarseTime()) < deadline)
+  {
+    returnCode = poll(&thePoll, 1, (int) (deadline - currentTime) * 1000);
+
+    if (returnCode == -1 && errno == EINTR)
+      continue;
+
+    if (returnCode <= 0)
+      break;
+
+    theSocket = acceptClientDataSocket(ftpData, clientId, SOCK_CLOEXEC);
+
+    if (theSocket != -1 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED))
+      return theSocket;
+  }
+
+  if (returnCode == 0 || currentTime >= deadline)
+    errno = ETIMEDOUT;
+
+  return -1;
+}
+
+void fdInit(ftpDataType * ftpData, int reactorId)
+{
+    struct epoll_event theEvent;
+    ConnectionData_DataType *reactor = &ftpData->connectionData[reactorId];
+
+    reactor->readyEventsNumber = 0;
+    reactor->epollFd = epoll_create1(EPOLL_CLOEXEC);
+
+    if (reactor->epollFd == -1)
+    {
+        report_error_q("Unable to create the epoll instance", __FILE__, __LINE__, 0);
+    }
+
+    memset(&theEvent, 0, sizeof(struct epoll_event));
+    theEvent.events = EPOLLIN;
+    theEvent.data.u32 = (uint32_t) MAIN_SOCKET_EVENT_ID;
+
+    if (epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, reactor->theMainSocket, &theEvent) == -1)
+    {
+        report_error_q("Unable to add the main socket to the epoll set", __FILE__, __LINE__, 0);
+    }
 }
 
 void fdAdd(ftpDataType * ftpData, int index)
 {
-    FD_SET(ftpData->clients[index].socketDescriptor, &ftpData->connectionData.rsetAll);    
-    FD_SET(ftpData->clients[index].socketDescriptor, &ftpData->connectionData.wsetAll);
-    FD_SET(ftpData->clients[index].socketDescriptor, &ftpData->connectionData.esetAll);
-    ftpData->connectionData.maxSocketFD = getMaximumSocketFd(ftpData->connectionData.theMainSocket, ftpData) + 1;
+    struct epoll_event theEvent;
+
+    memset(&theEvent, 0, sizeof(struct epoll_event));
+    theEvent.events = EPOLLIN | EPOLLRDHUP;
+    theEvent.data.u32 = (uint32_t) index;
+
+    if (epoll_ctl(ftpData->connectionData[ftpData->clients[index].reactorId].epollFd, EPOLL_CTL_ADD, ftpData->clients[index].socketDescriptor, &theEvent) == -1)
+    {
+        printf("\nepoll_ctl add failed on client %d errno = %d", index, errno);
+        ftpData->clients[index].closeTheClient = 1;
+    }
 }
 
 void fdRemove(ftpDataType * ftpData, int index)
 {
-    FD_CLR(ftpData->clients[index].socketDescriptor, &ftpData->connectionData.rsetAll);    
-    FD_CLR(ftpData->clients[index].socketDescriptor, &ftpData->connectionData.wsetAll);
-    FD_CLR(ftpData->clients[index].socketDescriptor, &ftpData->connectionData.esetAll);
+    if (ftpData->clients[index].socketDescriptor < 0)
+        return;
+
+    epoll_ctl(ftpData->connectionData[ftpData->clients[index].reactorId].epollFd, EPOLL_CTL_DEL, ftpData->clients[index].socketDescriptor, NULL);
 }
 
-void closeSocket(ftpDataType * ftpData, int processingSocket)
+/* Move a client between the free and the live list of its reactor, only the reactor thread calls it */
+static void moveClientToList(ftpDataType * ftpData, int clientId, int isLive)
 {
-	int theReturnCode = 0;
+    ConnectionData_DataType *reactor = &ftpData->connectionData[ftpData->clients[clientId].reactorId];
+    clientDataType *theClient = &ftpData->clients[clientId];
+    int *fromHead = (theClient->isLive == 1) ? &reactor->firstLiveClientId : &reactor->firstFreeClientId;
+    int *toHead = (isLive == 1) ? &reactor->firstLiveClientId : &reactor->firstFreeClientId;
 
-#ifdef OPENSSL_ENABLED
+    if (theClient->isLive == isLive)
+        return;
 
-	if (ftpData->clients[processingSocket].dataChannelIsTls == 1)
-	{
-		if(ftpData->clients[processingSocket].workerData.passiveModeOn == 1)
-		{
-			printf("\nSSL worker Shutdown 1");
-			theReturnCode = SSL_shutdown(ftpData->clients[processingSocket].ssl);
-			printf("\nnSSL worker Shutdown 1 return code : %d", theReturnCode);
+    if (theClient->previousClientId != -1)
+        ftpData->clients[theClient->previousClientId].nextClientId = theClient->nextClientId;
+    else
+        *fromHead = theClient->nextClientId;
 
-			if (theReturnCode < 0)
-			{
-				printf("SSL_shutdown failed return code %d", theReturnCode);
-			}
-			else if (theReturnCode == 0)
-			{
-				printf("\nSSL worker Shutdown 2");
-				theReturnCode = SSL_shutdown(ftpData->clients[processingSocket].ssl);
-				printf("\nnSSL worker Shutdown 2 return code : %d", theReturnCode);
+    if (theClient->nextClientId != -1)
+        ftpData->clients[theClient->nextClientId].previousClientId = theClient->previousClientId;
 
-				if (theReturnCode <= 0)
-				{
-					printf("SSL_shutdown (2nd time) failed");
-				}
-			}
-		}
-	}
-#endif
+    theClient->previousClientId = -1;
+    theClient->nextClientId = *toHead;
+    if (*toHead != -1)
+        ftpData->clients[*toHead].previousClientId = clientId;
+
+    *toHead = clientId;
+    theClient->isLive = isLive;
+}
+
+static unsigned int getIpConnectionsIndex(ftpDataType * ftpData, in_addr_t ipAddress)
+{
+    unsigned int theHash = (unsigned int) ipAddress * 2654435761U;
+    return (theHash ^ (theHash >> 16)) & ftpData->ipConnectionsMask;
+}
+
+/* Count a new connection from ipAddress, returns 0 if the ip already reached the maximum (0 for no limit), connectionsMutex must be held */
+static int addIpConnection(ftpDataType * ftpData, in_addr_t ipAddress, int maximumConnections)
+{
+    unsigned int index = getIpConnectionsIndex(ftpData, ipAddress);
+
+    while (ftpData->ipConnections[index].connectionsNumber > 0 &&
+           ftpData->ipConnections[index].ipAddress != ipAddress)
+        index = (index + 1) & ftpData->ipConnectionsMask;
+
+    if (maximumConnections > 0 &&
+        ftpData->ipConnections[index].connectionsNumber >= maximumConnections)
+        return 0;
+
+    ftpData->ipConnections[index].ipAddress = ipAddress;
+    ftpData->ipConnections[index].connectionsNumber++;
+    return 1;
+}
+
+/* Uncount a connection from ipAddress, connectionsMutex must be held */
+static void removeIpConnection(ftpDataType * ftpData, in_addr_t ipAddress)
+{
+    unsigned int index = getIpConnectionsIndex(ftpData, ipAddress), nextIndex;
+
+    while (ftpData->ipConnections[index].connectionsNumber > 0 &&
+           ftpData->ipConnections[index].ipAddress != ipAddress)
+        index = (index + 1) & ftpData->ipConnectionsMask;
+
+    if (ftpData->ipConnections[index].connectionsNumber == 0 ||
+        --ftpData->ipConnections[index].connectionsNumber > 0)
+        return;
+
+    //Last connection gone, shift back the following entries of the probe sequence
+    nextIndex = (index + 1) & ftpData->ipConnectionsMask;
+    while (ftpData->ipConnections[nextIndex].connectionsNumber > 0)
+    {
+        unsigned int homeIndex = getIpConnectionsIndex(ftpData, ftpData->ipConnections[nextIndex].ipAddress);
+
+        if (((nextIndex - homeIndex) & ftpData->ipConnectionsMask) >= ((nextIndex - index) & ftpData->ipConnectionsMask))
+        {
+            ftpData->ipConnections[index] = ftpData->ipConnections[nextIndex];
+            ftpData->ipConnections[nextIndex].connectionsNumber = 0;
+            index = nextIndex;
+        }
+
+        nextIndex = (nextIndex + 1) & ftpData->ipConnectionsMask;
+    }
+}
+
+void closeSocket(ftpDataType * ftpData, int processingSocket)
+{
+	int theReturnCode = 0;
+
+    TWHEEL_Stop(&ftpData->connectionData[ftpData->clients[processingSocket].reactorId].timers, &ftpData->clients[processingSocket].idleTimer);
+    TWHEEL_Stop(&ftpData->connectionData[ftpData->clients[processingSocket].reactorId].timers, &ftpData->clients[processingSocket].tlsNegotiatingTimer);
 
-    //Close the socket
-    shutdown(ftpData->clients[processingSocket].socketDescriptor, SHUT_RDWR);
+    dropClientOutput(ftpData, processingSocket);
+
+    //Close the socket, a TLS session sends its close notify first
+    TRANSPORT_Shutdown(&ftpData->clients[processingSocket].transport);
     theReturnCode = close(ftpData->clients[processingSocket].socketDescriptor);
 
-    resetClientData(ftpData, processingSocket, 0);
-    //resetWorkerData(ftpData, processingSocket, 0);
-    
-    //Update client connecteds
-    ftpData->connectedClients--;
+    //Update client connecteds, the ip table is shared by all the reactors
+    pthread_mutex_lock(&ftpData->connectionsMutex);
+    if (ftpData->clients[processingSocket].ipConnectionIsCounted == 1)
+    {
+        removeIpConnection(ftpData, ftpData->clients[processingSocket].client_sockaddr_in.sin_addr.s_addr);
+        ftpData->clients[processingSocket].ipConnectionIsCounted = 0;
+        ftpData->connectedClients--;
+    }
+
     if (ftpData->connectedClients < 0) 
     {
         ftpData->connectedClients = 0;
     }
+    pthread_mutex_unlock(&ftpData->connectionsMutex);
+
+    resetClientData(ftpData, processingSocket, 0);
+    moveClientToList(ftpData, processingSocket, 0);
+    //resetWorkerData(ftpData, processingSocket, 0);
 
     //printf("Client id: %d disconnected", processingSocket);
     //printf("\nServer: Clients connected:%d", ftpData->connectedClients);
@@ -596,66 +921,88 @@ void closeClient(ftpDataType * ftpData, int processingSocket)
     if (ftpData->clients[processingSocket].workerData.threadIsAlive == 1)
     {
     	cancelWorker(ftpData, processingSocket);
-    }
 
-    FD_CLR(ftpData->clients[processingSocket].socketDescriptor, &ftpData->connectionData.rsetAll);    
-    FD_CLR(ftpData->clients[processingSocket].socketDescriptor, &ftpData->connectionData.wsetAll);
-    FD_CLR(ftpData->clients[processingSocket].socketDescriptor, &ftpData->connectionData.esetAll);
+    	//The pool thread still uses the client data, releaseClientWorker wakes up the reactor to close it
+    	if (pauseClientEvents(ftpData, processingSocket) == 1)
+    	{
+    		ftpData->clients[processingSocket].closeTheClient = 1;
+    		return;
+    	}
+    }
 
+    fdRemove(ftpData, processingSocket);
     closeSocket(ftpData, processingSocket);
-
-    ftpData->connectionData.maxSocketFD = ftpData->connectionData.theMainSocket+1;
-    ftpData->connectionData.maxSocketFD = getMaximumSocketFd(ftpData->connectionData.theMainSocket, ftpData) + 1;
     return;
 }
 
-void checkClientConnectionTimeout(ftpDataType * ftpData)
+/* Run the expired timers of the reactor clients, the cost depends on the expired timers only */
+void checkClientConnectionTimeout(ftpDataType * ftpData, int reactorId)
+{
+    TWHEEL_Advance(&ftpData->connectionData[reactorId].timers);
+}
+
+void clientIdleTimeout(void *theOwner, int clientId)
 {
-    int processingSock;
-    for (processingSock = 0; processingSock < ftpData->ftpParameters.maxClients; processingSock++)
+    ftpDataType *ftpData = (ftpDataType *) theOwner;
+    TWHEEL_WheelDataType *theTimers = &ftpData->connectionData[ftpData->clients[clientId].reactorId].timers;
+    unsigned long long int idleDeadline = ftpData->clients[clientId].lastActivityTimeStamp + ftpData->ftpParameters.maximumIdleInactivity + 1;
+
+    /* Max idle time check, close the connection if time is elapsed */
+    if (idleDeadline > theTimers->currentTime)
     {
-        /* No connection active*/
-        if (ftpData->clients[processingSock].socketDescriptor < 0 ||
-            ftpData->clients[processingSock].socketIsConnected == 0) 
-            {
-                continue;
-            }
+        TWHEEL_Start(theTimers, &ftpData->clients[clientId].idleTimer, idleDeadline);
+        return;
+    }
 
-        /* Max idle time check, close the connection if time is elapsed */
-        if (ftpData->ftpParameters.maximumIdleInactivity != 0 &&
-            (int)time(NULL) - ftpData->clients[processingSock].lastActivityTimeStamp > ftpData->ftpParameters.maximumIdleInactivity)
-            {
-                ftpData->clients[processingSock].closeTheClient = 1;
-            }
+    closeClient(ftpData, clientId);
+}
+
+void clientTlsNegotiatingTimeout(void *theOwner, int clientId)
+{
+    ftpDataType *ftpData = (ftpDataType *) theOwner;
+
+    if (ftpData->clients[clientId].tlsIsNegotiating == 1)
+    {
+        //printf("\nTLS timeout closing the client %d", clientId);
+        closeClient(ftpData, clientId);
     }
 }
 
+/* Expire the login fails, the timers are shared by all the reactors */
 void flushLoginWrongTriesData(ftpDataType * ftpData)
 {
-    int i;
-    //printf("\n flushLoginWrongTriesData size of the vector : %d", ftpData->loginFailsVector.Size);
-    
-    for (i = (ftpData->loginFailsVector.Size-1); i >= 0; i--)
+    pthread_mutex_lock(&ftpData->loginFailsMutex);
+    TWHEEL_Advance(&ftpData->loginFailsTimers);
+    pthread_mutex_unlock(&ftpData->loginFailsMutex);
+}
+
+int selectWait(ftpDataType * ftpData, int reactorId)
+{
+    ConnectionData_DataType *reactor = &ftpData->connectionData[reactorId];
+
+    //Wake up every tick while timers are running
+    int waitTimeout = (reactor->timers.timersNumber > 0 || (reactorId == 0 && ftpData->loginFailsTimers.timersNumber > 0)) ? 1000 : 10000;
+
+    reactor->readyEventsNumber = epoll_wait(reactor->epollFd, reactor->readyEvents, MAXIMUM_READY_EVENTS, waitTimeout);
+
+    if (reactor->readyEventsNumber < 0)
     {
-        //printf("\n last login fail attempt : %d", ((loginFailsDataType *) ftpData->loginFailsVector.Data[i])->failTimeStamp);
-        
-        if ( (time(NULL) - ((loginFailsDataType *) ftpData->loginFailsVector.Data[i])->failTimeStamp) > WRONG_PASSWORD_ALLOWED_RETRY_TIME)
+        if (errno != EINTR)
         {
-            //printf("\n Deleting element : %d", i);
-            ftpData->loginFailsVector.DeleteAt(&ftpData->loginFailsVector, i, deleteLoginFailsData);
+            printf("\nepoll_wait error errno = %d", errno);
         }
+
+        reactor->readyEventsNumber = 0;
+        return -1;
     }
+
+    return reactor->readyEventsNumber;
 }
 
-int selectWait(ftpDataType * ftpData)
+/* Return the client id of a ready event, MAIN_SOCKET_EVENT_ID for the listening socket */
+int getReadyClientId(ftpDataType * ftpData, int reactorId, int eventIndex)
 {
-    struct timeval selectMaximumLockTime;
-    selectMaximumLockTime.tv_sec = 10;
-    selectMaximumLockTime.tv_usec = 0;
-    ftpData->connectionData.rset = ftpData->connectionData.rsetAll;
-    ftpData->connectionData.wset = ftpData->connectionData.wsetAll;
-    ftpData->connectionData.eset = ftpData->connectionData.esetAll;
-    return select(ftpData->connectionData.maxSocketFD, &ftpData->connectionData.rset, NULL, &ftpData->connectionData.eset, &selectMaximumLockTime);
+    return (int) ftpData->connectionData[reactorId].readyEvents[eventIndex].data.u32;
 }
 
 int isClientConnected(ftpDataType * ftpData, int cliendId)
@@ -669,39 +1016,65 @@ int isClientConnected(ftpDataType * ftpData, int cliendId)
     return 1;
 }
 
-int getAvailableClientSocketIndex(ftpDataType * ftpData)
+/* The first free client of the reactor, it becomes live once the connection is accepted */
+int getAvailableClientSocketIndex(ftpDataType * ftpData, int reactorId)
 {
-    int socketIndex;
-    for (socketIndex = 0; socketIndex < ftpData->ftpParameters.maxClients; socketIndex++)
-    {
-        if (isClientConnected(ftpData, socketIndex) == 0) 
-        {
-            return socketIndex;
-        }
-    }
-
-    /* no socket are available for a new client connection */
-    return -1;
+    /* -1 if no socket are available for a new client connection */
+    return ftpData->connectionData[reactorId].firstFreeClientId;
 }
 
-int evaluateClientSocketConnection(ftpDataType * ftpData)
+/* Accept one pending connection, returns 0 when the backlog is empty */
+static int acceptClientConnection(ftpDataType * ftpData, int reactorId)
 {
-    if (FD_ISSET(ftpData->connectionData.theMainSocket, &ftpData->connectionData.rset))
     {
         int availableSocketIndex;
-        if ((availableSocketIndex = getAvailableClientSocketIndex(ftpData)) != -1) //get available socket  
+        if ((availableSocketIndex = getAvailableClientSocketIndex(ftpData, reactorId)) != -1) //get available socket  
         {
-            if ((ftpData->clients[availableSocketIndex].socketDescriptor = accept(ftpData->connectionData.theMainSocket, (struct sockaddr *)&ftpData->clients[availableSocketIndex].client_sockaddr_in, (socklen_t*)&ftpData->clients[availableSocketIndex].sockaddr_in_size))!=-1)
+            if ((ftpData->clients[availableSocketIndex].socketDescriptor = accept4(ftpData->connectionData[reactorId].theMainSocket, (struct sockaddr *)&ftpData->clients[availableSocketIndex].client_sockaddr_in, (socklen_t*)&ftpData->clients[availableSocketIndex].sockaddr_in_size, SOCK_NONBLOCK | SOCK_CLOEXEC))!=-1)
             {
-                int error, numberOfConnectionFromSameIp, i;
-                numberOfConnectionFromSameIp = 0;
-                ftpData->connectedClients++;
-                ftpData->clients[availableSocketIndex].socketIsConnected = 1;
+                int error, ipConnectionIsCounted;
+
+                TRANSPORT_InitPlain(&ftpData->clients[availableSocketIndex].transport, ftpData->clients[availableSocketIndex].socketDescriptor);
+                inet_ntop(AF_INET,
+                          &(ftpData->clients[availableSocketIndex].client_sockaddr_in.sin_addr),
+                          ftpData->clients[availableSocketIndex].clientIpAddress,
+                          INET_ADDRSTRLEN);
+                //printf("\n Client IP: %s", ftpData->clients[availableSocketIndex].clientIpAddress);
+
+                pthread_mutex_lock(&ftpData->connectionsMutex);
+                ipConnectionIsCounted = addIpConnection(ftpData, ftpData->clients[availableSocketIndex].client_sockaddr_in.sin_addr.s_addr, ftpData->ftpParameters.maximumConnectionsPerIp);
+                if (ipConnectionIsCounted == 1)
+                {
+                    ftpData->connectedClients++;
+                }
+                pthread_mutex_unlock(&ftpData->connectionsMutex);
 
-                error = fcntl(ftpData->clients[availableSocketIndex].socketDescriptor, F_SETFL, O_NONBLOCK);
+                //Refused before the slot is used, it stays in the free list
+                if (ipConnectionIsCounted == 0)
+                {
+                    char theMessage[128];
+                    int theMessageLen = snprintf(theMessage, sizeof(theMessage), "530 too many connection from your ip address %s \r\n", ftpData->clients[availableSocketIndex].clientIpAddress);
+                    write(ftpData->clients[availableSocketIndex].socketDescriptor, theMessage, theMessageLen);
+                    shutdown(ftpData->clients[availableSocketIndex].socketDescriptor, SHUT_RDWR);
+                    close(ftpData->clients[availableSocketIndex].socketDescriptor);
+                    ftpData->clients[availableSocketIndex].socketDescriptor = -1;
+                    ftpData->clients[availableSocketIndex].sockaddr_in_size = sizeof(struct sockaddr_in);
+                    memset(ftpData->clients[availableSocketIndex].clientIpAddress, 0, INET_ADDRSTRLEN);
+                    return 1;
+                }
+
+                ftpData->clients[availableSocketIndex].ipConnectionIsCounted = 1;
+                ftpData->clients[availableSocketIndex].socketIsConnected = 1;
+                moveClientToList(ftpData, availableSocketIndex, 1);
 
                 fdAdd(ftpData, availableSocketIndex);
 
+                if (ftpData->clients[availableSocketIndex].closeTheClient == 1)
+                {
+                    closeClient(ftpData, availableSocketIndex);
+                    return 1;
+                }
+
                 error = getsockname(ftpData->clients[availableSocketIndex].socketDescriptor, (struct sockaddr *)&ftpData->clients[availableSocketIndex].server_sockaddr_in, (socklen_t*)&ftpData->clients[availableSocketIndex].sockaddr_in_server_size);
                 inet_ntop(AF_INET,
                           &(ftpData->clients[availableSocketIndex].server_sockaddr_in.sin_addr),
@@ -715,51 +1088,33 @@ int evaluateClientSocketConnection(ftpDataType * ftpData)
                                                                                                 &ftpData->clients[availableSocketIndex].serverIpAddressInteger[2],
                                                                                                 &ftpData->clients[availableSocketIndex].serverIpAddressInteger[3]);
 
-                inet_ntop(AF_INET,
-                          &(ftpData->clients[availableSocketIndex].client_sockaddr_in.sin_addr),
-                          ftpData->clients[availableSocketIndex].clientIpAddress,
-                          INET_ADDRSTRLEN);
-                //printf("\n Client IP: %s", ftpData->clients[availableSocketIndex].clientIpAddress);
                 ftpData->clients[availableSocketIndex].clientPort = (int) ntohs(ftpData->clients[availableSocketIndex].client_sockaddr_in.sin_port);      
                 //printf("\nClient port is: %d\n", ftpData->clients[availableSocketIndex].clientPort);
 
-                ftpData->clients[availableSocketIndex].connectionTimeStamp = (int)time(NULL);
-                ftpData->clients[availableSocketIndex].lastActivityTimeStamp = (int)time(NULL);
-                
-                for (i = 0; i <ftpData->ftpParameters.maxClients; i++)
-                {
-                    if (i == availableSocketIndex)
-                    {
-                        continue;
-                    }
-                    
-                    if (strcmp(ftpData->clients[availableSocketIndex].clientIpAddress, ftpData->clients[i].clientIpAddress) == 0) {
-                        numberOfConnectionFromSameIp++;
-                    }
-                }
-                if (ftpData->ftpParameters.maximumConnectionsPerIp > 0 &&
-                    numberOfConnectionFromSameIp >= ftpData->ftpParameters.maximumConnectionsPerIp)
-                {
-                	int theReturnCode = socketPrintf(ftpData, availableSocketIndex, "sss", "530 too many connection from your ip address ", ftpData->clients[availableSocketIndex].clientIpAddress, " \r\n");
-                    ftpData->clients[availableSocketIndex].closeTheClient = 1;
-                }
-                else
+                ftpData->clients[availableSocketIndex].connectionTimeStamp = ftpData->connectionData[reactorId].timers.currentTime;
+                ftpData->clients[availableSocketIndex].lastActivityTimeStamp = ftpData->connectionData[reactorId].timers.currentTime;
+
+                if (ftpData->ftpParameters.maximumIdleInactivity != 0)
+                    TWHEEL_Start(&ftpData->connectionData[reactorId].timers, &ftpData->clients[availableSocketIndex].idleTimer, ftpData->clients[availableSocketIndex].lastActivityTimeStamp + ftpData->ftpParameters.maximumIdleInactivity + 1);
+
+                ftpData->clients[availableSocketIndex].outputIsHeld = 1;
+                int returnCode = socketPrintf(ftpData, availableSocketIndex, "s", ftpData->welcomeMessage);
+                if (returnCode <= 0 ||
+                    flushClientOutput(ftpData, availableSocketIndex) < 0)
                 {
-                	int returnCode = socketPrintf(ftpData, availableSocketIndex, "s", ftpData->welcomeMessage);
-                	if (returnCode <= 0)
-                	{
-                		ftpData->clients[availableSocketIndex].closeTheClient = 1;
-                	}
+                    closeClient(ftpData, availableSocketIndex);
                 }
                 
                 return 1;
             }
             else
             {
-                //Errors while accepting, socket will be closed
-                ftpData->clients[availableSocketIndex].closeTheClient = 1;
-                printf("\n2 Errno = %d", errno);
-                return 1;
+                //Errors while accepting, the slot is still free
+                ftpData->clients[availableSocketIndex].socketDescriptor = -1;
+                ftpData->clients[availableSocketIndex].sockaddr_in_size = sizeof(struct sockaddr_in);
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    printf("\n2 Errno = %d", errno);
+                return 0;
             }
         }
         else
@@ -767,21 +1122,32 @@ int evaluateClientSocketConnection(ftpDataType * ftpData)
             int socketRefuseFd, socketRefuse_in_size;
             socketRefuse_in_size = sizeof(struct sockaddr_in);
             struct sockaddr_in socketRefuse_sockaddr_in;
-            if ((socketRefuseFd = accept(ftpData->connectionData.theMainSocket, (struct sockaddr *)&socketRefuse_sockaddr_in, (socklen_t*)&socketRefuse_in_size))!=-1)
+            if ((socketRefuseFd = accept4(ftpData->connectionData[reactorId].theMainSocket, (struct sockaddr *)&socketRefuse_sockaddr_in, (socklen_t*)&socketRefuse_in_size, SOCK_NONBLOCK | SOCK_CLOEXEC))!=-1)
             {
             	int theReturnCode = 0;
                 char *messageToWrite = "10068 Server reached the maximum number of connection, please try later.\r\n";
                 write(socketRefuseFd, messageToWrite, strlen(messageToWrite));
                 shutdown(socketRefuseFd, SHUT_RDWR);
                 theReturnCode = close(socketRefuseFd);
+                return 1;
             }
 
             return 0;
         }
     }
-    else
+}
+
+/* Called when epoll reports the reactor main socket as readable, drains the backlog up to acceptBatchSize connections.
+ * The socket is level triggered, the remaining connections are reported again on the next wait */
+int evaluateClientSocketConnection(ftpDataType * ftpData, int reactorId)
+{
+    int acceptedConnections = 0;
+
+    while (acceptedConnections < ftpData->ftpParameters.acceptBatchSize &&
+           acceptClientConnection(ftpData, reactorId) == 1)
     {
-        //No new socket
-        return 0;
+        acceptedConnections++;
     }
+
+    return acceptedConnections;
 }
@@ -32,24 +32,37 @@
 extern "C" {
 #endif
 
-int getMaximumSocketFd(int mainSocket, ftpDataType * data);
+/* Seconds a pool thread waits for the data connection and then for the transfer command */
+#define DATA_CONNECTION_TIMEOUT 30
+
 int createSocket(ftpDataType * ftpData);
 int createPassiveSocket(int port);
-int createActiveSocket(int port, char *ipAddress);
-void fdInit(ftpDataType * ftpData);
+int createActiveSocket(int port, char *ipAddress, int *theSocket);
+int createActiveSocketNonBlocking(int port, char *ipAddress);
+int acceptClientDataSocket(ftpDataType * ftpData, int clientId, int flags);
+int waitClientDataSocket(ftpDataType * ftpData, int clientId, int timeoutSeconds);
+void fdInit(ftpDataType * ftpData, int reactorId);
 void fdAdd(ftpDataType * ftpData, int index);
 void fdRemove(ftpDataType * ftpData, int index);
 
-void checkClientConnectionTimeout(ftpDataType * ftpData);
+void checkClientConnectionTimeout(ftpDataType * ftpData, int reactorId);
+void clientIdleTimeout(void *theOwner, int clientId);
+void clientTlsNegotiatingTimeout(void *theOwner, int clientId);
 void flushLoginWrongTriesData(ftpDataType * ftpData);
 void closeSocket(ftpDataType * ftpData, int processingSocket);
 void closeClient(ftpDataType * ftpData, int processingSocket);
-int selectWait(ftpDataType * ftpData);
+int selectWait(ftpDataType * ftpData, int reactorId);
+int getReadyClientId(ftpDataType * ftpData, int reactorId, int eventIndex);
 int isClientConnected(ftpDataType * ftpData, int cliendId);
-int getAvailableClientSocketIndex(ftpDataType * ftpData);
-int evaluateClientSocketConnection(ftpDataType * ftpData);
+int getAvailableClientSocketIndex(ftpDataType * ftpData, int reactorId);
+int evaluateClientSocketConnection(ftpDataType * ftpData, int reactorId);
 int socketPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __fmt, ...);
+void holdClientOutput(ftpDataType * ftpData, int clientId);
+int flushClientOutput(ftpDataType * ftpData, int clientId);
+void dropClientOutput(ftpDataType * ftpData, int clientId);
+void releaseClientWorker(ftpDataType * ftpData, int clientId);
 int socketWorkerPrintf(ftpDataType * ftpData, int clientId, const char *__restrict __fmt, ...);
+int socketWorkerWrite(ftpDataType * ftpData, int clientId, char *theData, int theDataSize);
 
 
 #ifdef __cplusplus
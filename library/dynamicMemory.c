@@ -7,14 +7,51 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <pthread.h>
 #include <string.h>
 #include "dynamicMemory.h"
 #include "errorHandling.h"
 
-//total memory allocated
+#define DYNMEM_MAGIC_NUMBER		0x44594e4d
+
+/* Keeps the user memory after the inline item aligned like malloc does */
+typedef union DYNMEM_BlockHeader_DataType
+{
+	DYNMEM_MemoryTable_DataType item;
+	long double alignLongDouble;
+	long long int alignLongLong;
+	void *alignPointer;
+} DYNMEM_BlockHeader_DataType;
+
+#define DYNMEM_HEADER_SIZE		sizeof(DYNMEM_BlockHeader_DataType)
+#define DYNMEM_ITEM_OF(address)	((DYNMEM_MemoryTable_DataType *) ((char *) (address) - DYNMEM_HEADER_SIZE))
+
+//total memory allocated, updated with atomic operations
 static unsigned long long int theTotalMemory;
-static pthread_mutex_t memoryCountMutex;
+
+static DYNMEM_MemoryTable_DataType *DYNMEM_GetItem(void *theMemoryAddress)
+{
+	DYNMEM_MemoryTable_DataType *theItem = DYNMEM_ITEM_OF(theMemoryAddress);
+
+	if (theItem->magicNumber != DYNMEM_MAGIC_NUMBER ||
+		theItem->address != theMemoryAddress)
+	{
+		return NULL;
+	}
+
+	return theItem;
+}
+
+/* Unlinking the item from another table would corrupt both lists */
+static int DYNMEM_IsOwnedBy(DYNMEM_MemoryTable_DataType *theItem, DYNMEM_MemoryTable_DataType **memoryListHead)
+{
+	if (theItem->ownerTable != memoryListHead)
+	{
+		fprintf(stderr, "\nDYNMEM: %s item of table %p used with table %p", theItem->theName, (void *) theItem->ownerTable, (void *) memoryListHead);
+		return 0;
+	}
+
+	return 1;
+}
 
 void DYNMEM_Init(void)
 {
@@ -25,54 +62,38 @@ void DYNMEM_Init(void)
 
 	state = 1;
 
-	theTotalMemory = 0;
-
-    if (pthread_mutex_init(&memoryCountMutex, NULL) != 0)
-    {
-    	report_error_q("Unable to init the mutex", __FILE__, __LINE__, 0);
-    }
+	__atomic_store_n(&theTotalMemory, 0, __ATOMIC_RELAXED);
 }
 
 unsigned long long int DYNMEM_GetTotalMemory(void)
 {
-	return theTotalMemory;
+	return __atomic_load_n(&theTotalMemory, __ATOMIC_RELAXED);
 }
 
 unsigned long long int DYNMEM_IncreaseMemoryCounter(unsigned long long int theSize)
 {
-	pthread_mutex_lock(&memoryCountMutex);
-	theTotalMemory = theTotalMemory + theSize;
-	pthread_mutex_unlock(&memoryCountMutex);
-	return theTotalMemory;
+	return __atomic_add_fetch(&theTotalMemory, theSize, __ATOMIC_RELAXED);
 }
 
 unsigned long long int DYNMEM_DecreaseMemoryCounter(unsigned long long int theSize)
 {
-	pthread_mutex_lock(&memoryCountMutex);
-	theTotalMemory = theTotalMemory - theSize;
-	pthread_mutex_unlock(&memoryCountMutex);
-	return theTotalMemory;
+	return __atomic_sub_fetch(&theTotalMemory, theSize, __ATOMIC_RELAXED);
 }
 
 void *DYNMEM_malloc(size_t bytes, DYNMEM_MemoryTable_DataType **memoryListHead, char * theName)
 {
-	void *memory = NULL;
 	DYNMEM_MemoryTable_DataType *newItem = NULL;
-	memory = calloc(bytes,1);
-	newItem = calloc(1, sizeof(DYNMEM_MemoryTable_DataType));
+	newItem = calloc(DYNMEM_HEADER_SIZE + bytes, 1);
 	//printf("Allocating new item in memory, size of %d", bytes);
 
-	if(memory)
+	if(newItem)
 	{
-		if(newItem == NULL)
-		{
-			report_error_q("Memory allocation error, no room for memory list item.",__FILE__,__LINE__, 0);
-		}
+		DYNMEM_IncreaseMemoryCounter(bytes + DYNMEM_HEADER_SIZE);
 
-		DYNMEM_IncreaseMemoryCounter(bytes + sizeof(DYNMEM_MemoryTable_DataType));
-
-		newItem->address = memory;
+		newItem->magicNumber = DYNMEM_MAGIC_NUMBER;
+		newItem->address = (char *) newItem + DYNMEM_HEADER_SIZE;
 		newItem->size = bytes;
+		newItem->ownerTable = memoryListHead;
 		newItem->nextElement = NULL;
 		newItem->previousElement = NULL;
 		strncpy(newItem->theName, theName, 20);
@@ -85,17 +106,10 @@ void *DYNMEM_malloc(size_t bytes, DYNMEM_MemoryTable_DataType **memoryListHead,
 		}
 		else
 		{
-			//printf("\nmemoryListHead = %ld", (int) *memoryListHead);
 			*memoryListHead = newItem;
-			//printf("\nmemoryListHead = newItem %ld", (int) *memoryListHead);
 		}
 
-//		printf("\nElement size: %ld", (*memoryListHead)->size);
-//		printf("\nElement address: %ld", (long int) (*memoryListHead)->address);
-//		printf("\nElement nextElement: %ld",(long int) (*memoryListHead)->nextElement);
-//		printf("\nElement previousElement: %ld",(long int) (*memoryListHead)->previousElement);
-
-		return memory;
+		return newItem->address;
 	}
 	else
 	{
@@ -106,55 +120,49 @@ void *DYNMEM_malloc(size_t bytes, DYNMEM_MemoryTable_DataType **memoryListHead,
 
 void *DYNMEM_realloc(void *theMemoryAddress, size_t bytes, DYNMEM_MemoryTable_DataType **memoryListHead)
 {
-	void *newMemory = NULL;
-	//printf("\nSearching address %lld", theMemoryAddress);
-	newMemory = realloc(theMemoryAddress, bytes);
+	DYNMEM_MemoryTable_DataType *found = NULL, *newItem = NULL;
+	size_t previousSize;
 
-	//printf("\nReallocating item in memory, size of %d", bytes);
-	//printf("\nSearching address %lld", theMemoryAddress);
-	//printf("(*memoryListHead) = %lld", (*memoryListHead));
+	if (theMemoryAddress == NULL ||
+		(found = DYNMEM_GetItem(theMemoryAddress)) == NULL)
+	{
+		report_error_q("Unable to reallocate memory not previously allocated",__FILE__,__LINE__, 0);
+		return NULL;
+	}
 
-	if(newMemory)
+	if (DYNMEM_IsOwnedBy(found, memoryListHead) == 0)
 	{
-		DYNMEM_MemoryTable_DataType *temp = NULL,*found = NULL;
-		for( temp = (*memoryListHead); temp!=NULL; temp = temp->nextElement)
-		{
-			//printf("\n %lld == %lld", temp->address, theMemoryAddress);
-			if(temp->address == theMemoryAddress)
-			{
-				found = temp;
-				break;
-			}
-		}
+		report_error_q("Unable to reallocate memory of another memory table",__FILE__,__LINE__, 0);
+		return NULL;
+	}
 
-		if(!found)
-		{
-			//Debug TRAP
-			//char *theData ="c";
-			//strcpy(theData, "NOOOOOOOOOOOOOOOO");
+	previousSize = found->size;
+	newItem = realloc(found, DYNMEM_HEADER_SIZE + bytes);
 
-			report_error_q("Unable to reallocate memory not previously allocated",__FILE__,__LINE__, 0);
-			// Report this as an error
-		}
+	if(newItem)
+	{
+		//The item may have moved, relink it in the table
+		if (newItem->previousElement)
+			newItem->previousElement->nextElement = newItem;
+		else
+			(*memoryListHead) = newItem;
+
+		if (newItem->nextElement)
+			newItem->nextElement->previousElement = newItem;
 
-		if (found->size > bytes)
+		if (previousSize > bytes)
 		{
-			DYNMEM_DecreaseMemoryCounter((found->size-bytes));
+			DYNMEM_DecreaseMemoryCounter((previousSize-bytes));
 		}
-		else if (found->size < bytes)
+		else if (previousSize < bytes)
 		{
-			DYNMEM_IncreaseMemoryCounter((bytes-found->size));
+			DYNMEM_IncreaseMemoryCounter((bytes-previousSize));
 		}
 
-		found->address = newMemory;
-		found->size = bytes;
-
-		//printf("\nElement size: %ld", (*found)->size);
-		//printf("\nElement address: %ld", (long int) (*found)->address);
-		//printf("\nElement nextElement: %ld",(long int) (*found)->nextElement);
-		//printf("\nElement previousElement: %ld",(long int) (*found)->previousElement);
+		newItem->address = (char *) newItem + DYNMEM_HEADER_SIZE;
+		newItem->size = bytes;
 
-		return newMemory;
+		return newItem->address;
 	}
 	else
 	{
@@ -165,36 +173,27 @@ void *DYNMEM_realloc(void *theMemoryAddress, size_t bytes, DYNMEM_MemoryTable_Da
 
 void DYNMEM_free(void *f_address, DYNMEM_MemoryTable_DataType ** memoryListHead)
 {
-	DYNMEM_MemoryTable_DataType *temp = NULL,*found = NULL;
+	DYNMEM_MemoryTable_DataType *found = NULL;
 
 	if(f_address == NULL)
 		return;
 
-	for(temp=(*memoryListHead); temp!=NULL; temp = temp->nextElement)
-	{
-		if(temp->address == f_address)
-		{
-			found = temp;
-			break;
-		}
-	}
+	found = DYNMEM_GetItem(f_address);
 
 	if(!found)
 	{
-		//printf("\n\nMemory address : %ld not found\n\n", f_address);
-		//Debug TRAP
-		//char *theData ="c";
-		//strcpy(theData, "ciaociaociao");
 		report_error_q("Unable to free memory not previously allocated",__FILE__,__LINE__, 1);
-		// Report this as an error
+		return;
 	}
 
-	DYNMEM_DecreaseMemoryCounter(found->size + sizeof(DYNMEM_MemoryTable_DataType));
-
+	if (DYNMEM_IsOwnedBy(found, memoryListHead) == 0)
+	{
+		report_error_q("Unable to free memory of another memory table",__FILE__,__LINE__, 0);
+		return;
+	}
 
-	//printf("\nFree of %ld", f_address);
+	DYNMEM_DecreaseMemoryCounter(found->size + DYNMEM_HEADER_SIZE);
 
-	free(f_address);
 	if(found->previousElement)
 		found->previousElement->nextElement = found->nextElement;
 
@@ -204,6 +203,7 @@ void DYNMEM_free(void *f_address, DYNMEM_MemoryTable_DataType ** memoryListHead)
 	if(found == (*memoryListHead))
 		(*memoryListHead) = found->nextElement;
 
+	found->magicNumber = 0;
 	free(found);
 }
 
@@ -214,16 +214,9 @@ void DYNMEM_freeAll(DYNMEM_MemoryTable_DataType **memoryListHead)
 
 	while((*memoryListHead) != NULL)
 	{
-//		printf("\nDYNMEM_freeAll called");
-//		printf("\nElement size: %ld", (*memoryListHead)->size);
-//		printf("\nElement address: %ld", (long int) (*memoryListHead)->address);
-//		printf("\nElement nextElement: %ld",(long int) (*memoryListHead)->nextElement);
-//		printf("\nElement previousElement: %ld",(long int) (*memoryListHead)->previousElement);
-
-		DYNMEM_DecreaseMemoryCounter((*memoryListHead)->size + sizeof(DYNMEM_MemoryTable_DataType));
-		//printf("\nFree table element");
-		free((*memoryListHead)->address);
+		DYNMEM_DecreaseMemoryCounter((*memoryListHead)->size + DYNMEM_HEADER_SIZE);
 		temp = (*memoryListHead)->nextElement;
+		(*memoryListHead)->magicNumber = 0;
 		free((*memoryListHead));
 		(*memoryListHead) = temp;
 	}
@@ -8,11 +8,16 @@
 #ifndef LIBRARY_DYNAMICMEMORY_H_
 #define LIBRARY_DYNAMICMEMORY_H_
 
+/* The table item is stored inline just before the memory it tracks,
+   so free and realloc find it without scanning the table */
 typedef struct DYNMEM_MemoryTable_DataType
 {
 	char theName[20];
+	unsigned int magicNumber;
 	void *address;
 	size_t size;
+	/* Head of the table that owns the item, free and realloc must be given the same one */
+	struct DYNMEM_MemoryTable_DataType **ownerTable;
 	struct DYNMEM_MemoryTable_DataType *nextElement;
 	struct DYNMEM_MemoryTable_DataType *previousElement;
 } DYNMEM_MemoryTable_DataType;
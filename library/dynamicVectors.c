@@ -30,15 +30,53 @@
 #include "dynamicVectors.h"
 #include "dynamicMemory.h"
 
+static void DYNV_Reserve(void ***Data, int **ElementSize, int *Capacity, int Size, DYNMEM_MemoryTable_DataType **memoryTable)
+{
+    int newCapacity;
+
+    if (Size < *Capacity)
+        return;
+
+    newCapacity = (*Capacity > 0) ? (*Capacity * 2) : DYNV_INITIAL_CAPACITY;
+
+    if (*Data != NULL)
+    {
+        *Data = (void **) DYNMEM_realloc(*Data, sizeof(void *) * newCapacity, memoryTable);
+        *ElementSize = (int *) DYNMEM_realloc(*ElementSize, sizeof(int) * newCapacity, memoryTable);
+    }
+    else
+    {
+        *Data = (void **) DYNMEM_malloc(sizeof(void *) * newCapacity, memoryTable, "pushback");
+        *ElementSize = (int *) DYNMEM_malloc(sizeof(int) * newCapacity, memoryTable, "pushback");
+    }
+
+    *Capacity = newCapacity;
+}
+
+static void DYNV_Release(void ***Data, int **ElementSize, int *Capacity, DYNMEM_MemoryTable_DataType **memoryTable)
+{
+    if (*Data != NULL)
+        DYNMEM_free(*Data, memoryTable);
+
+    if (*ElementSize != NULL)
+        DYNMEM_free(*ElementSize, memoryTable);
+
+    *Data = NULL;
+    *ElementSize = NULL;
+    *Capacity = 0;
+}
+
 void DYNV_VectorGeneric_Init(DYNV_VectorGenericDataType *TheVectorGeneric)
 {
     TheVectorGeneric->Size = 0;
+    TheVectorGeneric->Capacity = 0;
     TheVectorGeneric->Data = NULL;
     TheVectorGeneric->ElementSize = NULL;
     TheVectorGeneric->memoryTable = NULL;
 
     //Functions Pointers
     TheVectorGeneric->DeleteAt = (void *)DYNV_VectorGeneric_DeleteAt;
+    TheVectorGeneric->SwapDeleteAt = (void *)DYNV_VectorGeneric_SwapDeleteAt;
     TheVectorGeneric->Destroy = (void *)DYNV_VectorGeneric_Destroy;
     TheVectorGeneric->PopBack = (void *)DYNV_VectorGeneric_PopBack;
     TheVectorGeneric->PushBack = (void *)DYNV_VectorGeneric_PushBack;
@@ -54,23 +92,7 @@ void DYNV_VectorGeneric_InitWithSearchFunction(DYNV_VectorGenericDataType *TheVe
 
 void DYNV_VectorGeneric_PushBack(DYNV_VectorGenericDataType *TheVectorGeneric, void * TheElementData, int TheElementSize)
 {
-    if (TheVectorGeneric->Data != NULL)
-    {
-        TheVectorGeneric->Data = (void **) DYNMEM_realloc(TheVectorGeneric->Data, sizeof(void *) * (TheVectorGeneric->Size+1), &TheVectorGeneric->memoryTable);
-    }
-    else
-    {
-        TheVectorGeneric->Data = (void **) DYNMEM_malloc (sizeof(void *) * (TheVectorGeneric->Size+1), &TheVectorGeneric->memoryTable, "pushback");
-    }
-
-    if (TheVectorGeneric->ElementSize != NULL)
-    {
-        TheVectorGeneric->ElementSize = (int *) DYNMEM_realloc (TheVectorGeneric->ElementSize, sizeof(int) * (TheVectorGeneric->Size+1), &TheVectorGeneric->memoryTable);
-    }
-    else
-    {
-        TheVectorGeneric->ElementSize = (int *) DYNMEM_malloc (sizeof(int), &TheVectorGeneric->memoryTable, "PushBack");
-    }
+    DYNV_Reserve(&TheVectorGeneric->Data, &TheVectorGeneric->ElementSize, &TheVectorGeneric->Capacity, TheVectorGeneric->Size, &TheVectorGeneric->memoryTable);
 
     TheVectorGeneric->Data[TheVectorGeneric->Size] = (void *) DYNMEM_malloc(TheElementSize, &TheVectorGeneric->memoryTable, "pushback");
     memcpy(TheVectorGeneric->Data[TheVectorGeneric->Size], TheElementData, TheElementSize);
@@ -81,41 +103,19 @@ void DYNV_VectorGeneric_PushBack(DYNV_VectorGenericDataType *TheVectorGeneric, v
 void DYNV_VectorGeneric_PopBack(DYNV_VectorGenericDataType *TheVector, void (*DeleteElementFunction)(void *TheElementToDelete))
 {
     DeleteElementFunction((void *) TheVector->Data[TheVector->Size-1]);
-    DYNMEM_free(TheVector->Data[TheVector->Size-1], &TheVector->memoryTable);
-    if (TheVector->Size > 1)
-    {
-            TheVector->Data = (void **) DYNMEM_realloc(TheVector->Data, sizeof(void *) * (TheVector->Size-1), &TheVector->memoryTable);
-            TheVector->ElementSize = (int *) DYNMEM_realloc (TheVector->ElementSize, sizeof(int) * (TheVector->Size-1), &TheVector->memoryTable);
-    }
-    else
-    {
-            DYNMEM_free(TheVector->Data, &TheVector->memoryTable);
-            DYNMEM_free(TheVector->ElementSize, &TheVector->memoryTable);
-            TheVector->Data = NULL;
-            TheVector->ElementSize = NULL;
-    }
-
-        TheVector->Size--;
+    DYNV_VectorGeneric_SoftPopBack(TheVector);
 }
 
 void DYNV_VectorGeneric_SoftPopBack(DYNV_VectorGenericDataType *TheVector)
 {
     DYNMEM_free(TheVector->Data[TheVector->Size-1], &TheVector->memoryTable);
+    TheVector->Size--;
 
-    if (TheVector->Size > 1)
-    {
-        TheVector->Data = (void **) DYNMEM_realloc(TheVector->Data, sizeof(void *) * (TheVector->Size-1), &TheVector->memoryTable);
-        TheVector->ElementSize = (int *) DYNMEM_realloc (TheVector->ElementSize, sizeof(int) * (TheVector->Size-1), &TheVector->memoryTable);
-    }
-    else
+    //The capacity is kept until the vector is empty
+    if (TheVector->Size == 0)
     {
-        DYNMEM_free(TheVector->Data, &TheVector->memoryTable);
-        DYNMEM_free(TheVector->ElementSize, &TheVector->memoryTable);
-        TheVector->Data = NULL;
-        TheVector->ElementSize = NULL;
+        DYNV_Release(&TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     }
-
-    TheVector->Size--;
 }
 
 void DYNV_VectorGeneric_Destroy(DYNV_VectorGenericDataType *TheVector, void (*DeleteElementFunction)(DYNV_VectorGenericDataType *TheVector))
@@ -125,10 +125,7 @@ void DYNV_VectorGeneric_Destroy(DYNV_VectorGenericDataType *TheVector, void (*De
 	DeleteElementFunction(TheVector);
 	//DYNMEM_free(TheVector->Data[i], &TheVector->memoryTable);
 
-    DYNMEM_free(TheVector->Data, &TheVector->memoryTable);
-    DYNMEM_free(TheVector->ElementSize, &TheVector->memoryTable);
-    TheVector->Data = NULL;
-    TheVector->ElementSize = NULL;
+    DYNV_Release(&TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     TheVector->Size = 0;
 }
 
@@ -139,44 +136,47 @@ void DYNV_VectorGeneric_SoftDestroy(DYNV_VectorGenericDataType *TheVector)
     {
         DYNMEM_free(TheVector->Data[i], &TheVector->memoryTable);
     }
-    DYNMEM_free(TheVector->Data, &TheVector->memoryTable);
-    DYNMEM_free(TheVector->ElementSize, &TheVector->memoryTable);
 
-    TheVector->Data = NULL;
-    TheVector->ElementSize = NULL;
+    DYNV_Release(&TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     TheVector->Size = 0;
 }
 
 void DYNV_VectorGeneric_DeleteAt(DYNV_VectorGenericDataType *TheVector, int index, void (*DeleteElementFunction)(void *TheElementToDelete))
 {
-    int i;
-    DYNV_VectorGenericDataType TempVector;
-    DYNV_VectorGeneric_Init(&TempVector);
+    //Permanent delete of the item At on the Heap
+    DeleteElementFunction((void *) TheVector->Data[index]);
+    DYNMEM_free(TheVector->Data[index], &TheVector->memoryTable);
+
+    memmove(&TheVector->Data[index], &TheVector->Data[index + 1], sizeof(void *) * (TheVector->Size - index - 1));
+    memmove(&TheVector->ElementSize[index], &TheVector->ElementSize[index + 1], sizeof(int) * (TheVector->Size - index - 1));
+    TheVector->Size--;
 
-    for (i = index + 1; i < TheVector->Size; i++)
+    if (TheVector->Size == 0)
     {
-        DYNV_VectorGeneric_PushBack(&TempVector, TheVector->Data[i], TheVector->ElementSize[i]);
+        DYNV_Release(&TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     }
+}
 
-    //Permanent delete of the item At on the Heap
+/* Like DeleteAt but the last element takes the place of the deleted one, the order is not kept */
+void DYNV_VectorGeneric_SwapDeleteAt(DYNV_VectorGenericDataType *TheVector, int index, void (*DeleteElementFunction)(void *TheElementToDelete))
+{
     DeleteElementFunction((void *) TheVector->Data[index]);
+    DYNMEM_free(TheVector->Data[index], &TheVector->memoryTable);
 
-    while (TheVector->Size > index)
-    {
-        DYNV_VectorGeneric_SoftPopBack(TheVector);
-    }
+    TheVector->Size--;
+    TheVector->Data[index] = TheVector->Data[TheVector->Size];
+    TheVector->ElementSize[index] = TheVector->ElementSize[TheVector->Size];
 
-    for (i = 0; i < TempVector.Size; i++)
+    if (TheVector->Size == 0)
     {
-        DYNV_VectorGeneric_PushBack(TheVector, TempVector.Data[i], TempVector.ElementSize[i]);
+        DYNV_Release(&TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     }
-
-    DYNV_VectorGeneric_SoftDestroy(&TempVector);
 }
 
 void DYNV_VectorString_Init(DYNV_VectorString_DataType *TheVector)
 {
     TheVector->Size = 0;
+    TheVector->Capacity = 0;
     TheVector->Data = NULL;
     TheVector->ElementSize = NULL;
     TheVector->memoryTable = NULL;
@@ -190,56 +190,25 @@ void DYNV_VectorString_Init(DYNV_VectorString_DataType *TheVector)
 
 void DYNV_VectorString_PushBack(DYNV_VectorString_DataType *TheVector, char * TheString, int StringLenght)
 {
-    int i;
-
-    if (TheVector->Data != NULL)
-    {
-        TheVector->Data = (char **)DYNMEM_realloc(TheVector->Data, sizeof(char *) * (TheVector->Size+1), &TheVector->memoryTable);
-    }
-    else
-    {
-        TheVector->Data = (char **) DYNMEM_malloc (sizeof(char *) * (TheVector->Size+1), &TheVector->memoryTable, "pushback");
-    }
-
-    if (TheVector->ElementSize != NULL)
-    {
-        TheVector->ElementSize = (int *) DYNMEM_realloc (TheVector->ElementSize, sizeof(int) * (TheVector->Size+1), &TheVector->memoryTable);
-    }
-    else
-    {
-        TheVector->ElementSize = (int *) DYNMEM_malloc (sizeof(int) * 1, &TheVector->memoryTable, "pushback");
-    }
+    DYNV_Reserve((void ***) &TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, TheVector->Size, &TheVector->memoryTable);
 
     TheVector->Data[TheVector->Size] = (char *) DYNMEM_malloc((StringLenght + 1), &TheVector->memoryTable, "pushback");
+    memcpy(TheVector->Data[TheVector->Size], TheString, StringLenght);
 
-    for (i = 0; i < StringLenght; i++ )
-    {
-        TheVector->Data[TheVector->Size][i] = TheString[i];
-    }
-
-    TheVector->ElementSize[TheVector->Size] = i;
-    TheVector->Data[TheVector->Size][TheVector->ElementSize[TheVector->Size]] = '\0';
+    TheVector->ElementSize[TheVector->Size] = StringLenght;
+    TheVector->Data[TheVector->Size][StringLenght] = '\0';
     TheVector->Size++;
 }
 
 void DYNV_VectorString_PopBack(DYNV_VectorString_DataType *TheVector)
 {
 	DYNMEM_free(TheVector->Data[TheVector->Size-1], &TheVector->memoryTable);
+    TheVector->Size--;
 
-    if (TheVector->Size > 1)
-    {
-        TheVector->Data = (char **)DYNMEM_realloc(TheVector->Data, sizeof(char *) * (TheVector->Size-1), &TheVector->memoryTable);
-        TheVector->ElementSize = (int *) DYNMEM_realloc (TheVector->ElementSize, sizeof(int) * (TheVector->Size-1), &TheVector->memoryTable);
-    }
-    else
+    if (TheVector->Size == 0)
     {
-    	DYNMEM_free(TheVector->Data, &TheVector->memoryTable);
-        DYNMEM_free(TheVector->ElementSize, &TheVector->memoryTable);
-        TheVector->Data = NULL;
-        TheVector->ElementSize = NULL;
+        DYNV_Release((void ***) &TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     }
-
-    TheVector->Size--;
 }
 
 void DYNV_VectorString_Destroy(DYNV_VectorString_DataType *TheVector)
@@ -250,38 +219,20 @@ void DYNV_VectorString_Destroy(DYNV_VectorString_DataType *TheVector)
     	DYNMEM_free(TheVector->Data[i], &TheVector->memoryTable);
     }
 
-    if (TheVector->Data != NULL)
-    	DYNMEM_free(TheVector->Data, &TheVector->memoryTable);
-
-    if (TheVector->ElementSize != NULL)
-    	DYNMEM_free(TheVector->ElementSize, &TheVector->memoryTable);
-
-    TheVector->Data = NULL;
-    TheVector->ElementSize = NULL;
-
+    DYNV_Release((void ***) &TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     TheVector->Size = 0;
 }
 
 void DYNV_VectorString_DeleteAt(DYNV_VectorString_DataType *TheVector, int index)
 {
-    int i;
-    DYNV_VectorString_DataType TempVector;
-    DYNV_VectorString_Init(&TempVector);
+    DYNMEM_free(TheVector->Data[index], &TheVector->memoryTable);
 
-    for (i = index + 1; i < TheVector->Size; i++)
-    {
-        DYNV_VectorString_PushBack(&TempVector, TheVector->Data[i], TheVector->ElementSize[i]);
-    }
-
-    while (TheVector->Size > index)
-    {
-        DYNV_VectorString_PopBack(TheVector);
-    }
+    memmove(&TheVector->Data[index], &TheVector->Data[index + 1], sizeof(char *) * (TheVector->Size - index - 1));
+    memmove(&TheVector->ElementSize[index], &TheVector->ElementSize[index + 1], sizeof(int) * (TheVector->Size - index - 1));
+    TheVector->Size--;
 
-    for (i = 0; i < TempVector.Size; i++)
+    if (TheVector->Size == 0)
     {
-        DYNV_VectorString_PushBack(TheVector, TempVector.Data[i], TempVector.ElementSize[i]);
+        DYNV_Release((void ***) &TheVector->Data, &TheVector->ElementSize, &TheVector->Capacity, &TheVector->memoryTable);
     }
-
-    DYNV_VectorString_Destroy(&TempVector);
 }
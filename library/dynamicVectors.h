@@ -31,11 +31,15 @@
 extern "C" {
 #endif
 
+/* Data and ElementSize grow geometrically starting from this capacity */
+#define DYNV_INITIAL_CAPACITY	8
+
 struct DYNV_VectorString
 {
 	DYNMEM_MemoryTable_DataType *memoryTable;
     char **Data;
     int Size;
+    int Capacity;
     int *ElementSize;
     void (*PushBack)(void *TheVector, char * TheString, int StringLenght);
     void (*PopBack)(void *TheVector);
@@ -48,6 +52,7 @@ struct DYNV_VectorGenericDataStruct
 	DYNMEM_MemoryTable_DataType *memoryTable;
     void **Data;
     int Size;
+    int Capacity;
     int *ElementSize;
     void (*PushBack)(void *TheVectorGeneric, void * TheElementData, int TheElementSize);
     void (*PopBack)(void *TheVector, void (*DeleteElement)(void *TheElementToDelete));
@@ -55,6 +60,7 @@ struct DYNV_VectorGenericDataStruct
     void (*Destroy)(void *TheVector, void (*DeleteElement)(struct DYNV_VectorGenericDataStruct *TheElementToDelete));
     void (*SoftDestroy)(void *TheVector);
     void (*DeleteAt)(void *TheVector, int index, void (*DeleteElement)(void *TheElementToDelete));
+    void (*SwapDeleteAt)(void *TheVector, int index, void (*DeleteElement)(void *TheElementToDelete));
     int  (*SearchElement)(void *TheVectorGeneric, void * TheElementData);
 } typedef DYNV_VectorGenericDataType;
 
@@ -72,6 +78,7 @@ void DYNV_VectorGeneric_SoftPopBack(DYNV_VectorGenericDataType *TheVector);
 void DYNV_VectorGeneric_Destroy(DYNV_VectorGenericDataType *TheVector, void (*DeleteElementFunction)(DYNV_VectorGenericDataType *TheVector));
 void DYNV_VectorGeneric_SoftDestroy(DYNV_VectorGenericDataType *TheVector);
 void DYNV_VectorGeneric_DeleteAt(DYNV_VectorGenericDataType *TheVector, int index, void (*DeleteElementFunction)(void *TheElementToDelete));
+void DYNV_VectorGeneric_SwapDeleteAt(DYNV_VectorGenericDataType *TheVector, int index, void (*DeleteElementFunction)(void *TheElementToDelete));
 
 #ifdef	__cplusplus
 }
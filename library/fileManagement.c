@@ -34,6 +34,8 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/resource.h>
+#include <pthread.h>
+#include <errno.h>
 
 #include "fileManagement.h"
 #include "dynamicVectors.h"
@@ -514,6 +516,226 @@ int FILE_StringParametersBinarySearch(DYNV_VectorGenericDataType *TheVectorGener
 
 	}
 
+static int FILE_IsDotOrDotDot(const char *theName)
+{
+    return theName[0] == '.' && (theName[1] == '\0' || (theName[1] == '.' && theName[2] == '\0'));
+}
+
+/* Append the type and the name to the arena, returns 0 when the memory limit is reached */
+static int FILE_AddDirectoryListName(FILE_DirectoryList_DataType *theList, char *theName, unsigned char theType, long long int sortMemoryLimit, DYNMEM_MemoryTable_DataType ** memoryTable)
+{
+    long long int nameSize = strlen(theName) + 2;
+
+    if (theList->namesArenaSize + nameSize + (long long int) sizeof(char *) * (theList->filesNumber + 1) > sortMemoryLimit)
+        return 0;
+
+    if (theList->namesArenaSize + nameSize > theList->namesArenaCapacity)
+    {
+        long long int newCapacity = (theList->namesArenaCapacity > 0) ? theList->namesArenaCapacity : 16384;
+
+        while (theList->namesArenaSize + nameSize > newCapacity)
+            newCapacity *= 2;
+
+        if (theList->namesArena == NULL)
+            theList->namesArena = (char *) DYNMEM_malloc(newCapacity, &*memoryTable, "DirectoryList");
+        else
+            theList->namesArena = (char *) DYNMEM_realloc(theList->namesArena, newCapacity, &*memoryTable);
+
+        theList->namesArenaCapacity = newCapacity;
+    }
+
+    theList->namesArena[theList->namesArenaSize] = (char) theType;
+    memcpy(theList->namesArena + theList->namesArenaSize + 1, theName, nameSize - 1);
+    theList->namesArenaSize += nameSize;
+    theList->filesNumber++;
+
+    return 1;
+}
+
+static void FILE_ReleaseDirectoryListNames(FILE_DirectoryList_DataType *theList, DYNMEM_MemoryTable_DataType ** memoryTable)
+{
+    if (theList->fileNames != NULL)
+        DYNMEM_free(theList->fileNames, &*memoryTable);
+
+    if (theList->namesArena != NULL)
+        DYNMEM_free(theList->namesArena, &*memoryTable);
+
+    theList->fileNames = NULL;
+    theList->namesArena = NULL;
+    theList->namesArenaSize = 0;
+    theList->namesArenaCapacity = 0;
+    theList->filesNumber = 0;
+    theList->nextFileIndex = 0;
+}
+
+/* Open a directory, or take a single file, for FILE_GetNextDirectoryListName.
+   With a sortMemoryLimit the names are read and sorted like FILE_GetDirectoryInodeList,
+   a directory that does not fit in the limit is streamed unsorted.
+   Returns 0 for an invalid path */
+int FILE_OpenDirectoryList(char *thePath, FILE_DirectoryList_DataType *theList, long long int sortMemoryLimit, DYNMEM_MemoryTable_DataType ** memoryTable)
+{
+    int theFd, i;
+    long long int arenaIndex;
+    struct stat info;
+    struct dirent *dir;
+
+    theList->theDirectory = NULL;
+    theList->directoryFd = AT_FDCWD;
+    theList->isSorted = 0;
+    theList->singleFileName = NULL;
+    theList->namesArena = NULL;
+    theList->namesArenaSize = 0;
+    theList->namesArenaCapacity = 0;
+    theList->fileNames = NULL;
+    theList->filesNumber = 0;
+    theList->nextFileIndex = 0;
+
+    theFd = open(thePath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+    if (theFd == -1)
+    {
+        if (stat(thePath, &info) == 0 && S_ISREG(info.st_mode))
+        {
+            theList->singleFileName = thePath;
+            theList->isSorted = 1;
+            theList->filesNumber = 1;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    theList->theDirectory = fdopendir(theFd);
+    if (theList->theDirectory == NULL)
+    {
+        close(theFd);
+        return 0;
+    }
+
+    theList->directoryFd = theFd;
+
+    if (sortMemoryLimit <= 0)
+        return 1;
+
+    while ((dir = readdir(theList->theDirectory)) != NULL)
+    {
+        if (FILE_IsDotOrDotDot(dir->d_name))
+            continue;
+
+        if (FILE_AddDirectoryListName(theList, dir->d_name, dir->d_type, sortMemoryLimit, &*memoryTable) == 0)
+        {
+            //Too big to sort, stream it from the beginning
+            FILE_ReleaseDirectoryListNames(theList, &*memoryTable);
+            rewinddir(theList->theDirectory);
+            return 1;
+        }
+    }
+
+    theList->fileNames = (char **) DYNMEM_malloc(sizeof(char *) * (theList->filesNumber + 1), &*memoryTable, "DirectoryList");
+
+    for (i = 0, arenaIndex = 0; i < theList->filesNumber; i++)
+    {
+        theList->fileNames[i] = theList->namesArena + arenaIndex + 1;
+        arenaIndex += strlen(theList->fileNames[i]) + 2;
+    }
+
+    if (theList->filesNumber > 1)
+        qsort (theList->fileNames, theList->filesNumber, sizeof (const char *), FILE_CompareString);
+
+    theList->isSorted = 1;
+    return 1;
+}
+
+/* The name is valid until the next call, NULL at the end of the list.
+   theType, if not NULL, receives the d_type of the entry, DT_UNKNOWN when the file system doesn't report it */
+char * FILE_GetNextDirectoryListName(FILE_DirectoryList_DataType *theList, unsigned char *theType)
+{
+    struct dirent *dir;
+
+    if (theList->singleFileName != NULL)
+    {
+        if (theType != NULL)
+            *theType = DT_REG;
+
+        if (theList->nextFileIndex++ == 0)
+            return theList->singleFileName;
+
+        return NULL;
+    }
+
+    if (theList->isSorted == 1)
+    {
+        if (theList->nextFileIndex < theList->filesNumber)
+        {
+            if (theType != NULL)
+                *theType = (unsigned char) theList->fileNames[theList->nextFileIndex][-1];
+
+            return theList->fileNames[theList->nextFileIndex++];
+        }
+
+        return NULL;
+    }
+
+    if (theList->theDirectory == NULL)
+        return NULL;
+
+    while ((dir = readdir(theList->theDirectory)) != NULL)
+    {
+        if (FILE_IsDotOrDotDot(dir->d_name))
+            continue;
+
+        if (theType != NULL)
+            *theType = dir->d_type;
+
+        theList->filesNumber++;
+        return dir->d_name;
+    }
+
+    return NULL;
+}
+
+/* Stat an entry with a single fstatat, symbolic links report the target attributes like stat.
+   Returns 0 for a broken link or a vanished entry */
+int FILE_StatDirectoryListEntry(FILE_DirectoryList_DataType *theList, char *theName, struct stat *theInfo, int *isLink)
+{
+    *isLink = 0;
+
+    if (fstatat(theList->directoryFd, theName, theInfo, AT_SYMLINK_NOFOLLOW) == -1)
+        return 0;
+
+    if (S_ISLNK(theInfo->st_mode))
+    {
+        *isLink = 1;
+
+        if (fstatat(theList->directoryFd, theName, theInfo, 0) == -1)
+            return 0;
+    }
+
+    return 1;
+}
+
+int FILE_ReadDirectoryListLink(FILE_DirectoryList_DataType *theList, char *theName, char *theLinkPath, int theLinkPathSize)
+{
+    int len = readlinkat(theList->directoryFd, theName, theLinkPath, theLinkPathSize - 1);
+
+    if (len > 0)
+        theLinkPath[len] = '\0';
+
+    return len;
+}
+
+void FILE_CloseDirectoryList(FILE_DirectoryList_DataType *theList, DYNMEM_MemoryTable_DataType ** memoryTable)
+{
+    FILE_ReleaseDirectoryListNames(theList, &*memoryTable);
+
+    if (theList->theDirectory != NULL)
+        closedir(theList->theDirectory);
+
+    theList->theDirectory = NULL;
+    theList->directoryFd = AT_FDCWD;
+    theList->singleFileName = NULL;
+}
+
 char * FILE_GetFilenameFromPath(char * FileName)
 {
 	int i = 0;
@@ -529,35 +751,47 @@ char * FILE_GetFilenameFromPath(char * FileName)
 	return TheStr;
 }
 
+/* The 9 rwx characters of every permission combination, built once */
+static char FILE_PermissionsTable[512][10];
+static pthread_once_t FILE_PermissionsTableOnce = PTHREAD_ONCE_INIT;
+
+static void FILE_InitPermissionsTable(void)
+{
+    int i, bit;
+    const char *rwx = "rwxrwxrwx";
+
+    for (i = 0; i < 512; i++)
+    {
+        for (bit = 0; bit < 9; bit++)
+            FILE_PermissionsTable[i][bit] = (i & (0400 >> bit)) ? rwx[bit] : '-';
+
+        FILE_PermissionsTable[i][9] = '\0';
+    }
+}
+
+/* theString must hold 11 characters */
+void FILE_GetPermissionsStringFromMode(mode_t theMode, int isLink, char *theString)
+{
+    pthread_once(&FILE_PermissionsTableOnce, FILE_InitPermissionsTable);
+
+    theString[0] = isLink ? 'l' : ((S_ISDIR(theMode)) ? 'd' : '-');
+    memcpy(theString + 1, FILE_PermissionsTable[theMode & 0777], 10);
+}
+
 char * FILE_GetListPermissionsString(char *file, DYNMEM_MemoryTable_DataType ** memoryTable) {
     struct stat st, stl;
-    char *modeval = DYNMEM_malloc(sizeof(char) * 10 + 1, &*memoryTable, "getperm");
-    if(stat(file, &st) == 0) 
-    {
-        mode_t perm = st.st_mode;
-        modeval[0] = (S_ISDIR(st.st_mode)) ? 'd' : '-';
-        modeval[1] = (perm & S_IRUSR) ? 'r' : '-';
-        modeval[2] = (perm & S_IWUSR) ? 'w' : '-';
-        modeval[3] = (perm & S_IXUSR) ? 'x' : '-';
-        modeval[4] = (perm & S_IRGRP) ? 'r' : '-';
-        modeval[5] = (perm & S_IWGRP) ? 'w' : '-';
-        modeval[6] = (perm & S_IXGRP) ? 'x' : '-';
-        modeval[7] = (perm & S_IROTH) ? 'r' : '-';
-        modeval[8] = (perm & S_IWOTH) ? 'w' : '-';
-        modeval[9] = (perm & S_IXOTH) ? 'x' : '-';
-        modeval[10] = '\0';
-
-        if(lstat(file, &stl) == 0)
-        {
-            if (S_ISLNK(stl.st_mode)) 
-                modeval[0] = 'l'; // is a link
-        }
-           
-    }
-    else {
+    int isLink = 0;
+    char *modeval;
+
+    if(stat(file, &st) != 0)
         return NULL;
-    }
-    
+
+    if(lstat(file, &stl) == 0 && S_ISLNK(stl.st_mode))
+        isLink = 1;
+
+    modeval = DYNMEM_malloc(sizeof(char) * 10 + 1, &*memoryTable, "getperm");
+    FILE_GetPermissionsStringFromMode(st.st_mode, isLink, modeval);
+
     return modeval;
 }
 
@@ -640,21 +874,117 @@ int checkUserFilePermissions(char *fileName, int uid, int gid)
     return filePermissions;
 }
 
+struct FILE_NameCacheEntry
+{
+    int isValid;
+    unsigned int theId;
+    time_t timeStamp;
+    char theName[FILE_NAME_CACHE_NAME_SIZE];
+};
+
+static struct FILE_NameCacheEntry FILE_UserNameCache[FILE_NAME_CACHE_SIZE];
+static struct FILE_NameCacheEntry FILE_GroupNameCache[FILE_NAME_CACHE_SIZE];
+static pthread_mutex_t FILE_NameCacheMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* The buffer starts at the size suggested by sysconf and grows while the lookup returns ERANGE,
+   groups with many members don't fit in a fixed one */
+static void FILE_ResolveName(unsigned int theId, int isGroup, char *theName, int theNameSize)
+{
+    char *buffer = NULL, *newBuffer;
+    long bufferSize = sysconf((isGroup == 0) ? _SC_GETPW_R_SIZE_MAX : _SC_GETGR_R_SIZE_MAX);
+    int returnCode = ERANGE;
+
+    theName[0] = '\0';
+
+    if (bufferSize <= 0)
+        bufferSize = FILE_NAME_LOOKUP_BUFFER_SIZE;
+
+    while (returnCode == ERANGE && bufferSize <= FILE_NAME_LOOKUP_BUFFER_MAX)
+    {
+        newBuffer = (char *) realloc(buffer, bufferSize);
+
+        if (newBuffer == NULL)
+            break;
+
+        buffer = newBuffer;
+
+        if (isGroup == 0)
+        {
+            struct passwd pwd, *pw = NULL;
+            returnCode = getpwuid_r((uid_t) theId, &pwd, buffer, bufferSize, &pw);
+            if (returnCode == 0 && pw != NULL)
+                snprintf(theName, theNameSize, "%s", pw->pw_name);
+        }
+        else
+        {
+            struct group grp, *gr = NULL;
+            returnCode = getgrgid_r((gid_t) theId, &grp, buffer, bufferSize, &gr);
+            if (returnCode == 0 && gr != NULL)
+                snprintf(theName, theNameSize, "%s", gr->gr_name);
+        }
+
+        bufferSize *= 2;
+    }
+
+    free(buffer);
+}
+
+/* Name lookups go through NSS and may be slow, unknown ids are cached too */
+static int FILE_GetCachedName(struct FILE_NameCacheEntry *theCache, unsigned int theId, int isGroup, char *theName, int theNameSize)
+{
+    time_t now = time(NULL);
+    struct FILE_NameCacheEntry *entry = &theCache[theId % FILE_NAME_CACHE_SIZE];
+    char resolvedName[FILE_NAME_CACHE_NAME_SIZE];
+
+    pthread_mutex_lock(&FILE_NameCacheMutex);
+    if (entry->isValid == 1 &&
+        entry->theId == theId &&
+        now - entry->timeStamp < FILE_NAME_CACHE_TTL)
+    {
+        snprintf(theName, theNameSize, "%s", entry->theName);
+        pthread_mutex_unlock(&FILE_NameCacheMutex);
+        return theName[0] != '\0';
+    }
+    pthread_mutex_unlock(&FILE_NameCacheMutex);
+
+    FILE_ResolveName(theId, isGroup, resolvedName, FILE_NAME_CACHE_NAME_SIZE);
+
+    pthread_mutex_lock(&FILE_NameCacheMutex);
+    entry->isValid = 1;
+    entry->theId = theId;
+    entry->timeStamp = now;
+    memcpy(entry->theName, resolvedName, FILE_NAME_CACHE_NAME_SIZE);
+    pthread_mutex_unlock(&FILE_NameCacheMutex);
+
+    snprintf(theName, theNameSize, "%s", resolvedName);
+    return theName[0] != '\0';
+}
+
+/* Returns 0 and an empty name when the uid has no user */
+int FILE_GetOwnerName(uid_t theUid, char *theName, int theNameSize)
+{
+    return FILE_GetCachedName(FILE_UserNameCache, (unsigned int) theUid, 0, theName, theNameSize);
+}
+
+int FILE_GetGroupOwnerName(gid_t theGid, char *theName, int theNameSize)
+{
+    return FILE_GetCachedName(FILE_GroupNameCache, (unsigned int) theGid, 1, theName, theNameSize);
+}
+
 char * FILE_GetOwner(char *fileName, DYNMEM_MemoryTable_DataType **memoryTable)
 {
-    int returnCode = 0;
     char *toReturn;
+    char theName[FILE_NAME_CACHE_NAME_SIZE];
     struct stat info;
 
-    if ((returnCode = stat(fileName, &info)) == -1)
+    if (stat(fileName, &info) == -1)
         return NULL;
 
-    struct passwd *pw;
-    if ( (pw = getpwuid(info.st_uid)) == NULL)
+    if (FILE_GetOwnerName(info.st_uid, theName, FILE_NAME_CACHE_NAME_SIZE) == 0)
         return NULL;
 
-    toReturn = (char *) DYNMEM_malloc (strlen(pw->pw_name) + 1, &*memoryTable, "getowner");
-    strcpy(toReturn, pw->pw_name);
+    toReturn = (char *) DYNMEM_malloc (strlen(theName) + 1, &*memoryTable, "getowner");
+    strcpy(toReturn, theName);
 
     return toReturn;
 }
@@ -662,20 +992,67 @@ char * FILE_GetOwner(char *fileName, DYNMEM_MemoryTable_DataType **memoryTable)
 char * FILE_GetGroupOwner(char *fileName, DYNMEM_MemoryTable_DataType **memoryTable)
 {
     char *toReturn;
+    char theName[FILE_NAME_CACHE_NAME_SIZE];
     struct stat info;
+
     if (stat(fileName, &info) == -1 )
         return NULL;
-    struct group  *gr;
-    
-    if ((gr = getgrgid(info.st_gid)) == NULL)
+
+    if (FILE_GetGroupOwnerName(info.st_gid, theName, FILE_NAME_CACHE_NAME_SIZE) == 0)
         return NULL;
-    
-    toReturn = (char *) DYNMEM_malloc (strlen(gr->gr_name) + 1, &*memoryTable, "getowner");
-    strcpy(toReturn, gr->gr_name);
-    
+
+    toReturn = (char *) DYNMEM_malloc (strlen(theName) + 1, &*memoryTable, "getowner");
+    strcpy(toReturn, theName);
+
     return toReturn;
 }
 
+struct FILE_DateCacheEntry
+{
+    time_t dayStart;
+    time_t dayEnd;
+    char theString[32];
+};
+
+/* The list date has a day resolution, the string is formatted once per day and thread */
+void FILE_GetListDateString(time_t theTime, char *theString, int theStringSize)
+{
+    static __thread struct FILE_DateCacheEntry dateCache[FILE_DATE_CACHE_SIZE];
+    struct FILE_DateCacheEntry *entry = &dateCache[((unsigned long long int) theTime / 86400) % FILE_DATE_CACHE_SIZE];
+    struct tm theTm, dayTm;
+
+    if (theTime >= entry->dayStart && theTime < entry->dayEnd)
+    {
+        snprintf(theString, theStringSize, "%s", entry->theString);
+        return;
+    }
+
+    if (localtime_r(&theTime, &theTm) == NULL)
+    {
+        snprintf(theString, theStringSize, "%s", "Unknown");
+        return;
+    }
+
+    strftime(entry->theString, sizeof(entry->theString), "%b %d %Y", &theTm);
+
+    dayTm = theTm;
+    dayTm.tm_hour = 0;
+    dayTm.tm_min = 0;
+    dayTm.tm_sec = 0;
+    dayTm.tm_isdst = -1;
+    entry->dayStart = mktime(&dayTm);
+
+    dayTm = theTm;
+    dayTm.tm_mday++;
+    dayTm.tm_hour = 0;
+    dayTm.tm_min = 0;
+    dayTm.tm_sec = 0;
+    dayTm.tm_isdst = -1;
+    entry->dayEnd = mktime(&dayTm);
+
+    snprintf(theString, theStringSize, "%s", entry->theString);
+}
+
 time_t FILE_GetLastModifiedData(char *path)
 {
     struct stat statbuf;
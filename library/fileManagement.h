@@ -27,12 +27,26 @@
     #include <stdio.h> 
     #include <time.h> 
     #include <sys/types.h>
+    #include <sys/stat.h>
+    #include <dirent.h>
     #include "dynamicVectors.h"
 
     #define FILE_MAX_LINE_LENGHT			512
     #define FILE_MAX_PAR_VAR_SIZE			256
 
 
+	/* Resolved user and group names are kept for FILE_NAME_CACHE_TTL seconds */
+	#define FILE_NAME_CACHE_SIZE			256
+	#define FILE_NAME_CACHE_NAME_SIZE		256
+	#define FILE_NAME_CACHE_TTL				60
+
+	/* getpwuid_r and getgrgid_r buffer, used when sysconf has no size and grown up to the max on ERANGE */
+	#define FILE_NAME_LOOKUP_BUFFER_SIZE	4096
+	#define FILE_NAME_LOOKUP_BUFFER_MAX		(1024 * 1024)
+
+	/* Per thread memo of the LIST date strings, one slot per day */
+	#define FILE_DATE_CACHE_SIZE			64
+
 	#define FILE_PERMISSION_NO_RW			0
 	#define FILE_PERMISSION_R				1
 	#define FILE_PERMISSION_W				2
@@ -55,6 +69,25 @@
     }
     FILE_fileInfo_DataType;
 
+    /* A directory opened once, the names are relative to directoryFd.
+       For a single file path directoryFd is AT_FDCWD and the name is the path.
+       Sorted lists keep all the names in one arena, each after its d_type byte,
+       the others stream from readdir */
+    typedef struct FILE_DirectoryList_DataStruct
+    {
+        DIR     *theDirectory;
+        int     directoryFd;
+        int     isSorted;
+        char    *singleFileName;
+        char    *namesArena;
+        long long int namesArenaSize;
+        long long int namesArenaCapacity;
+        char    **fileNames;
+        int     filesNumber;
+        int     nextFileIndex;
+    }
+    FILE_DirectoryList_DataType;
+
     long long int  FILE_GetFileSize(FILE *theFilePointer);
     long int FILE_GetAvailableSpace(const char* ThePath);
     long long int FILE_GetFileSizeFromPath(char *TheFileName);
@@ -62,14 +95,23 @@
     int  FILE_IsDirectory (char *directory_path);
     void FILE_GetDirectoryInodeList(char * DirectoryInodeName, char *** InodeList, int * filesandfolders, int recursive, DYNMEM_MemoryTable_DataType ** memoryTable);
     int  FILE_GetDirectoryInodeCount(char * DirectoryInodeName);
+    int  FILE_OpenDirectoryList(char *thePath, FILE_DirectoryList_DataType *theList, long long int sortMemoryLimit, DYNMEM_MemoryTable_DataType ** memoryTable);
+    char * FILE_GetNextDirectoryListName(FILE_DirectoryList_DataType *theList, unsigned char *theType);
+    int  FILE_StatDirectoryListEntry(FILE_DirectoryList_DataType *theList, char *theName, struct stat *theInfo, int *isLink);
+    int  FILE_ReadDirectoryListLink(FILE_DirectoryList_DataType *theList, char *theName, char *theLinkPath, int theLinkPathSize);
+    void FILE_CloseDirectoryList(FILE_DirectoryList_DataType *theList, DYNMEM_MemoryTable_DataType ** memoryTable);
     int  FILE_GetStringFromFile(char * filename, char **file_content, DYNMEM_MemoryTable_DataType ** memoryTable);
     void FILE_ReadStringParameters(char * filename, DYNV_VectorGenericDataType *ParametersVector);
     int FILE_StringParametersLinearySearch(DYNV_VectorGenericDataType *TheVectorGeneric, void * name);
     int FILE_StringParametersBinarySearch(DYNV_VectorGenericDataType *TheVectorGeneric, void * Needle);
     char * FILE_GetFilenameFromPath(char * filename);
     char * FILE_GetListPermissionsString(char *file, DYNMEM_MemoryTable_DataType ** memoryTable);
+    void FILE_GetPermissionsStringFromMode(mode_t theMode, int isLink, char *theString);
     char * FILE_GetOwner(char *fileName, DYNMEM_MemoryTable_DataType ** memoryTable);
     char * FILE_GetGroupOwner(char *fileName, DYNMEM_MemoryTable_DataType ** memoryTable);
+    int FILE_GetOwnerName(uid_t theUid, char *theName, int theNameSize);
+    int FILE_GetGroupOwnerName(gid_t theGid, char *theName, int theNameSize);
+    void FILE_GetListDateString(time_t theTime, char *theString, int theStringSize);
     time_t FILE_GetLastModifiedData(char *path);
     void FILE_AppendToString(char ** sourceString, char *theString, DYNMEM_MemoryTable_DataType ** memoryTable);
     void FILE_DirectoryToParent(char ** sourceString, DYNMEM_MemoryTable_DataType ** memoryTable);
@@ -157,6 +157,29 @@ void configureContext(SSL_CTX *ctx, char *certificatePath, char* privateCertific
 }
 
 
+/* Data connections resume the session of the control connection from the cache or from a ticket */
+void configureSessionCache(SSL_CTX *ctx, int cacheSize, int sessionTimeout, int useTickets)
+{
+    static const unsigned char sessionIdContext[] = "uFTP";
+
+    SSL_CTX_set_session_id_context(ctx, sessionIdContext, sizeof(sessionIdContext) - 1);
+
+    if (cacheSize > 0)
+    {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(ctx, cacheSize);
+    }
+    else
+    {
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+    }
+
+    SSL_CTX_set_timeout(ctx, sessionTimeout);
+
+    if (useTickets == 0)
+        SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+}
+
 void ShowCerts(SSL* ssl)
 {   X509 *cert;
     char *line;
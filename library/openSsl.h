@@ -43,6 +43,7 @@ SSL_CTX *createServerContext();
 SSL_CTX *createClientContext();
 void configureContext(SSL_CTX *ctx, char *certificatePath, char* privateCertificatePath);
 void configureClientContext(SSL_CTX *ctx, char *certificatePath, char* privateCertificatePath);
+void configureSessionCache(SSL_CTX *ctx, int cacheSize, int sessionTimeout, int useTickets);
 void ShowCerts(SSL* ssl);
 #ifdef __cplusplus
 }
@@ -0,0 +1,243 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "portPool.h"
+#include "dynamicMemory.h"
+#include "errorHandling.h"
+
+/* Reserve a free port starting from a random bit, returns its index in the range or -1 */
+static int PORTPOOL_ReservePort(PORTPOOL_PoolDataType *ThePool)
+{
+    int i, startBit, word;
+    unsigned long long int usedBits;
+
+    if (ThePool->freePorts == 0)
+        return -1;
+
+    startBit = rand_r(&ThePool->randomSeed) % ThePool->portsNumber;
+    word = startBit / PORTPOOL_WORD_BITS;
+
+    /* The bits before the start are checked last, when the scan wraps around */
+    usedBits = ThePool->bitmap[word] | ((1ULL << (startBit % PORTPOOL_WORD_BITS)) - 1);
+
+    for (i = 0; i <= ThePool->bitmapWords; i++)
+    {
+        if (~usedBits != 0)
+        {
+            int theBit = __builtin_ctzll(~usedBits);
+
+            ThePool->bitmap[word] |= 1ULL << theBit;
+            ThePool->freePorts--;
+            return word * PORTPOOL_WORD_BITS + theBit;
+        }
+
+        word = (word + 1) % ThePool->bitmapWords;
+        usedBits = ThePool->bitmap[word];
+    }
+
+    return -1;
+}
+
+static void PORTPOOL_FreePort(PORTPOOL_PoolDataType *ThePool, int portIndex)
+{
+    unsigned long long int theMask = 1ULL << (portIndex % PORTPOOL_WORD_BITS);
+
+    if ((ThePool->bitmap[portIndex / PORTPOOL_WORD_BITS] & theMask) == 0)
+        return;
+
+    ThePool->bitmap[portIndex / PORTPOOL_WORD_BITS] &= ~theMask;
+    ThePool->freePorts++;
+}
+
+/* Reserve a port and bind a socket on it, returns the socket or -1 */
+static int PORTPOOL_BindPort(PORTPOOL_PoolDataType *ThePool, int *thePort)
+{
+    int tries, portIndex, theSocket;
+
+    for (tries = 0; tries < PORTPOOL_BIND_TRIES; tries++)
+    {
+        pthread_mutex_lock(&ThePool->poolMutex);
+        portIndex = PORTPOOL_ReservePort(ThePool);
+        pthread_mutex_unlock(&ThePool->poolMutex);
+
+        if (portIndex == -1)
+            return -1;
+
+        theSocket = ThePool->CreateSocket(ThePool->portMin + portIndex);
+
+        if (theSocket != -1)
+        {
+            *thePort = ThePool->portMin + portIndex;
+            return theSocket;
+        }
+
+        //Used outside the server, another port is tried
+        pthread_mutex_lock(&ThePool->poolMutex);
+        PORTPOOL_FreePort(ThePool, portIndex);
+        pthread_mutex_unlock(&ThePool->poolMutex);
+    }
+
+    return -1;
+}
+
+static void PORTPOOL_AddWarmSocket(PORTPOOL_PoolDataType *ThePool)
+{
+    int theSocket, thePort;
+
+    theSocket = PORTPOOL_BindPort(ThePool, &thePort);
+
+    if (theSocket == -1)
+        return;
+
+    pthread_mutex_lock(&ThePool->poolMutex);
+
+    if (ThePool->warmSize < ThePool->warmCapacity)
+    {
+        ThePool->warmSockets[ThePool->warmSize] = theSocket;
+        ThePool->warmPorts[ThePool->warmSize] = thePort;
+        ThePool->warmSize++;
+        theSocket = -1;
+    }
+    else
+    {
+        PORTPOOL_FreePort(ThePool, thePort - ThePool->portMin);
+    }
+
+    pthread_mutex_unlock(&ThePool->poolMutex);
+
+    if (theSocket != -1)
+        close(theSocket);
+}
+
+int PORTPOOL_Init(PORTPOOL_PoolDataType *ThePool, int portMin, int portMax, int warmCapacity, int (*CreateSocket)(int port))
+{
+    int i;
+
+    if (portMin < 1)
+        portMin = 1;
+
+    if (portMax > 65535)
+        portMax = 65535;
+
+    if (portMax < portMin)
+        portMax = portMin;
+
+    if (warmCapacity < 0)
+        warmCapacity = 0;
+
+    ThePool->memoryTable = NULL;
+    ThePool->randomSeed = (unsigned int) time(NULL) ^ (unsigned int) getpid();
+    ThePool->portMin = portMin;
+    ThePool->portsNumber = portMax - portMin + 1;
+    ThePool->freePorts = ThePool->portsNumber;
+    ThePool->bitmapWords = (ThePool->portsNumber + PORTPOOL_WORD_BITS - 1) / PORTPOOL_WORD_BITS;
+    ThePool->warmSize = 0;
+    ThePool->warmCapacity = warmCapacity;
+    ThePool->CreateSocket = CreateSocket;
+    ThePool->bitmap = (unsigned long long int *) DYNMEM_malloc(sizeof(unsigned long long int) * ThePool->bitmapWords, &ThePool->memoryTable, "PortPoolBitmap");
+    ThePool->warmSockets = (int *) DYNMEM_malloc(sizeof(int) * (warmCapacity + 1), &ThePool->memoryTable, "PortPoolWarmSockets");
+    ThePool->warmPorts = (int *) DYNMEM_malloc(sizeof(int) * (warmCapacity + 1), &ThePool->memoryTable, "PortPoolWarmPorts");
+    memset(ThePool->bitmap, 0, sizeof(unsigned long long int) * ThePool->bitmapWords);
+
+    /* The bits after the end of the range are never free */
+    for (i = ThePool->portsNumber; i < ThePool->bitmapWords * PORTPOOL_WORD_BITS; i++)
+        ThePool->bitmap[i / PORTPOOL_WORD_BITS] |= 1ULL << (i % PORTPOOL_WORD_BITS);
+
+    if (pthread_mutex_init(&ThePool->poolMutex, NULL) != 0)
+    {
+        report_error_q("Unable to init the port pool mutex", __FILE__, __LINE__, 0);
+    }
+
+    for (i = 0; i < warmCapacity; i++)
+        PORTPOOL_AddWarmSocket(ThePool);
+
+    return ThePool->portsNumber;
+}
+
+/* Returns a listening socket and its port in thePort, -1 when no port of the range is available.
+   The sockets wait in the pool only bound, nobody can connect before a session owns them */
+int PORTPOOL_Acquire(PORTPOOL_PoolDataType *ThePool, int *thePort)
+{
+    int theSocket, tries;
+
+    for (tries = 0; tries < PORTPOOL_BIND_TRIES; tries++)
+    {
+        theSocket = -1;
+        pthread_mutex_lock(&ThePool->poolMutex);
+
+        if (ThePool->warmSize > 0)
+        {
+            ThePool->warmSize--;
+            theSocket = ThePool->warmSockets[ThePool->warmSize];
+            *thePort = ThePool->warmPorts[ThePool->warmSize];
+        }
+
+        pthread_mutex_unlock(&ThePool->poolMutex);
+
+        if (theSocket == -1)
+            theSocket = PORTPOOL_BindPort(ThePool, thePort);
+
+        if (theSocket == -1)
+            return -1;
+
+        if (listen(theSocket, 1) == 0)
+            return theSocket;
+
+        printf("\n Could not listen %d errno = %d", theSocket, errno);
+        close(theSocket);
+
+        pthread_mutex_lock(&ThePool->poolMutex);
+        PORTPOOL_FreePort(ThePool, *thePort - ThePool->portMin);
+        pthread_mutex_unlock(&ThePool->poolMutex);
+    }
+
+    return -1;
+}
+
+/* The caller has closed the listening socket, the port is free again and the warm sockets are refilled */
+void PORTPOOL_Release(PORTPOOL_PoolDataType *ThePool, int thePort)
+{
+    int refill;
+
+    if (thePort < ThePool->portMin || thePort >= ThePool->portMin + ThePool->portsNumber)
+        return;
+
+    pthread_mutex_lock(&ThePool->poolMutex);
+    PORTPOOL_FreePort(ThePool, thePort - ThePool->portMin);
+    refill = ThePool->warmSize < ThePool->warmCapacity;
+    pthread_mutex_unlock(&ThePool->poolMutex);
+
+    if (refill)
+        PORTPOOL_AddWarmSocket(ThePool);
+}
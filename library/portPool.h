@@ -0,0 +1,69 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef PORT_POOL_H
+#define PORT_POOL_H
+
+#include <pthread.h>
+#include "dynamicMemory.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PORTPOOL_WORD_BITS                          64
+#define PORTPOOL_BIND_TRIES                         30
+
+struct PORTPOOL_Pool
+{
+    DYNMEM_MemoryTable_DataType *memoryTable;
+    pthread_mutex_t poolMutex;
+    unsigned int randomSeed;
+
+    /* One bit for each port of the range, set while the port is reserved */
+    unsigned long long int *bitmap;
+    int bitmapWords;
+    int portMin;
+    int portsNumber;
+    int freePorts;
+
+    /* Sockets already bound on a reserved port, handed out first and put in listen by PORTPOOL_Acquire */
+    int *warmSockets;
+    int *warmPorts;
+    int warmSize;
+    int warmCapacity;
+
+    /* Bind a socket on the port without listening, -1 when the port can't be used */
+    int (*CreateSocket)(int port);
+} typedef PORTPOOL_PoolDataType;
+
+int PORTPOOL_Init(PORTPOOL_PoolDataType *ThePool, int portMin, int portMax, int warmCapacity, int (*CreateSocket)(int port));
+int PORTPOOL_Acquire(PORTPOOL_PoolDataType *ThePool, int *thePort);
+void PORTPOOL_Release(PORTPOOL_PoolDataType *ThePool, int thePort);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PORT_POOL_H */
@@ -0,0 +1,188 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <time.h>
+
+#include "timerWheel.h"
+
+static void TWHEEL_Link(TWHEEL_WheelDataType *TheWheel, TWHEEL_TimerDataType *TheTimer);
+
+unsigned long long int TWHEEL_GetCoarseTime(void)
+{
+    struct timespec theTime;
+
+    #ifdef CLOCK_MONOTONIC_COARSE
+    if (clock_gettime(CLOCK_MONOTONIC_COARSE, &theTime) == 0)
+        return (unsigned long long int) theTime.tv_sec;
+    #endif
+
+    clock_gettime(CLOCK_MONOTONIC, &theTime);
+    return (unsigned long long int) theTime.tv_sec;
+}
+
+void TWHEEL_Init(TWHEEL_WheelDataType *TheWheel, void *theOwner)
+{
+    int level, slot;
+
+    TheWheel->currentTime = TWHEEL_GetCoarseTime();
+    TheWheel->currentTick = TheWheel->currentTime;
+    TheWheel->timersNumber = 0;
+    TheWheel->theOwner = theOwner;
+
+    //Each slot is the sentinel of a circular list
+    for (level = 0; level < TWHEEL_LEVELS; level++)
+    {
+        for (slot = 0; slot < TWHEEL_SLOTS; slot++)
+        {
+            TheWheel->slots[level][slot].next = &TheWheel->slots[level][slot];
+            TheWheel->slots[level][slot].previous = &TheWheel->slots[level][slot];
+        }
+    }
+}
+
+void TWHEEL_InitTimer(TWHEEL_TimerDataType *TheTimer, int timerId, void (*TimerFunction)(void *theOwner, int timerId))
+{
+    TheTimer->next = NULL;
+    TheTimer->previous = NULL;
+    TheTimer->expireTime = 0;
+    TheTimer->timerId = timerId;
+    TheTimer->TimerFunction = TimerFunction;
+}
+
+int TWHEEL_IsRunning(TWHEEL_TimerDataType *TheTimer)
+{
+    return (TheTimer->next != NULL);
+}
+
+/* Put the timer in the level that covers its distance from the current tick */
+static void TWHEEL_Link(TWHEEL_WheelDataType *TheWheel, TWHEEL_TimerDataType *TheTimer)
+{
+    unsigned long long int expireTick = TheTimer->expireTime;
+    unsigned long long int maximumTick = TheWheel->currentTick + (1ULL << (TWHEEL_SLOT_BITS * TWHEEL_LEVELS)) - 1;
+    TWHEEL_TimerDataType *theSlot;
+    int level;
+
+    if (expireTick < TheWheel->currentTick)
+        expireTick = TheWheel->currentTick;
+
+    //Far timers wait in the last level and are linked again when it cascades
+    if (expireTick > maximumTick)
+        expireTick = maximumTick;
+
+    for (level = 0; level < TWHEEL_LEVELS - 1; level++)
+    {
+        if (expireTick - TheWheel->currentTick < (1ULL << (TWHEEL_SLOT_BITS * (level + 1))))
+            break;
+    }
+
+    theSlot = &TheWheel->slots[level][(expireTick >> (TWHEEL_SLOT_BITS * level)) & (TWHEEL_SLOTS - 1)];
+    TheTimer->next = theSlot;
+    TheTimer->previous = theSlot->previous;
+    theSlot->previous->next = TheTimer;
+    theSlot->previous = TheTimer;
+}
+
+void TWHEEL_Start(TWHEEL_WheelDataType *TheWheel, TWHEEL_TimerDataType *TheTimer, unsigned long long int expireTime)
+{
+    TWHEEL_Stop(TheWheel, TheTimer);
+
+    //Expired deadlines run at the next tick
+    if (expireTime <= TheWheel->currentTick)
+        expireTime = TheWheel->currentTick + 1;
+
+    TheTimer->expireTime = expireTime;
+    TWHEEL_Link(TheWheel, TheTimer);
+    TheWheel->timersNumber++;
+}
+
+void TWHEEL_Stop(TWHEEL_WheelDataType *TheWheel, TWHEEL_TimerDataType *TheTimer)
+{
+    if (TheTimer->next == NULL)
+        return;
+
+    TheTimer->previous->next = TheTimer->next;
+    TheTimer->next->previous = TheTimer->previous;
+    TheTimer->next = NULL;
+    TheTimer->previous = NULL;
+    TheWheel->timersNumber--;
+}
+
+/* Update the cached clock and run the expired timers, the timer functions can start and stop any timer. Returns the number of expired timers */
+int TWHEEL_Advance(TWHEEL_WheelDataType *TheWheel)
+{
+    int expiredTimers = 0;
+
+    TheWheel->currentTime = TWHEEL_GetCoarseTime();
+
+    while (TheWheel->currentTick < TheWheel->currentTime)
+    {
+        TWHEEL_TimerDataType *theSlot;
+        int level;
+
+        //Nothing to run, jump to the current time
+        if (TheWheel->timersNumber == 0)
+        {
+            TheWheel->currentTick = TheWheel->currentTime;
+            break;
+        }
+
+        TheWheel->currentTick++;
+
+        //When a level wraps, the next slot of the upper level is spread on the lower ones
+        for (level = 1; level < TWHEEL_LEVELS; level++)
+        {
+            TWHEEL_TimerDataType *theTimer;
+
+            if (((TheWheel->currentTick >> (TWHEEL_SLOT_BITS * (level - 1))) & (TWHEEL_SLOTS - 1)) != 0)
+                break;
+
+            theSlot = &TheWheel->slots[level][(TheWheel->currentTick >> (TWHEEL_SLOT_BITS * level)) & (TWHEEL_SLOTS - 1)];
+            theTimer = theSlot->next;
+            theSlot->next = theSlot;
+            theSlot->previous = theSlot;
+
+            while (theTimer != theSlot)
+            {
+                TWHEEL_TimerDataType *nextTimer = theTimer->next;
+                TWHEEL_Link(TheWheel, theTimer);
+                theTimer = nextTimer;
+            }
+        }
+
+        //One timer at a time, the list can change while a timer function runs
+        theSlot = &TheWheel->slots[0][TheWheel->currentTick & (TWHEEL_SLOTS - 1)];
+        while (theSlot->next != theSlot)
+        {
+            TWHEEL_TimerDataType *theTimer = theSlot->next;
+
+            TWHEEL_Stop(TheWheel, theTimer);
+            theTimer->TimerFunction(TheWheel->theOwner, theTimer->timerId);
+            expiredTimers++;
+        }
+    }
+
+    return expiredTimers;
+}
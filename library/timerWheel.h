@@ -0,0 +1,68 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Hierarchical wheel with a tick of one second, 64 slots for each level */
+#define TWHEEL_LEVELS                               4
+#define TWHEEL_SLOT_BITS                            6
+#define TWHEEL_SLOTS                                (1 << TWHEEL_SLOT_BITS)
+
+struct TWHEEL_Timer
+{
+    /* Links of the slot list, next is NULL when the timer is not running */
+    struct TWHEEL_Timer *next, *previous;
+    unsigned long long int expireTime;
+    int timerId;
+    void (*TimerFunction)(void *theOwner, int timerId);
+} typedef TWHEEL_TimerDataType;
+
+struct TWHEEL_Wheel
+{
+    /* Coarse monotonic clock in seconds, cached by TWHEEL_Advance */
+    unsigned long long int currentTime;
+    unsigned long long int currentTick;
+    int timersNumber;
+    void *theOwner;
+    TWHEEL_TimerDataType slots[TWHEEL_LEVELS][TWHEEL_SLOTS];
+} typedef TWHEEL_WheelDataType;
+
+unsigned long long int TWHEEL_GetCoarseTime(void);
+void TWHEEL_Init(TWHEEL_WheelDataType *TheWheel, void *theOwner);
+void TWHEEL_InitTimer(TWHEEL_TimerDataType *TheTimer, int timerId, void (*TimerFunction)(void *theOwner, int timerId));
+void TWHEEL_Start(TWHEEL_WheelDataType *TheWheel, TWHEEL_TimerDataType *TheTimer, unsigned long long int expireTime);
+void TWHEEL_Stop(TWHEEL_WheelDataType *TheWheel, TWHEEL_TimerDataType *TheTimer);
+int TWHEEL_IsRunning(TWHEEL_TimerDataType *TheTimer);
+int TWHEEL_Advance(TWHEEL_WheelDataType *TheWheel);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,523 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/* splice, pipe2 and the pipe size fcntl are Linux extensions */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+
+#include "transport.h"
+
+static int TRANSPORT_WaitSocket(int socketDescriptor, short theEvents)
+{
+    struct pollfd socketPoll;
+
+    socketPoll.fd = socketDescriptor;
+    socketPoll.events = theEvents;
+    socketPoll.revents = 0;
+
+    return poll(&socketPoll, 1, TRANSPORT_POLL_TIMEOUT);
+}
+
+/* Plain sockets */
+static ssize_t plainRead(TRANSPORT_DataType *TheTransport, void *theBuffer, size_t theSize)
+{
+    return read(TheTransport->socketDescriptor, theBuffer, theSize);
+}
+
+static ssize_t plainWrite(TRANSPORT_DataType *TheTransport, const void *theBuffer, size_t theSize)
+{
+    return write(TheTransport->socketDescriptor, theBuffer, theSize);
+}
+
+static ssize_t plainWritev(TRANSPORT_DataType *TheTransport, const struct iovec *theVectors, int vectorsNumber)
+{
+    return writev(TheTransport->socketDescriptor, theVectors, vectorsNumber);
+}
+
+static long long int plainSendFile(TRANSPORT_DataType *TheTransport, int theFileDescriptor, long long int startFrom, long long int theFileSize)
+{
+    long long int toReturn = 0;
+    ssize_t sentSize;
+    size_t toSend;
+
+    #ifdef LARGE_FILE_SUPPORT_ENABLED
+        off64_t theOffset = (off64_t) startFrom;
+    #endif
+
+    #ifndef LARGE_FILE_SUPPORT_ENABLED
+        off_t theOffset = (off_t) startFrom;
+    #endif
+
+    while (theOffset < theFileSize)
+    {
+        toSend = TRANSPORT_SENDFILE_CHUNK_SIZE;
+        if (theFileSize - theOffset < toSend)
+            toSend = (size_t) (theFileSize - theOffset);
+
+        #ifdef LARGE_FILE_SUPPORT_ENABLED
+            sentSize = sendfile64(TheTransport->socketDescriptor, theFileDescriptor, &theOffset, toSend);
+        #endif
+
+        #ifndef LARGE_FILE_SUPPORT_ENABLED
+            sentSize = sendfile(TheTransport->socketDescriptor, theFileDescriptor, &theOffset, toSend);
+        #endif
+
+        if (sentSize > 0)
+        {
+            toReturn = toReturn + sentSize;
+            continue;
+        }
+
+        //The file has been truncated while sending
+        if (sentSize == 0)
+            break;
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            if (TheTransport->isEventDriven == 1)
+            {
+                if (toReturn > 0)
+                    return toReturn;
+
+                errno = EAGAIN;
+                return -1;
+            }
+
+            if (TRANSPORT_WaitSocket(TheTransport->socketDescriptor, POLLOUT) <= 0)
+            {
+                printf("\nTimeout while sending the retr file.");
+                return -1;
+            }
+
+            continue;
+        }
+
+        //Nothing has been sent yet, the caller can still use read and write
+        if (toReturn == 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP))
+            return TRANSPORT_NOT_SUPPORTED;
+
+        printf("\nError %d while sending retr file.", errno);
+        return -1;
+    }
+
+    return toReturn;
+}
+
+static long long int plainReceiveFile(TRANSPORT_DataType *TheTransport, int theFileDescriptor, int *thePipe)
+{
+    long long int toReturn = 0;
+    ssize_t receivedSize, writtenSize;
+
+    //splice can't write to a file opened in append mode
+    if ((fcntl(theFileDescriptor, F_GETFL) & O_APPEND) == O_APPEND)
+        return TRANSPORT_NOT_SUPPORTED;
+
+    if (thePipe[0] == -1)
+    {
+        if (pipe2(thePipe, O_CLOEXEC) == -1)
+        {
+            thePipe[0] = -1;
+            thePipe[1] = -1;
+            return TRANSPORT_NOT_SUPPORTED;
+        }
+
+        fcntl(thePipe[1], F_SETPIPE_SZ, TRANSPORT_SPLICE_CHUNK_SIZE);
+    }
+
+    while (1)
+    {
+        receivedSize = splice(TheTransport->socketDescriptor, NULL, thePipe[1], NULL, TRANSPORT_SPLICE_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+        //Transfer completed
+        if (receivedSize == 0)
+            break;
+
+        if (receivedSize < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                if (TheTransport->isEventDriven == 1)
+                {
+                    errno = EAGAIN;
+                    return -1;
+                }
+
+                if (TRANSPORT_WaitSocket(TheTransport->socketDescriptor, POLLIN) <= 0)
+                    break;
+
+                continue;
+            }
+
+            //Nothing is in the pipe yet, the caller can still use read and write
+            if (toReturn == 0 && (errno == EINVAL || errno == ENOSYS))
+                return TRANSPORT_NOT_SUPPORTED;
+
+            //Connection errors end the transfer as with read
+            break;
+        }
+
+        while (receivedSize > 0)
+        {
+            writtenSize = splice(thePipe[0], NULL, theFileDescriptor, NULL, receivedSize, SPLICE_F_MOVE | SPLICE_F_MORE);
+
+            if (writtenSize < 0 && errno == EINTR)
+                continue;
+
+            if (writtenSize <= 0)
+            {
+                printf("\nError %d while writing stor file.", errno);
+
+                //The pipe may still hold data, don't reuse it
+                close(thePipe[0]);
+                close(thePipe[1]);
+                thePipe[0] = -1;
+                thePipe[1] = -1;
+                return -1;
+            }
+
+            receivedSize = receivedSize - writtenSize;
+            toReturn = toReturn + writtenSize;
+        }
+
+        //The caller waits the next socket event
+        if (TheTransport->isEventDriven == 1)
+            break;
+    }
+
+    return toReturn;
+}
+
+static void plainShutdown(TRANSPORT_DataType *TheTransport)
+{
+    shutdown(TheTransport->socketDescriptor, SHUT_RDWR);
+}
+
+static int plainPending(TRANSPORT_DataType *TheTransport)
+{
+    return 0;
+}
+
+static const TRANSPORT_OperationsDataType plainOperations =
+{
+    plainRead,
+    plainWrite,
+    plainWritev,
+    plainSendFile,
+    plainReceiveFile,
+    plainShutdown,
+    plainPending
+};
+
+void TRANSPORT_InitPlain(TRANSPORT_DataType *TheTransport, int socketDescriptor)
+{
+    TheTransport->socketDescriptor = socketDescriptor;
+    TheTransport->isEventDriven = 0;
+    #ifdef OPENSSL_ENABLED
+    TheTransport->ssl = NULL;
+    #endif
+    TheTransport->operations = &plainOperations;
+}
+
+#ifdef OPENSSL_ENABLED
+/* TLS sessions, the OpenSSL errors are mapped on errno */
+static ssize_t tlsResult(TRANSPORT_DataType *TheTransport, int returnCode)
+{
+    if (returnCode > 0)
+        return returnCode;
+
+    switch (SSL_get_error(TheTransport->ssl, returnCode))
+    {
+        case SSL_ERROR_ZERO_RETURN:
+            return 0;
+
+        case SSL_ERROR_WANT_READ:
+        case SSL_ERROR_WANT_WRITE:
+            errno = EAGAIN;
+            return -1;
+
+        case SSL_ERROR_SYSCALL:
+            //The peer has closed without the TLS close notify
+            if (errno == 0)
+                return 0;
+            return -1;
+
+        default:
+            errno = EIO;
+            return -1;
+    }
+}
+
+static ssize_t tlsRead(TRANSPORT_DataType *TheTransport, void *theBuffer, size_t theSize)
+{
+    //SSL_get_error looks at the thread error queue, older errors must not be taken for this call
+    ERR_clear_error();
+    errno = 0;
+    return tlsResult(TheTransport, SSL_read(TheTransport->ssl, theBuffer, (int) theSize));
+}
+
+static ssize_t tlsWrite(TRANSPORT_DataType *TheTransport, const void *theBuffer, size_t theSize)
+{
+    ssize_t returnCode;
+
+    ERR_clear_error();
+    errno = 0;
+    returnCode = tlsResult(TheTransport, SSL_write(TheTransport->ssl, theBuffer, (int) theSize));
+
+    //A write never ends the stream
+    if (returnCode == 0)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    return returnCode;
+}
+
+/* One record for each vector, stops at the first one the session can't take */
+static ssize_t tlsWritev(TRANSPORT_DataType *TheTransport, const struct iovec *theVectors, int vectorsNumber)
+{
+    ssize_t toReturn = 0, writtenSize;
+    int i;
+
+    for (i = 0; i < vectorsNumber; i++)
+    {
+        writtenSize = tlsWrite(TheTransport, theVectors[i].iov_base, theVectors[i].iov_len);
+
+        if (writtenSize < 0)
+            return (toReturn > 0) ? toReturn : -1;
+
+        toReturn += writtenSize;
+
+        if (writtenSize < theVectors[i].iov_len)
+            break;
+    }
+
+    return toReturn;
+}
+
+#ifdef SSL_OP_ENABLE_KTLS
+/* The kernel encrypts the session, the file goes to the socket as with a plain one */
+static long long int ktlsSendFile(TRANSPORT_DataType *TheTransport, int theFileDescriptor, long long int startFrom, long long int theFileSize)
+{
+    long long int toReturn = 0;
+    ssize_t sentSize;
+    size_t toSend;
+
+    while (startFrom < theFileSize)
+    {
+        toSend = TRANSPORT_SENDFILE_CHUNK_SIZE;
+        if (theFileSize - startFrom < toSend)
+            toSend = (size_t) (theFileSize - startFrom);
+
+        ERR_clear_error();
+        errno = 0;
+        sentSize = tlsResult(TheTransport, (int) SSL_sendfile(TheTransport->ssl, theFileDescriptor, (off_t) startFrom, toSend, 0));
+
+        if (sentSize > 0)
+        {
+            startFrom = startFrom + sentSize;
+            toReturn = toReturn + sentSize;
+            continue;
+        }
+
+        //The file has been truncated while sending
+        if (sentSize == 0)
+            break;
+
+        if (errno == EINTR)
+            continue;
+
+        if (errno == EAGAIN)
+        {
+            if (TheTransport->isEventDriven == 1)
+            {
+                if (toReturn > 0)
+                    return toReturn;
+
+                errno = EAGAIN;
+                return -1;
+            }
+
+            if (TRANSPORT_WaitSocket(TheTransport->socketDescriptor, POLLOUT) <= 0)
+            {
+                printf("\nTimeout while sending the retr file.");
+                return -1;
+            }
+
+            continue;
+        }
+
+        printf("\nError %d while sending retr file.", errno);
+        return -1;
+    }
+
+    return toReturn;
+}
+#endif
+
+/* Only a kernel TLS session can send the file directly, the caller reads it in its buffer otherwise */
+static long long int tlsSendFile(TRANSPORT_DataType *TheTransport, int theFileDescriptor, long long int startFrom, long long int theFileSize)
+{
+    #ifdef SSL_OP_ENABLE_KTLS
+    if (BIO_get_ktls_send(SSL_get_wbio(TheTransport->ssl)))
+        return ktlsSendFile(TheTransport, theFileDescriptor, startFrom, theFileSize);
+    #endif
+
+    return TRANSPORT_NOT_SUPPORTED;
+}
+
+static long long int tlsReceiveFile(TRANSPORT_DataType *TheTransport, int theFileDescriptor, int *thePipe)
+{
+    return TRANSPORT_NOT_SUPPORTED;
+}
+
+/* Send the close notify, the peer one is not waited */
+static void tlsShutdown(TRANSPORT_DataType *TheTransport)
+{
+    int returnCode = SSL_shutdown(TheTransport->ssl);
+
+    shutdown(TheTransport->socketDescriptor, SHUT_RDWR);
+
+    if (returnCode == 0)
+        SSL_shutdown(TheTransport->ssl);
+}
+
+static int tlsPending(TRANSPORT_DataType *TheTransport)
+{
+    return SSL_pending(TheTransport->ssl);
+}
+
+static const TRANSPORT_OperationsDataType tlsOperations =
+{
+    tlsRead,
+    tlsWrite,
+    tlsWritev,
+    tlsSendFile,
+    tlsReceiveFile,
+    tlsShutdown,
+    tlsPending
+};
+
+void TRANSPORT_InitTls(TRANSPORT_DataType *TheTransport, int socketDescriptor, SSL *ssl)
+{
+    TheTransport->socketDescriptor = socketDescriptor;
+    TheTransport->isEventDriven = 0;
+    TheTransport->ssl = ssl;
+    TheTransport->operations = &tlsOperations;
+}
+
+/* Handshake on a blocking socket within timeoutSeconds, the socket is not blocking meanwhile.
+   Returns 1 on success, 0 or -1 on failure or timeout like SSL_accept and SSL_connect */
+int TRANSPORT_TlsHandshake(SSL *ssl, int socketDescriptor, int isServer, int timeoutSeconds)
+{
+    int returnCode, socketFlags, waitTime;
+    struct timespec deadline, now;
+    struct pollfd socketPoll;
+
+    if (SSL_set_fd(ssl, socketDescriptor) == 0)
+        return -1;
+
+    socketFlags = fcntl(socketDescriptor, F_GETFL);
+    fcntl(socketDescriptor, F_SETFL, socketFlags | O_NONBLOCK);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutSeconds;
+
+    while ((returnCode = isServer ? SSL_accept(ssl) : SSL_connect(ssl)) != 1)
+    {
+        switch (SSL_get_error(ssl, returnCode))
+        {
+            case SSL_ERROR_WANT_READ:
+                socketPoll.events = POLLIN;
+                break;
+            case SSL_ERROR_WANT_WRITE:
+                socketPoll.events = POLLOUT;
+                break;
+            default:
+                socketPoll.events = 0;
+                break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        waitTime = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+
+        if (socketPoll.events == 0 || waitTime <= 0)
+            break;
+
+        socketPoll.fd = socketDescriptor;
+        socketPoll.revents = 0;
+
+        if (poll(&socketPoll, 1, waitTime) == 0)
+        {
+            returnCode = 0;
+            break;
+        }
+    }
+
+    fcntl(socketDescriptor, F_SETFL, socketFlags);
+    return returnCode;
+}
+#endif
+
+/* Write the whole buffer, waiting the socket if it is not blocking. Returns the bytes written or -1 */
+ssize_t TRANSPORT_WriteAll(TRANSPORT_DataType *TheTransport, const void *theBuffer, size_t theSize)
+{
+    size_t bytesWritten = 0;
+    ssize_t returnCode;
+
+    while (bytesWritten < theSize)
+    {
+        returnCode = TRANSPORT_Write(TheTransport, (const char *) theBuffer + bytesWritten, theSize - bytesWritten);
+
+        if (returnCode > 0)
+        {
+            bytesWritten += returnCode;
+            continue;
+        }
+
+        if (returnCode < 0 && errno == EINTR)
+            continue;
+
+        if (returnCode < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+            TRANSPORT_WaitSocket(TheTransport->socketDescriptor, POLLOUT) > 0)
+            continue;
+
+        return -1;
+    }
+
+    return bytesWritten;
+}
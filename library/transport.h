@@ -0,0 +1,97 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#ifdef OPENSSL_ENABLED
+	#include <openssl/ssl.h>
+	#include <openssl/err.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRANSPORT_NOT_SUPPORTED                     -2
+#define TRANSPORT_SENDFILE_CHUNK_SIZE               (64 * 1024 * 1024)
+#define TRANSPORT_SPLICE_CHUNK_SIZE                 (1024 * 1024)
+#define TRANSPORT_POLL_TIMEOUT                      (60 * 1000)
+
+struct TRANSPORT_Transport;
+
+/*
+ * Read, Write and Writev return the bytes moved or -1 with errno set, EAGAIN when the
+ * socket would block, Read returns 0 at the end of the stream.
+ * SendFile and ReceiveFile move a file without a copy through a user buffer and return
+ * TRANSPORT_NOT_SUPPORTED before anything is moved when the transport can't do it.
+ * On an event driven transport they don't wait the socket: SendFile returns the bytes
+ * sent before it would block, ReceiveFile moves one chunk and returns 0 at the end of
+ * the stream, both return -1 with EAGAIN when nothing could be moved.
+ */
+struct TRANSPORT_Operations
+{
+    ssize_t (*Read)(struct TRANSPORT_Transport *TheTransport, void *theBuffer, size_t theSize);
+    ssize_t (*Write)(struct TRANSPORT_Transport *TheTransport, const void *theBuffer, size_t theSize);
+    ssize_t (*Writev)(struct TRANSPORT_Transport *TheTransport, const struct iovec *theVectors, int vectorsNumber);
+    long long int (*SendFile)(struct TRANSPORT_Transport *TheTransport, int theFileDescriptor, long long int startFrom, long long int theFileSize);
+    long long int (*ReceiveFile)(struct TRANSPORT_Transport *TheTransport, int theFileDescriptor, int *thePipe);
+    void (*Shutdown)(struct TRANSPORT_Transport *TheTransport);
+    /* Bytes already received and buffered by the transport, the socket won't signal them */
+    int (*Pending)(struct TRANSPORT_Transport *TheTransport);
+} typedef TRANSPORT_OperationsDataType;
+
+/* Chosen once for each connection, the call sites don't branch on TLS anymore */
+struct TRANSPORT_Transport
+{
+    int socketDescriptor;
+    int isEventDriven;
+    #ifdef OPENSSL_ENABLED
+    SSL *ssl;
+    #endif
+    const TRANSPORT_OperationsDataType *operations;
+} typedef TRANSPORT_DataType;
+
+#define TRANSPORT_Read(TheTransport, theBuffer, theSize)                    ((TheTransport)->operations->Read((TheTransport), (theBuffer), (theSize)))
+#define TRANSPORT_Write(TheTransport, theBuffer, theSize)                   ((TheTransport)->operations->Write((TheTransport), (theBuffer), (theSize)))
+#define TRANSPORT_Writev(TheTransport, theVectors, vectorsNumber)           ((TheTransport)->operations->Writev((TheTransport), (theVectors), (vectorsNumber)))
+#define TRANSPORT_SendFile(TheTransport, theFileDescriptor, startFrom, theFileSize) ((TheTransport)->operations->SendFile((TheTransport), (theFileDescriptor), (startFrom), (theFileSize)))
+#define TRANSPORT_ReceiveFile(TheTransport, theFileDescriptor, thePipe)     ((TheTransport)->operations->ReceiveFile((TheTransport), (theFileDescriptor), (thePipe)))
+#define TRANSPORT_Shutdown(TheTransport)                                    ((TheTransport)->operations->Shutdown((TheTransport)))
+#define TRANSPORT_Pending(TheTransport)                                     ((TheTransport)->operations->Pending((TheTransport)))
+
+void TRANSPORT_InitPlain(TRANSPORT_DataType *TheTransport, int socketDescriptor);
+#ifdef OPENSSL_ENABLED
+void TRANSPORT_InitTls(TRANSPORT_DataType *TheTransport, int socketDescriptor, SSL *ssl);
+int TRANSPORT_TlsHandshake(SSL *ssl, int socketDescriptor, int isServer, int timeoutSeconds);
+#endif
+ssize_t TRANSPORT_WriteAll(TRANSPORT_DataType *TheTransport, const void *theBuffer, size_t theSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TRANSPORT_H */
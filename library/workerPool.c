@@ -0,0 +1,152 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "workerPool.h"
+#include "dynamicMemory.h"
+#include "errorHandling.h"
+
+static void *WPOOL_ThreadHandle(void *TheArgument);
+
+int WPOOL_Init(WPOOL_PoolDataType *ThePool, int threadsNumber, size_t stackSize, int queueCapacity, void (*JobFunction)(int jobId))
+{
+    int i, returnCode;
+    pthread_attr_t threadAttributes;
+
+    ThePool->memoryTable = NULL;
+    ThePool->threadsNumber = 0;
+    ThePool->queueHead = 0;
+    ThePool->queueSize = 0;
+    ThePool->queueCapacity = queueCapacity;
+    ThePool->JobFunction = JobFunction;
+    ThePool->threads = (pthread_t *) DYNMEM_malloc(sizeof(pthread_t) * threadsNumber, &ThePool->memoryTable, "WorkerPoolThreads");
+    ThePool->queue = (int *) DYNMEM_malloc(sizeof(int) * queueCapacity, &ThePool->memoryTable, "WorkerPoolQueue");
+
+    if (pthread_mutex_init(&ThePool->poolMutex, NULL) != 0 ||
+        pthread_cond_init(&ThePool->jobAvailable, NULL) != 0)
+    {
+        report_error_q("Unable to init the worker pool mutex", __FILE__, __LINE__, 0);
+    }
+
+    pthread_attr_init(&threadAttributes);
+
+    if (stackSize > 0)
+    {
+        if (stackSize < PTHREAD_STACK_MIN)
+            stackSize = PTHREAD_STACK_MIN;
+
+        pthread_attr_setstacksize(&threadAttributes, stackSize);
+    }
+
+    for (i = 0; i < threadsNumber; i++)
+    {
+        returnCode = pthread_create(&ThePool->threads[i], &threadAttributes, WPOOL_ThreadHandle, ThePool);
+
+        if (returnCode != 0)
+        {
+            printf("\nWorker pool pthread_create error %d", returnCode);
+            break;
+        }
+
+        ThePool->threadsNumber++;
+    }
+
+    pthread_attr_destroy(&threadAttributes);
+    return ThePool->threadsNumber;
+}
+
+/* Queue the job, the first free thread runs JobFunction(jobId) */
+int WPOOL_Submit(WPOOL_PoolDataType *ThePool, int jobId)
+{
+    pthread_mutex_lock(&ThePool->poolMutex);
+
+    if (ThePool->queueSize == ThePool->queueCapacity)
+    {
+        pthread_mutex_unlock(&ThePool->poolMutex);
+        return -1;
+    }
+
+    ThePool->queue[(ThePool->queueHead + ThePool->queueSize) % ThePool->queueCapacity] = jobId;
+    ThePool->queueSize++;
+    pthread_cond_signal(&ThePool->jobAvailable);
+    pthread_mutex_unlock(&ThePool->poolMutex);
+    return 0;
+}
+
+/* Return 1 if the job was still waiting in the queue and has been removed */
+int WPOOL_RemoveQueuedJob(WPOOL_PoolDataType *ThePool, int jobId)
+{
+    int i, j, toReturn = 0;
+
+    pthread_mutex_lock(&ThePool->poolMutex);
+
+    for (i = 0; i < ThePool->queueSize; i++)
+    {
+        if (ThePool->queue[(ThePool->queueHead + i) % ThePool->queueCapacity] != jobId)
+            continue;
+
+        for (j = i; j < ThePool->queueSize - 1; j++)
+        {
+            ThePool->queue[(ThePool->queueHead + j) % ThePool->queueCapacity] = ThePool->queue[(ThePool->queueHead + j + 1) % ThePool->queueCapacity];
+        }
+
+        ThePool->queueSize--;
+        toReturn = 1;
+        break;
+    }
+
+    pthread_mutex_unlock(&ThePool->poolMutex);
+    return toReturn;
+}
+
+static void *WPOOL_ThreadHandle(void *TheArgument)
+{
+    WPOOL_PoolDataType *ThePool = (WPOOL_PoolDataType *) TheArgument;
+    int jobId;
+
+    while (1)
+    {
+        pthread_mutex_lock(&ThePool->poolMutex);
+
+        while (ThePool->queueSize == 0)
+        {
+            pthread_cond_wait(&ThePool->jobAvailable, &ThePool->poolMutex);
+        }
+
+        jobId = ThePool->queue[ThePool->queueHead];
+        ThePool->queueHead = (ThePool->queueHead + 1) % ThePool->queueCapacity;
+        ThePool->queueSize--;
+        pthread_mutex_unlock(&ThePool->poolMutex);
+
+        ThePool->JobFunction(jobId);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,60 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2018 Ugo Cirmignani.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <pthread.h>
+#include "dynamicMemory.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct WPOOL_Pool
+{
+    DYNMEM_MemoryTable_DataType *memoryTable;
+    pthread_t *threads;
+    int threadsNumber;
+
+    /* Ring buffer of the job ids waiting for a free thread */
+    int *queue;
+    int queueHead;
+    int queueSize;
+    int queueCapacity;
+
+    pthread_mutex_t poolMutex;
+    pthread_cond_t jobAvailable;
+    void (*JobFunction)(int jobId);
+} typedef WPOOL_PoolDataType;
+
+int WPOOL_Init(WPOOL_PoolDataType *ThePool, int threadsNumber, size_t stackSize, int queueCapacity, void (*JobFunction)(int jobId));
+int WPOOL_Submit(WPOOL_PoolDataType *ThePool, int jobId);
+int WPOOL_RemoveQueuedJob(WPOOL_PoolDataType *ThePool, int jobId);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* WORKER_POOL_H */